@@ -42,6 +42,14 @@ REGISTRY_COMMAND_MULTIPROC(ConfigAuthorization,        "b0552370-b87b-4fce-b3e3-
 REGISTRY_COMMAND_SINGLPROC(ConfigSavePassword,         "ab728622-221e-4690-b74c-2d3c60b82e32")
 REGISTRY_COMMAND_MULTIPROC(PlaybackFinish,             "cd6b68b6-2cda-4291-b3c8-365cf0e84828")
 REGISTRY_COMMAND_SINGLPROC(DiverterHandset,            "6650b9f5-a7e1-4255-8d6d-498e03e3dcdb")
+REGISTRY_COMMAND_SINGLPROC(VoiceStat,                  "a8a1cb54-4b9c-40cd-9b0a-d1574b357556")
+REGISTRY_COMMAND_SINGLPROC(AudioEchoCancel,            "c386be69-d5e3-43b3-a7b7-2740c6bc285f")
+REGISTRY_COMMAND_SINGLPROC(AudioEchoStat,              "b0245317-aec9-421d-a36d-ab1949638993")
+REGISTRY_COMMAND_SINGLPROC(VoiceFilterChain,           "c0e3ca9f-8f4c-414a-9e53-76082c54ae4d")
+REGISTRY_COMMAND_SINGLPROC(VoiceFilterStat,            "d4d993b7-b16f-4e88-9777-1467e705298d")
+REGISTRY_COMMAND_SINGLPROC(VoiceSendStat,              "ca9927c4-de0b-43a8-8f56-64305b1a42a5")
+REGISTRY_COMMAND_SINGLPROC(VoiceLatency,               "17066c4c-e03b-42b7-845f-64ef287daf72")
+REGISTRY_COMMAND_MULTIPROC(DtmfDigit,                  "45d7a8ca-6bf7-4ce8-a3c2-4f92e490e356")
 
 #undef REGISTRY_COMMAND_SINGLPROC
 #undef REGISTRY_COMMAND_MULTIPROC
@@ -478,6 +486,9 @@ bserial::RawVector ToxCallState::toRaw() const
     stream << friendNumber;
     B_SERIALIZE_V2(stream)
     stream << friendPublicKey;
+    B_SERIALIZE_V3(stream)
+    stream << audioBitRate;
+    stream << bitRateReason;
     B_SERIALIZE_RETURN
 }
 
@@ -490,6 +501,9 @@ void ToxCallState::fromRaw(const bserial::RawVector& vect)
     stream >> friendNumber;
     B_DESERIALIZE_V2(vect, stream)
     stream >> friendPublicKey;
+    B_DESERIALIZE_V3(vect, stream)
+    stream >> audioBitRate;
+    stream >> bitRateReason;
     B_DESERIALIZE_END
 }
 
@@ -683,5 +697,195 @@ void DiverterHandset::fromRaw(const bserial::RawVector& vect)
     B_DESERIALIZE_END
 }
 
+bserial::RawVector VoiceStat::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << delay;
+    stream << targetDelay;
+    stream << jitter;
+    stream << late;
+    stream << lost;
+    B_SERIALIZE_V2(stream)
+    stream << concealed;
+    B_SERIALIZE_RETURN
+}
+
+void VoiceStat::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> delay;
+    stream >> targetDelay;
+    stream >> jitter;
+    stream >> late;
+    stream >> lost;
+    B_DESERIALIZE_V2(vect, stream)
+    stream >> concealed;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector AudioEchoCancel::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << enable;
+    B_SERIALIZE_RETURN
+}
+
+void AudioEchoCancel::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> enable;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector AudioEchoStat::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << delay;
+    stream << delayEstimated;
+    stream << erle;
+    B_SERIALIZE_RETURN
+}
+
+void AudioEchoStat::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> delay;
+    stream >> delayEstimated;
+    stream >> erle;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector VoiceFilterChain::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << stages;
+    B_SERIALIZE_RETURN
+}
+
+void VoiceFilterChain::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> stages;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector VoiceFilterStat::Stage::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << name;
+    stream << frames;
+    stream << min;
+    stream << avg;
+    stream << max;
+    B_SERIALIZE_RETURN
+}
+
+void VoiceFilterStat::Stage::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> name;
+    stream >> frames;
+    stream >> min;
+    stream >> avg;
+    stream >> max;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector VoiceFilterStat::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << stages;
+    B_SERIALIZE_RETURN
+}
+
+void VoiceFilterStat::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> stages;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector VoiceSendStat::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << sent;
+    stream << suppressed;
+    stream << dropped;
+    stream << maxBacklog;
+    stream << maxLatency;
+    B_SERIALIZE_RETURN
+}
+
+void VoiceSendStat::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> sent;
+    stream >> suppressed;
+    stream >> dropped;
+    stream >> maxBacklog;
+    stream >> maxLatency;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector VoiceLatency::Segment::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << name;
+    stream << count;
+    stream << avg;
+    stream << max;
+    stream << p50;
+    stream << p95;
+    stream << p99;
+    stream << histogram;
+    B_SERIALIZE_RETURN
+}
+
+void VoiceLatency::Segment::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> name;
+    stream >> count;
+    stream >> avg;
+    stream >> max;
+    stream >> p50;
+    stream >> p95;
+    stream >> p99;
+    stream >> histogram;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector VoiceLatency::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << bounds;
+    stream << segments;
+    B_SERIALIZE_RETURN
+}
+
+void VoiceLatency::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> bounds;
+    stream >> segments;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector DtmfDigit::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << friendNumber;
+    stream << digit;
+    B_SERIALIZE_RETURN
+}
+
+void DtmfDigit::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> friendNumber;
+    stream >> digit;
+    B_DESERIALIZE_END
+}
+
 } // namespace data
 } // namespace pproto
@@ -184,6 +184,51 @@ extern const QUuidEx PlaybackFinish;
 */
 extern const QUuidEx DiverterHandset;
 
+/**
+  Статистика джиттер-буфера входящего голосового потока
+*/
+extern const QUuidEx VoiceStat;
+
+/**
+  Команда управляет эхоподавлением
+*/
+extern const QUuidEx AudioEchoCancel;
+
+/**
+  Информация о работе эхоподавления: оценка задержки эха и ERLE
+*/
+extern const QUuidEx AudioEchoStat;
+
+/**
+  Команда задает состав и порядок ступеней цепочки фильтров записанного
+  голосового сигнала
+*/
+extern const QUuidEx VoiceFilterChain;
+
+/**
+  Статистика времени обработки фреймов ступенями цепочки фильтров
+*/
+extern const QUuidEx VoiceFilterStat;
+
+/**
+  Статистика передачи записанных голосовых фреймов, отправляется по
+  окончании звонка
+*/
+extern const QUuidEx VoiceSendStat;
+
+/**
+  Гистограммы задержек голосовых фреймов по участкам аудио-тракта (см.
+  VoiceLatency). Во время звонка отправляется раз в секунду, значения
+  накапливаются с начала звонка
+*/
+extern const QUuidEx VoiceLatency;
+
+/**
+  Информирует модули программы о том, что во входящем голосовом потоке
+  обнаружено нажатие DTMF-клавиши на стороне собеседника
+*/
+extern const QUuidEx DtmfDigit;
+
 } // namespace command
 
 //---------------- Структуры данных используемые в сообщениях ----------------
@@ -557,6 +602,18 @@ struct ToxCallState : Data<&command::ToxCallState,
         Error        = 10  // В процессе звонка произошла какая-то ошибка
     };
 
+    // Причина последнего изменения битрейта исходящего голосового потока
+    enum class BitRateReason : quint32
+    {
+        Undefined         = 0,
+        Initial           = 1, // Начальное значение при установке соединения
+        NetworkSuggestion = 2, // Рекомендация ToxAV (bit rate callback)
+        TcpRelay          = 3, // Соединение с другом через TCP-релей
+        PacketLoss        = 4, // Потери входящих голосовых фреймов
+        Jitter            = 5, // Высокий джиттер входящего потока
+        Recovery          = 6  // Восстановление после улучшения условий сети
+    };
+
     Direction  direction = {Direction::Undefined};
     CallState  callState = {CallState::Undefined};
     CallEnd    callEnd   = {CallEnd::Undefined};
@@ -564,6 +621,9 @@ struct ToxCallState : Data<&command::ToxCallState,
     QByteArray friendPublicKey;            // Tox- Идентификатор друга
     quint32    friendNumber = quint32(-1); // Tox- Числовой идентификатор друга
 
+    quint32       audioBitRate  = {0}; // Битрейт исходящего голосового потока (Кбит/с)
+    BitRateReason bitRateReason = {BitRateReason::Undefined};
+
     DECLARE_B_SERIALIZE_FUNC
 };
 
@@ -739,6 +799,121 @@ struct DiverterHandset : Data<&command::DiverterHandset,
     DECLARE_B_SERIALIZE_FUNC
 };
 
+struct VoiceStat : Data<&command::VoiceStat,
+                         Message::Type::Command>
+{
+    quint32 delay       = {0}; // Текущая задержка воспроизведения (в мкс)
+    quint32 targetDelay = {0}; // Целевая задержка воспроизведения (в мкс)
+    quint32 jitter      = {0}; // Оценка джиттера входящего потока (в мкс)
+    quint32 late        = {0}; // Количество опоздавших фреймов
+    quint32 lost        = {0}; // Количество потерянных фреймов
+    quint32 concealed   = {0}; // Количество маскированных фреймов (PLC)
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
+struct AudioEchoCancel : Data<&command::AudioEchoCancel,
+                               Message::Type::Command,
+                               Message::Type::Answer>
+{
+    bool enable = {false}; // Признак использования эхоподавления
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
+struct AudioEchoStat : Data<&command::AudioEchoStat,
+                             Message::Type::Command>
+{
+    quint32 delay = {0}; // Задержка эха, используемая эхоподавителем (в мс)
+    bool delayEstimated = {false}; // Задержка получена по корреляции сигналов,
+                                   // иначе - по задержкам аудио-потоков
+    qint32 erle = {0};   // Ослабление эха (ERLE) в десятых долях дБ
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
+struct VoiceFilterChain : Data<&command::VoiceFilterChain,
+                                Message::Type::Command,
+                                Message::Type::Answer>
+{
+    // Наименования ступеней в порядке обработки: highpass, echo, noise,
+    // vad, agc, limiter. Ступень noise соответствует шумоподавлению, выбранному
+    // командой AudioNoise, ступень echo используется только при включенном
+    // эхоподавлении (команда AudioEchoCancel)
+    QVector<QString> stages;
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
+struct VoiceFilterStat : Data<&command::VoiceFilterStat,
+                               Message::Type::Command>
+{
+    struct Stage
+    {
+        QString name;
+        quint32 frames = {0}; // Количество обработанных фреймов
+        quint32 min = {0};    // Время обработки фрейма (в микросекундах)
+        quint32 avg = {0};
+        quint32 max = {0};
+
+        DECLARE_B_SERIALIZE_FUNC
+    };
+
+    // Статистика по ступеням, последний элемент (total) - по цепочке в целом
+    QVector<Stage> stages;
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
+struct VoiceSendStat : Data<&command::VoiceSendStat,
+                             Message::Type::Command>
+{
+    quint32 sent       = {0}; // Количество отправленных фреймов
+    quint32 suppressed = {0}; // Количество фреймов, не отправленных во время
+                              // пауз в речи (VAD)
+    quint32 dropped    = {0}; // Количество фреймов, отброшенных для соблюдения
+                              // ограничения задержки
+    quint32 maxBacklog = {0}; // Максимальное количество фреймов в очереди
+                              // на отправку
+    quint32 maxLatency = {0}; // Максимальная задержка отправки фрейма
+                              // от момента записи (в мкс)
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
+struct VoiceLatency : Data<&command::VoiceLatency,
+                            Message::Type::Command>
+{
+    struct Segment
+    {
+        QString name;
+        quint32 count = {0}; // Количество фреймов
+        quint32 avg = {0};   // Задержка (в микросекундах)
+        quint32 max = {0};
+        quint32 p50 = {0};   // Процентили (в микросекундах)
+        quint32 p95 = {0};
+        quint32 p99 = {0};
+        QVector<quint32> histogram;
+
+        DECLARE_B_SERIALIZE_FUNC
+    };
+
+    // Верхние границы интервалов гистограммы (в микросекундах)
+    QVector<quint32> bounds;
+    QVector<Segment> segments;
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
+struct DtmfDigit : Data<&command::DtmfDigit,
+                         Message::Type::Command>
+{
+    quint32 friendNumber = quint32(-1); // Tox- Числовой идентификатор друга
+    QString digit;                      // Клавиша: '0'-'9', '*', '#', 'A'-'D'
+
+    DECLARE_B_SERIALIZE_FUNC
+};
+
 
 } // namespace data
 } // namespace pproto
@@ -0,0 +1,459 @@
+#include "alsa_backend.h"
+#include "common/realtime.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/config/appl_conf.h"
+#include "shared/qt/logger_operators.h"
+
+#include <string>
+#include <string.h>
+#include <errno.h>
+
+#define log_error_m   alog::logger().error  (alog_line_location, "AlsaBackend")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "AlsaBackend")
+#define log_info_m    alog::logger().info   (alog_line_location, "AlsaBackend")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "AlsaBackend")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "AlsaBackend")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "AlsaBackend")
+
+using namespace std;
+
+static string alsaStrError(int err)
+{
+    return string("; Error: ") + snd_strerror(err);
+}
+
+#define ALSA_CHECK(CALL, MSG) { \
+    int err = CALL; \
+    if (err < 0) { \
+        log_error_m << MSG << alsaStrError(err); \
+        return false; \
+    } \
+}
+
+//------------------------------- AlsaStream ---------------------------------
+
+AlsaStream::AlsaStream(Kind kind, AudioBackend::Client* client)
+    : _kind(kind), _client(client)
+{}
+
+AlsaStream::~AlsaStream()
+{
+    close();
+}
+
+const char* AlsaStream::name() const
+{
+    switch (_kind)
+    {
+        case Kind::Playback: return "Playback";
+        case Kind::Voice:    return "Voice";
+        default:             return "Record";
+    }
+}
+
+bool AlsaStream::open(const QByteArray& device, AudioBackend::StreamSpec& spec,
+                      quint32 periodTime, quint32 periods)
+{
+    close();
+
+    snd_pcm_stream_t stream = (_kind == Kind::Record)
+                              ? SND_PCM_STREAM_CAPTURE
+                              : SND_PCM_STREAM_PLAYBACK;
+
+    int err = snd_pcm_open(&_pcm, device.constData(), stream, 0);
+    if (err < 0)
+    {
+        log_error_m << "Failed open device " << device
+                    << " for " << name() << " stream" << alsaStrError(err);
+        _pcm = nullptr;
+        return false;
+    }
+    if (!setParams(spec, periodTime, periods))
+    {
+        snd_pcm_close(_pcm);
+        _pcm = nullptr;
+        return false;
+    }
+    _spec = spec;
+    _stop = false;
+    _drained = (_kind != Kind::Playback);
+    _paceTimer.invalidate();
+
+    log_debug_m << name() << " stream opened"
+                << "; device: " << device
+                << "; access: " << (_mmap ? "mmap" : "rw")
+                << "; channels: " << int(spec.channels)
+                << "; sampling rate: " << spec.samplingRate
+                << "; period size: " << quint32(_periodSize)
+                << "; buffer size: " << quint32(_bufferSize);
+
+    start();
+    return true;
+}
+
+void AlsaStream::close()
+{
+    if (_pcm == nullptr)
+        return;
+
+    _stop = true;
+    wait();
+
+    snd_pcm_drop(_pcm);
+    snd_pcm_close(_pcm);
+    _pcm = nullptr;
+
+    // Поток звуков остановлен до окончания данных
+    if (!_drained.exchange(true))
+        _client->playbackDrained();
+
+    log_debug_m << name() << " stream closed";
+}
+
+bool AlsaStream::setParams(AudioBackend::StreamSpec& spec, quint32 periodTime,
+                           quint32 periods)
+{
+    snd_pcm_hw_params_t* hwParams;
+    snd_pcm_hw_params_alloca(&hwParams);
+
+    ALSA_CHECK(snd_pcm_hw_params_any(_pcm, hwParams),
+               "Failed call snd_pcm_hw_params_any()")
+
+    _mmap = (snd_pcm_hw_params_set_access(_pcm, hwParams,
+                                          SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0);
+    if (!_mmap)
+    {
+        log_warn_m << "Device of " << name() << " stream does not support"
+                   << " mmap access. Will be used read/write access";
+        ALSA_CHECK(snd_pcm_hw_params_set_access(_pcm, hwParams,
+                                                SND_PCM_ACCESS_RW_INTERLEAVED),
+                   "Failed call snd_pcm_hw_params_set_access()")
+    }
+    ALSA_CHECK(snd_pcm_hw_params_set_format(_pcm, hwParams, SND_PCM_FORMAT_S16_LE),
+               "Failed call snd_pcm_hw_params_set_format()")
+    ALSA_CHECK(snd_pcm_hw_params_set_channels(_pcm, hwParams, spec.channels),
+               "Failed set " << int(spec.channels) << " channels for "
+               << name() << " stream")
+
+    unsigned int rate = spec.samplingRate;
+    ALSA_CHECK(snd_pcm_hw_params_set_rate_near(_pcm, hwParams, &rate, nullptr),
+               "Failed call snd_pcm_hw_params_set_rate_near()")
+    if (rate != spec.samplingRate)
+    {
+        if (!spec.deviceRate)
+        {
+            log_error_m << "Device of " << name() << " stream does not support"
+                        << " sampling rate " << spec.samplingRate
+                        << " (nearest: " << rate << ")"
+                        << ". Use the plug device (e.g. plughw)";
+            return false;
+        }
+        spec.samplingRate = rate;
+    }
+
+    snd_pcm_uframes_t periodSize = snd_pcm_uframes_t(quint64(rate) * periodTime / 1000000);
+    ALSA_CHECK(snd_pcm_hw_params_set_period_size_near(_pcm, hwParams, &periodSize, nullptr),
+               "Failed call snd_pcm_hw_params_set_period_size_near()")
+
+    snd_pcm_uframes_t bufferSize = periodSize * qMax(periods, quint32(2));
+    ALSA_CHECK(snd_pcm_hw_params_set_buffer_size_near(_pcm, hwParams, &bufferSize),
+               "Failed call snd_pcm_hw_params_set_buffer_size_near()")
+
+    ALSA_CHECK(snd_pcm_hw_params(_pcm, hwParams),
+               "Failed apply hardware parameters of " << name() << " stream")
+
+    snd_pcm_hw_params_get_period_size(hwParams, &_periodSize, nullptr);
+    snd_pcm_hw_params_get_buffer_size(hwParams, &_bufferSize);
+    _frameSize = spec.channels * sizeof(qint16);
+
+    snd_pcm_sw_params_t* swParams;
+    snd_pcm_sw_params_alloca(&swParams);
+
+    ALSA_CHECK(snd_pcm_sw_params_current(_pcm, swParams),
+               "Failed call snd_pcm_sw_params_current()")
+    ALSA_CHECK(snd_pcm_sw_params_set_avail_min(_pcm, swParams, _periodSize),
+               "Failed call snd_pcm_sw_params_set_avail_min()")
+
+    // Воспроизведение начинается после заполнения всего буфера устройства,
+    // запись запускается явно (см. run())
+    if (_kind != Kind::Record)
+        ALSA_CHECK(snd_pcm_sw_params_set_start_threshold(_pcm, swParams, _bufferSize),
+                   "Failed call snd_pcm_sw_params_set_start_threshold()")
+
+    ALSA_CHECK(snd_pcm_sw_params(_pcm, swParams),
+               "Failed apply software parameters of " << name() << " stream")
+
+    if (!_mmap)
+        _buffer.resize(int(_bufferSize * _frameSize));
+
+    return true;
+}
+
+void AlsaStream::run()
+{
+    realtimeSetupThread("alsa_audio");
+
+    if (_kind == Kind::Record)
+    {
+        int err = snd_pcm_start(_pcm);
+        if (err < 0)
+            log_error_m << "Failed call snd_pcm_start()" << alsaStrError(err);
+    }
+
+    // Плагин null не имеет собственной синхронизации
+    const bool paced = (snd_pcm_type(_pcm) == SND_PCM_TYPE_NULL);
+
+    while (!_stop)
+    {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(_pcm);
+        if (avail < 0)
+        {
+            if (!recover(int(avail)))
+                break;
+            continue;
+        }
+        if (snd_pcm_uframes_t(avail) < _periodSize)
+        {
+            // Ожидание ограничено по времени только для проверки признака
+            // остановки потока
+            int err = snd_pcm_wait(_pcm, 100);
+            if (err < 0 && !recover(err))
+                break;
+            continue;
+        }
+
+        snd_pcm_uframes_t frames = qMin(snd_pcm_uframes_t(avail), _bufferSize);
+        if (!transfer(frames))
+            break;
+
+        if (paced)
+            pace(frames);
+    }
+
+    // Данные звука закончились: оставшиеся в буфере данные выводятся
+    // до конца, после чего клиент уведомляется о завершении потока
+    if (!_stop && _kind == Kind::Playback)
+    {
+        snd_pcm_drain(_pcm);
+        if (!_drained.exchange(true))
+            _client->playbackDrained();
+    }
+}
+
+bool AlsaStream::transfer(snd_pcm_uframes_t frames)
+{
+    while (frames > 0)
+    {
+        const snd_pcm_channel_area_t* areas;
+        snd_pcm_uframes_t offset = 0;
+        snd_pcm_uframes_t count = frames;
+        char* data;
+
+        if (_mmap)
+        {
+            int err = snd_pcm_mmap_begin(_pcm, &areas, &offset, &count);
+            if (err < 0)
+                return recover(err);
+
+            // Каналы чередуются, поэтому все они находятся в первой области
+            data = (char*)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+        }
+        else
+            data = _buffer.data();
+
+        snd_pcm_uframes_t done = count;
+        bool finished = false;
+
+        if (_kind == Kind::Record)
+        {
+            if (!_mmap)
+            {
+                snd_pcm_sframes_t res = snd_pcm_readi(_pcm, data, count);
+                if (res < 0)
+                    return recover(int(res));
+                count = done = snd_pcm_uframes_t(res);
+            }
+            _client->recordData(data, count * _frameSize, _spec, delay());
+        }
+        else
+        {
+            size_t nbytes = count * _frameSize;
+            size_t len = (_kind == Kind::Playback)
+                         ? _client->playbackData(data, nbytes, _spec)
+                         : _client->voiceData(data, nbytes, _spec, delay());
+            if (len < nbytes)
+            {
+                if (_kind == Kind::Playback)
+                {
+                    done = len / _frameSize;
+                    finished = true;
+                }
+                else
+                    memset(data + len, 0, nbytes - len);
+            }
+            if (!_mmap && done > 0)
+            {
+                snd_pcm_sframes_t res = snd_pcm_writei(_pcm, data, done);
+                if (res < 0)
+                    return recover(int(res));
+            }
+        }
+
+        if (_mmap)
+        {
+            snd_pcm_sframes_t res = snd_pcm_mmap_commit(_pcm, offset, done);
+            if (res < 0 || snd_pcm_uframes_t(res) != done)
+                return recover(res < 0 ? int(res) : -EPIPE);
+        }
+        if (finished)
+            return false;
+
+        frames -= count;
+    }
+    return true;
+}
+
+bool AlsaStream::recover(int err)
+{
+    if (err == -EPIPE)
+    {
+        if (_kind == Kind::Record)
+            _client->recordOverflow();
+        else
+            log_debug2_m << name() << " stream underrun";
+    }
+
+    int res = snd_pcm_recover(_pcm, err, 1);
+    if (res < 0)
+    {
+        log_error_m << "Failed recover " << name() << " stream" << alsaStrError(res);
+        return false;
+    }
+    if (_kind == Kind::Record)
+    {
+        res = snd_pcm_start(_pcm);
+        if (res < 0)
+        {
+            log_error_m << "Failed call snd_pcm_start()" << alsaStrError(res);
+            return false;
+        }
+    }
+    _paceTimer.invalidate();
+    return true;
+}
+
+quint32 AlsaStream::delay()
+{
+    snd_pcm_sframes_t frames = 0;
+    if (snd_pcm_delay(_pcm, &frames) < 0 || frames < 0)
+        return 0;
+
+    return quint32(quint64(frames) * 1000000 / _spec.samplingRate);
+}
+
+void AlsaStream::pace(snd_pcm_uframes_t frames)
+{
+    if (!_paceTimer.isValid())
+    {
+        _paceTimer.start();
+        _paceFrames = 0;
+    }
+    _paceFrames += frames;
+
+    // Данные опережают реальное время не более чем на длительность буфера
+    qint64 ahead = (qint64(_paceFrames) - qint64(_bufferSize)) * 1000000 / _spec.samplingRate
+                   - _paceTimer.nsecsElapsed() / 1000;
+    if (ahead > 0)
+        QThread::usleep(quint64(ahead));
+}
+
+//------------------------------- AlsaBackend --------------------------------
+
+AlsaBackend::~AlsaBackend()
+{
+    deinit();
+}
+
+bool AlsaBackend::init(Client* client)
+{
+    string device = "default";
+    config::base().getValue("audio.alsa.playback_device", device);
+    _playbackDevice = QByteArray::fromStdString(device);
+
+    device = "default";
+    config::base().getValue("audio.alsa.record_device", device);
+    _recordDevice = QByteArray::fromStdString(device);
+
+    string value = "5";
+    config::base().getValue("audio.alsa.period_time", value);
+
+    bool ok;
+    double periodTime = QString::fromStdString(value).toDouble(&ok);
+    if (!ok || periodTime < 1 || periodTime > 100)
+    {
+        log_error_m << "Invalid value of parameter audio.alsa.period_time: " << value
+                    << ". Will be used period time: 5 ms";
+        periodTime = 5;
+    }
+    _periodTime = quint32(periodTime * 1000);
+
+    int periods = 3;
+    config::base().getValue("audio.alsa.periods", periods);
+    _periods = quint32(qBound(2, periods, 16));
+
+    _playback = new AlsaStream(AlsaStream::Kind::Playback, client);
+    _voice    = new AlsaStream(AlsaStream::Kind::Voice, client);
+    _record   = new AlsaStream(AlsaStream::Kind::Record, client);
+
+    log_verbose_m << "Initialized"
+                  << "; playback device: " << _playbackDevice
+                  << "; record device: " << _recordDevice
+                  << "; period time: " << _periodTime << " us"
+                  << "; periods: " << _periods;
+    return true;
+}
+
+void AlsaBackend::deinit()
+{
+    delete _playback; _playback = nullptr;
+    delete _voice;    _voice = nullptr;
+    delete _record;   _record = nullptr;
+}
+
+bool AlsaBackend::startStream(AlsaStream* stream, const QByteArray& device,
+                              StreamSpec& spec)
+{
+    return stream->open(device, spec, _periodTime, _periods);
+}
+
+bool AlsaBackend::startPlayback(StreamSpec& spec)
+{
+    return startStream(_playback, _playbackDevice, spec);
+}
+
+void AlsaBackend::stopPlayback()
+{
+    _playback->close();
+}
+
+bool AlsaBackend::startVoice(StreamSpec& spec)
+{
+    return startStream(_voice, _playbackDevice, spec);
+}
+
+void AlsaBackend::stopVoice()
+{
+    _voice->close();
+}
+
+bool AlsaBackend::startRecord(StreamSpec& spec)
+{
+    return startStream(_record, _recordDevice, spec);
+}
+
+void AlsaBackend::stopRecord()
+{
+    _record->close();
+}
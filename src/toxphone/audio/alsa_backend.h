@@ -0,0 +1,124 @@
+#pragma once
+
+#include "audio/audio_backend.h"
+#include "shared/defmac.h"
+
+#include <alsa/asoundlib.h>
+#include <QtCore>
+#include <atomic>
+
+/**
+  Поток PCM-устройства ALSA. Обмен данными выполняется в отдельном потоке
+  через кольцевой буфер устройства (snd_pcm_mmap_begin/snd_pcm_mmap_commit):
+  клиент заполняет (или читает) буфер драйвера напрямую, без промежуточного
+  копирования. Если устройство не поддерживает mmap-доступ, используются
+  функции snd_pcm_writei/snd_pcm_readi.
+
+  Устройства без собственной синхронизации (плагин null) отдают буфер сразу
+  целиком, для них обмен данными ограничивается темпом реального времени.
+*/
+class AlsaStream : public QThread
+{
+public:
+    enum class Kind
+    {
+        Playback = 0, // Звуки
+        Voice    = 1, // Голос
+        Record   = 2  // Запись
+    };
+
+    AlsaStream(Kind, AudioBackend::Client*);
+    ~AlsaStream();
+
+    // Открывает и настраивает устройство, запускает поток. periodTime -
+    // длительность периода (в микросекундах), periods - количество периодов
+    // в буфере устройства
+    bool open(const QByteArray& device, AudioBackend::StreamSpec&,
+              quint32 periodTime, quint32 periods);
+
+    // Останавливает поток и закрывает устройство. Для потока звуков
+    // гарантирует единственный вызов Client::playbackDrained()
+    void close();
+
+    bool isOpen() const {return (_pcm != nullptr);}
+
+private:
+    DISABLE_DEFAULT_COPY(AlsaStream)
+    void run() override;
+
+    bool setParams(AudioBackend::StreamSpec&, quint32 periodTime, quint32 periods);
+
+    // Передает frames кадров между клиентом и устройством. Возвращает
+    // FALSE, если данные звука закончились или устройство недоступно
+    bool transfer(snd_pcm_uframes_t frames);
+
+    // Восстановление после переполнения буфера или приостановки устройства
+    bool recover(int err);
+
+    // Задержка устройства (в микросекундах)
+    quint32 delay();
+
+    // Ограничение темпа обмена для устройств без синхронизации
+    void pace(snd_pcm_uframes_t frames);
+
+    const char* name() const;
+
+private:
+    const Kind _kind;
+    AudioBackend::Client* const _client;
+
+    snd_pcm_t* _pcm = {nullptr};
+    AudioBackend::StreamSpec _spec;
+    snd_pcm_uframes_t _periodSize = {0};
+    snd_pcm_uframes_t _bufferSize = {0};
+    size_t _frameSize = {0};
+
+    bool _mmap = {true};
+    QByteArray _buffer; // Используется, если mmap-доступ недоступен
+
+    std::atomic_bool _stop = {false};
+    std::atomic_bool _drained = {true};
+
+    QElapsedTimer _paceTimer;
+    quint64 _paceFrames = {0};
+};
+
+/**
+  Бэкенд прямого доступа к устройствам ALSA без звукового сервера.
+  Устройства и параметры буферизации задаются в секции audio.alsa
+  файла конфигурации. Для проверки без звукового оборудования используются
+  плагин null и модуль snd-aloop (устройства hw:Loopback,0 и hw:Loopback,1).
+*/
+class AlsaBackend : public AudioBackend
+{
+public:
+    AlsaBackend() = default;
+    ~AlsaBackend();
+
+    bool init(Client*) override;
+    void deinit() override;
+
+    bool startPlayback(StreamSpec&) override;
+    void stopPlayback() override;
+
+    bool startVoice(StreamSpec&) override;
+    void stopVoice() override;
+
+    bool startRecord(StreamSpec&) override;
+    void stopRecord() override;
+
+private:
+    DISABLE_DEFAULT_COPY(AlsaBackend)
+    bool startStream(AlsaStream*, const QByteArray& device, StreamSpec&);
+
+private:
+    AlsaStream* _playback = {nullptr};
+    AlsaStream* _voice = {nullptr};
+    AlsaStream* _record = {nullptr};
+
+    QByteArray _playbackDevice = {"default"};
+    QByteArray _recordDevice = {"default"};
+
+    quint32 _periodTime = {5000}; // В микросекундах
+    quint32 _periods = {3};
+};
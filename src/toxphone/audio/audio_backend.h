@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QtCore>
+
+/**
+  Интерфейс бэкенда ввода/вывода звука, который используется вместо потоков
+  PulseAudio (параметр audio.backend). Единственная реализация - AlsaBackend.
+
+  Потоки PulseAudio этот интерфейс не реализуют: они связаны со списком
+  устройств, кэшем сэмплов и регулировкой громкости потоков в конфигураторе
+  и обслуживаются непосредственно модулем AudioDev. При использовании
+  PulseAudio бэкенд не создается.
+
+  Бэкенд обслуживает три потока: воспроизведение звуков (вызов, занято
+  и т.д.), воспроизведение голоса и запись голоса. Данные всегда передаются
+  в формате S16LE с чередованием каналов. Сами данные бэкенд не формирует
+  и не обрабатывает: он запрашивает их у клиента (AudioDev) через функции
+  интерфейса Client, которые вызываются в потоке бэкенда. Функции обратного
+  вызова потоков PulseAudio используют те же функции Client, поэтому
+  обработка данных не зависит от способа вывода звука.
+*/
+class AudioBackend
+{
+public:
+    // Параметры потока
+    struct StreamSpec
+    {
+        quint8  channels = {1};
+        quint32 samplingRate = {48000};
+
+        // Частота дискретизации выбирается по устройству (аналог флага
+        // PA_STREAM_FIX_RATE), фактическое значение записывается в samplingRate
+        bool deviceRate = {false};
+    };
+
+    // Источник и приемник данных потоков
+    class Client
+    {
+    public:
+        // Заполняет буфер воспроизведения звуков. Возвращает количество
+        // записанных байт, значение меньше nbytes - данные звука закончились
+        virtual size_t playbackData(char* data, size_t nbytes, const StreamSpec&) = 0;
+
+        // Поток воспроизведения звуков завершен: все данные выведены или
+        // поток остановлен функцией stopPlayback()
+        virtual void playbackDrained() = 0;
+
+        // Заполняет буфер воспроизведения голоса, delay - задержка вывода
+        // (в микросекундах)
+        virtual size_t voiceData(char* data, size_t nbytes, const StreamSpec&,
+                                 quint32 delay) = 0;
+
+        // Передает записанные данные, delay - задержка ввода (в микросекундах)
+        virtual void recordData(const char* data, size_t nbytes, const StreamSpec&,
+                                quint32 delay) = 0;
+
+        // Переполнение буфера записи, данные потеряны
+        virtual void recordOverflow() = 0;
+
+    protected:
+        ~Client() = default;
+    };
+
+    virtual ~AudioBackend() = default;
+
+    virtual bool init(Client*) = 0;
+    virtual void deinit() = 0;
+
+    // Функции старта потоков возвращают FALSE, если поток не удалось
+    // открыть. Фактические параметры потока записываются в StreamSpec
+    virtual bool startPlayback(StreamSpec&) = 0;
+    virtual void stopPlayback() = 0;
+
+    virtual bool startVoice(StreamSpec&) = 0;
+    virtual void stopVoice() = 0;
+
+    virtual bool startRecord(StreamSpec&) = 0;
+    virtual void stopRecord() = 0;
+};
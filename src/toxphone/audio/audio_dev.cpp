@@ -1,7 +1,10 @@
 #include "audio_dev.h"
+#include "audio/alsa_backend.h"
 #include "toxphone_appl.h"
 #include "common/functions.h"
+#include "common/realtime.h"
 #include "common/voice_filters.h"
+#include "tox/voice_sender.h"
 
 #include "shared/break_point.h"
 #include "shared/simple_ptr.h"
@@ -25,19 +28,44 @@
 #define log_debug_m   alog::logger().debug  (alog_line_location, "AudioDev")
 #define log_debug2_m  alog::logger().debug2 (alog_line_location, "AudioDev")
 
+// При использовании бэкенда ALSA mainloop не создается, блокировка
+// не выполняется
 struct MainloopLocker
 {
     pa_threaded_mainloop* const paMainLoop;
     MainloopLocker(pa_threaded_mainloop* paMainLoop) : paMainLoop(paMainLoop)
     {
-        pa_threaded_mainloop_lock(paMainLoop);
+        if (paMainLoop)
+            pa_threaded_mainloop_lock(paMainLoop);
     }
     ~MainloopLocker()
     {
-        pa_threaded_mainloop_unlock(paMainLoop);
+        if (paMainLoop)
+            pa_threaded_mainloop_unlock(paMainLoop);
     }
 };
 
+// Допустимые задержки записи (в микросекундах), соответствуют длительностям
+// фрейма кодека Opus
+static const quint32 recordLatencies[] = {2500, 5000, 10000, 20000, 40000, 60000};
+
+// Наименьшая задержка в автоматическом режиме: фильтры WebRtc и RNNoise
+// работают с фреймами, кратными 10 мс
+#define RECORD_LATENCY_AUTO_MIN 10000
+
+// Количество переполнений за сеанс записи, после которого задержка
+// в автоматическом режиме увеличивается
+#define RECORD_OVERFLOW_LIMIT 2
+
+// Количество сеансов записи без переполнений (длительностью не менее
+// RECORD_CLEAN_SESSION_TIME секунд), после которых задержка уменьшается
+#define RECORD_CLEAN_SESSIONS 3
+#define RECORD_CLEAN_SESSION_TIME 60
+
+// Длительность записанного сигнала (в микросекундах), которую вмещают пулы
+// и очереди тракта записи при наименьшей возможной задержке записи
+#define RECORD_BUFFER_TIME 120000
+
 static string paStrError(pa_context* context)
 {
     return string("; Error: ") + pa_strerror(pa_context_errno(context));
@@ -48,6 +76,16 @@ static string paStrError(pa_stream* stream)
     return string("; Error: ") + pa_strerror(pa_context_errno(pa_stream_get_context(stream)));
 }
 
+static AudioBackend::StreamSpec streamSpec(pa_stream* stream)
+{
+    const pa_sample_spec* paSampleSpec = pa_stream_get_sample_spec(stream);
+
+    AudioBackend::StreamSpec spec;
+    spec.channels = paSampleSpec->channels;
+    spec.samplingRate = paSampleSpec->rate;
+    return spec;
+}
+
 static void initChannelsVolume(const data::AudioStreamInfo& asi, pa_cvolume& volume)
 {
     volume.channels = asi.channels;
@@ -80,6 +118,16 @@ typedef simple_ptr<pa_operation, pa_operation_deleter> pa_operation_ptr;
     } \
 }
 
+// Состояние загрузки звука в кэш сэмплов PulseAudio
+struct SampleUpload
+{
+    AudioDev* audioDev = {nullptr};
+    QString fileName;
+    QByteArray name;
+    SoundCache::Sound::Ptr sound;
+    size_t pos = {0};
+};
+
 //-------------------------------- AudioDev ----------------------------------
 
 AudioDev& audioDev()
@@ -97,6 +145,11 @@ AudioDev::AudioDev()
     _recordAudioStreamInfo.type   = data::AudioStreamInfo::Type::Record;
 
     _playbackTimer.setSingleShot(true);
+    chk_connect_a(&_voiceStatTimer, &QTimer::timeout, this, &AudioDev::sendVoiceStat);
+
+    _sampleTimer.setSingleShot(true);
+    chk_connect_a(&_sampleTimer, &QTimer::timeout, this, &AudioDev::playSampleByTimer);
+    chk_connect_a(&_soundCache, &SoundCache::soundChanged, this, &AudioDev::soundChanged);
 
     #define FUNC_REGISTRATION(COMMAND) \
         _funcInvoker.registration(command:: COMMAND, &AudioDev::command_##COMMAND, this);
@@ -112,6 +165,87 @@ AudioDev::AudioDev()
 
 bool AudioDev::init()
 {
+    // Пулы создаются один раз, поэтому их размер рассчитывается по наименьшей
+    // задержке, которую может выбрать автоматический режим
+    quint32 minLatency = readRecordLatency();
+    if (_recordLatencyAuto)
+        minLatency = RECORD_LATENCY_AUTO_MIN;
+
+    quint32 recordFrames = (RECORD_BUFFER_TIME + minLatency - 1) / minLatency;
+    recordFrames = qBound(quint32(8), recordFrames, quint32(VOICE_QUEUE_MAX_CAPACITY));
+    log_verbose_m << "Record frame pool size: " << recordFrames;
+
+    if (!recordFramePool().init(recordFrames)
+        || !recordQueue_1().init(recordFrames) || !recordQueue_2().init(recordFrames)
+        || !sendQueue().init(recordFrames))
+    {
+        log_error_m << "Failed initialization of record frame queues";
+        return false;
+    }
+    if (!voiceFramePool().init(VOICE_QUEUE_MAX_CAPACITY)
+        || !voiceQueue().init(VOICE_QUEUE_MAX_CAPACITY))
+    {
+        log_error_m << "Failed initialization of voice frame queue";
+        return false;
+    }
+    if (!echoFramePool().init(16) || !echoQueue().init(16))
+    {
+        log_error_m << "Failed initialization of echo frame queue";
+        return false;
+    }
+
+    _streamsPrewarm = true;
+    config::base().getValue("audio.prewarm_streams", _streamsPrewarm);
+
+    // Звуки загружаются заранее, чтобы первое проигрывание не ожидало
+    // чтения файлов
+    _soundCache.init();
+
+    _sampleCache = true;
+    config::base().getValue("audio.sample_cache", _sampleCache);
+
+    _deviceDebounce = 200;
+    config::base().getValue("audio.device_debounce", _deviceDebounce);
+
+    _toneSynth = false;
+    string tonePlan = "files";
+    config::base().getValue("audio.tone_plan", tonePlan);
+    if (tonePlan != "files")
+    {
+        ToneGenerator::Plan plan;
+        if (ToneGenerator::planFromString(QString::fromStdString(tonePlan), plan))
+        {
+            _toneSynth = true;
+            _toneGenerator.setPlan(plan);
+            log_verbose_m << "Call progress tones are synthesized"
+                          << ". Tone plan: " << ToneGenerator::planName(plan);
+        }
+        else
+            log_error_m << "Invalid value of parameter audio.tone_plan: " << tonePlan
+                        << ". Sound files will be used";
+    }
+
+    string backend = "pulseaudio";
+    config::base().getValue("audio.backend", backend);
+    if (backend == "alsa")
+    {
+        // Звуковой сервер не используется: список устройств и кэш сэмплов
+        // недоступны, звуки проигрываются через поток воспроизведения
+        _sampleCache = false;
+        _backend = new AlsaBackend;
+        if (!_backend->init(this))
+        {
+            log_error_m << "Failed initialization of ALSA backend";
+            deinit();
+            return false;
+        }
+        log_verbose_m << "Audio backend: alsa";
+        return true;
+    }
+    if (backend != "pulseaudio")
+        log_error_m << "Unknown audio backend: " << backend
+                    << ". Will be used backend: pulseaudio";
+
     _paMainLoop = pa_threaded_mainloop_new();
     if (!_paMainLoop)
     {
@@ -169,6 +303,11 @@ void AudioDev::deinit()
         _recordStream = nullptr;
     }
 
+    if (_deviceEventTimer)
+    {
+        _paApi->time_free(_deviceEventTimer);
+        _deviceEventTimer = nullptr;
+    }
     if (_paContext)
     {
         pa_context_disconnect(_paContext);
@@ -181,6 +320,13 @@ void AudioDev::deinit()
         _paMainLoop = nullptr;
     }
     _paApi = nullptr;
+
+    if (_backend)
+    {
+        _backend->deinit();
+        delete _backend;
+        _backend = nullptr;
+    }
 }
 
 void AudioDev::playRingtone()
@@ -236,23 +382,55 @@ void AudioDev::playRingtoneByTimer()
 
 void AudioDev::playOutgoingByTimer()
 {
-    startPlayback("sound/outgoing_call.wav", std::numeric_limits<int>::max(),
+    if (_toneSynth)
+        startTone(ToneGenerator::Tone::Ringback, std::numeric_limits<int>::max(),
                   data::PlaybackFinish::Code::Outgoing);
+    else
+        startPlayback("sound/outgoing_call.wav", std::numeric_limits<int>::max(),
+                      data::PlaybackFinish::Code::Outgoing);
 }
 
 void AudioDev::playBusyByTimer()
 {
-    startPlayback("sound/busy.wav", 8, data::PlaybackFinish::Code::Busy);
+    if (_toneSynth)
+        startTone(ToneGenerator::Tone::Busy, 8, data::PlaybackFinish::Code::Busy);
+    else
+        startPlayback("sound/busy.wav", 8, data::PlaybackFinish::Code::Busy);
 }
 
 void AudioDev::playFailByTimer()
 {
-    startPlayback("sound/fail.wav", 1, data::PlaybackFinish::Code::Fail);
+    if (_toneSynth)
+        startTone(ToneGenerator::Tone::Congestion, 4, data::PlaybackFinish::Code::Fail);
+    else
+        startPlayback("sound/fail.wav", 1, data::PlaybackFinish::Code::Fail);
 }
 
 void AudioDev::playErrorByTimer()
 {
-    startPlayback("sound/error.wav", 1, data::PlaybackFinish::Code::Error);
+    if (_toneSynth)
+        startTone(ToneGenerator::Tone::Sit, 1, data::PlaybackFinish::Code::Error);
+    else
+        startPlayback("sound/error.wav", 1, data::PlaybackFinish::Code::Error);
+}
+
+void AudioDev::sendVoiceStat()
+{
+    if (!toxConfig().isActive())
+        return;
+
+    JitterBuffer::Stat stat = _jitterBuffer.stat();
+
+    data::VoiceStat voiceStat;
+    voiceStat.delay       = stat.delay;
+    voiceStat.targetDelay = stat.targetDelay;
+    voiceStat.jitter      = stat.jitter;
+    voiceStat.late        = stat.late;
+    voiceStat.lost        = stat.lost;
+    voiceStat.concealed   = stat.concealed;
+
+    Message::Ptr m = createMessage(voiceStat);
+    toxConfig().send(m);
 }
 
 void AudioDev::startPlayback(const QString& fileName, int cycleCount,
@@ -263,31 +441,102 @@ void AudioDev::startPlayback(const QString& fileName, int cycleCount,
     if (_playbackActive)
         return;
 
-    QString filePath = getFilePath(fileName);
-    if (filePath.isEmpty())
+    // Звук берется из кэша, файл разбирается только при первом обращении
+    SoundCache::Sound::Ptr sound = _soundCache.sound(fileName);
+    if (sound.empty())
     {
-        log_error_m << "File " << fileName << " not found";
+        log_error_m << "Failed get the playback sound " << fileName;
         return;
     }
-    if (_playbackFile.isOpen())
-        _playbackFile.close();
 
-    _playbackFile.setFileName(filePath);
-    if (!_playbackFile.open())
+    // Если звук загружен в кэш сэмплов PulseAudio, то поток воспроизведения
+    // не создается. Пока сэмпл не загружен, звук проигрывается через поток
+    if (_sampleCache && startSamplePlayback(fileName, cycleCount, playbackFinishCode))
+        return;
+
+    if (_backend)
     {
-        log_error_m << "Failed open the playback file " << filePath;
+        AudioBackend::StreamSpec spec;
+        spec.channels = sound->channels;
+        spec.samplingRate = sound->sampleRate;
+
+        _playbackTone = false;
+        _playbackSound = sound;
+        _playbackPos = 0;
+        if (startBackendPlayback(spec, cycleCount, playbackFinishCode))
+            log_debug_m << "Playback stream start (file: " << sound->filePath << ")";
         return;
     }
-    if (_playbackFile.header().bitsPerSample != 16)
+
+    MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
+
+    pa_sample_spec paSampleSpec;
+    paSampleSpec.format = PA_SAMPLE_S16LE;
+    paSampleSpec.channels = sound->channels;
+    paSampleSpec.rate = sound->sampleRate;
+
+    if (!createPlaybackStream(paSampleSpec, pa_stream_flags_t(PA_STREAM_NOFLAGS)))
+        return;
+
+    _playbackActive = true;
+    _playbackTone = false;
+    _playbackSound = sound;
+    _playbackPos = 0;
+    _playbackCycleCount = cycleCount;
+    _playbackFinish.code = playbackFinishCode;
+    log_debug_m << "Playback stream start (file: " << sound->filePath << ")";
+}
+
+void AudioDev::startTone(ToneGenerator::Tone tone, int cycleCount,
+                         data::PlaybackFinish::Code playbackFinishCode)
+{
+    QMutexLocker locker(&_streamLock); (void) locker;
+
+    if (_playbackActive)
+        return;
+
+    if (_backend)
     {
-        log_error_m << "Only 16 bits per sample is supported"
-                    << ". FIle: " << _playbackFile.fileName();
-        _playbackFile.close();
+        AudioBackend::StreamSpec spec;
+        spec.channels = 1;
+        spec.samplingRate = 48000;
+        spec.deviceRate = true;
+
+        _toneGenerator.start(tone, cycleCount);
+        _playbackTone = true;
+        _playbackSound = SoundCache::Sound::Ptr();
+        if (startBackendPlayback(spec, cycleCount, playbackFinishCode))
+            log_debug_m << "Playback stream start (tone: " << int(tone)
+                        << "; plan: " << ToneGenerator::planName(_toneGenerator.plan()) << ")";
         return;
     }
 
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
 
+    // Частота дискретизации потока выбирается сервером по устройству
+    // (PA_STREAM_FIX_RATE), поэтому сигнал формируется без передискретизации.
+    // Фактическая частота передается генератору при подключении потока
+    pa_sample_spec paSampleSpec;
+    paSampleSpec.format = PA_SAMPLE_S16LE;
+    paSampleSpec.channels = 1;
+    paSampleSpec.rate = 48000;
+
+    if (!createPlaybackStream(paSampleSpec, pa_stream_flags_t(PA_STREAM_FIX_RATE)))
+        return;
+
+    _toneGenerator.start(tone, cycleCount);
+
+    _playbackActive = true;
+    _playbackTone = true;
+    _playbackSound = SoundCache::Sound::Ptr();
+    _playbackFinish.code = playbackFinishCode;
+    log_debug_m << "Playback stream start (tone: " << int(tone)
+                << "; plan: " << ToneGenerator::planName(_toneGenerator.plan()) << ")";
+}
+
+bool AudioDev::createPlaybackStream(const pa_sample_spec& paSampleSpec,
+                                    pa_stream_flags_t flags)
+{
     if (_playbackStream)
     {
         log_debug_m << "Playback stream drop";
@@ -298,21 +547,17 @@ void AudioDev::startPlayback(const QString& fileName, int cycleCount,
                         << paStrError(_playbackStream);
         }
         pa_stream_unref(_playbackStream);
+        _playbackStream = 0;
         log_debug_m << "Playback stream dropped";
     }
 
     log_debug_m << "Create playback stream";
 
-    pa_sample_spec paSampleSpec;
-    paSampleSpec.format = PA_SAMPLE_S16LE;
-    paSampleSpec.channels = _playbackFile.header().numChannels;
-    paSampleSpec.rate = _playbackFile.header().sampleRate;
-
     _playbackStream = pa_stream_new(_paContext, "Playback", &paSampleSpec, 0);
     if (!_playbackStream)
     {
         log_error_m << "Failed call pa_stream_new()" << paStrError(_paContext);
-        return;
+        return false;
     }
 
     pa_stream_set_state_callback    (_playbackStream, playback_stream_state, this);
@@ -325,17 +570,32 @@ void AudioDev::startPlayback(const QString& fileName, int cycleCount,
 
     QByteArray devNameBuff;
     const char* devName = currentDeviceName(_sinkDevices, devNameBuff);
-    pa_stream_flags_t flags = pa_stream_flags_t(PA_STREAM_NOFLAGS);
     if (pa_stream_connect_playback(_playbackStream, devName, 0, flags, 0, 0) < 0)
     {
         log_error_m << "Failed call pa_stream_connect_playback()"
                     << paStrError(_playbackStream);
-        return;
+        return false;
     }
-    _playbackActive = true;
+    return true;
+}
+
+bool AudioDev::startBackendPlayback(AudioBackend::StreamSpec& spec, int cycleCount,
+                                    data::PlaybackFinish::Code playbackFinishCode)
+{
+    // Параметры проигрывания задаются до открытия устройства: поток
+    // бэкенда запрашивает данные сразу после открытия
     _playbackCycleCount = cycleCount;
     _playbackFinish.code = playbackFinishCode;
-    log_debug_m << "Playback stream start (file: " << _playbackFile.fileName() << ")";
+    _playbackActive = true;
+
+    if (!_backend->startPlayback(spec))
+    {
+        _playbackSound = SoundCache::Sound::Ptr();
+        _playbackTone = false;
+        _playbackActive = false;
+        return false;
+    }
+    return true;
 }
 
 void AudioDev::stopPlayback()
@@ -346,8 +606,21 @@ void AudioDev::stopPlayback()
     if (!_playbackActive)
         return;
 
+    if (_samplePlayback)
+    {
+        stopSamplePlayback(true);
+        return;
+    }
+
     log_debug_m << "Playback stream stop";
 
+    if (_backend)
+    {
+        // При закрытии устройства вызывается playbackDrained()
+        _backend->stopPlayback();
+        return;
+    }
+
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
     pa_stream_set_write_callback(_playbackStream, 0, 0);
     playback_stream_drain(_playbackStream, false, this);
@@ -356,32 +629,289 @@ void AudioDev::stopPlayback()
     _playbackActive = false;
 }
 
-void AudioDev::startVoice(const VoiceFrameInfo::Ptr& voiceFrameInfo)
+void AudioDev::uploadSamples()
 {
-    stopPlayback();
+    for (const QString& fileName : _soundCache.fileNames())
+        uploadSample(fileName);
+}
 
-    QMutexLocker locker(&_streamLock); (void) locker;
+void AudioDev::soundChanged(const QString& fileName)
+{
+    if (!_sampleCache)
+        return;
 
-    if (_voiceActive)
+    // Сэмпл с тем же именем заменяется на сервере новыми данными
+    if (_soundCache.contains(fileName))
+    {
+        uploadSample(fileName);
         return;
+    }
 
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
 
-    if (_voiceStream)
+    auto it = _samples.find(fileName);
+    if (it == _samples.end())
+        return;
+
+    O_PTR_MSG(pa_context_remove_sample(_paContext, it->name.constData(), nullptr, nullptr),
+              "Failed call pa_context_remove_sample()", _paContext, {})
+    _samples.erase(it);
+}
+
+void AudioDev::uploadSample(const QString& fileName)
+{
+    SoundCache::Sound::Ptr sound = _soundCache.sound(fileName);
+    if (sound.empty())
+        return;
+
+    MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
+
+    if (_paContext == nullptr || pa_context_get_state(_paContext) != PA_CONTEXT_READY)
+        return;
+
+    SampleUpload* upload = new SampleUpload;
+    upload->audioDev = this;
+    upload->fileName = fileName;
+    upload->name = "toxphone-" + QFileInfo(fileName).completeBaseName().toUtf8();
+    upload->sound = sound;
+
+    pa_sample_spec paSampleSpec;
+    paSampleSpec.format = PA_SAMPLE_S16LE;
+    paSampleSpec.channels = sound->channels;
+    paSampleSpec.rate = sound->sampleRate;
+
+    pa_stream* stream = pa_stream_new(_paContext, upload->name.constData(), &paSampleSpec, 0);
+    if (!stream)
+    {
+        log_error_m << "Failed call pa_stream_new()" << paStrError(_paContext);
+        delete upload;
+        return;
+    }
+
+    pa_stream_set_state_callback(stream, upload_stream_state, upload);
+    pa_stream_set_write_callback(stream, upload_stream_write, upload);
+
+    if (pa_stream_connect_upload(stream, size_t(sound->data.size())) < 0)
+    {
+        log_error_m << "Failed call pa_stream_connect_upload()" << paStrError(stream);
+        pa_stream_set_state_callback(stream, 0, 0);
+        pa_stream_set_write_callback(stream, 0, 0);
+        pa_stream_unref(stream);
+        delete upload;
+    }
+}
+
+bool AudioDev::startSamplePlayback(const QString& fileName, int cycleCount,
+                                   data::PlaybackFinish::Code playbackFinishCode)
+{
+    { //Block for MainloopLocker
+        MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
+
+        auto it = _samples.constFind(fileName);
+        if (it == _samples.constEnd())
+            return false;
+
+        _sample = it.value();
+        _sampleSinkInput = PA_INVALID_INDEX;
+        _samplePlayback = true;
+    }
+    _sampleFile = fileName;
+    _playbackActive = true;
+    _playbackCycleCount = cycleCount;
+    _playbackFinish.code = playbackFinishCode;
+    log_debug_m << "Sample playback start (file: " << fileName << ")";
+
+    playSampleByTimer();
+    return true;
+}
+
+void AudioDev::playSampleByTimer()
+{
+    if (!_samplePlayback)
+        return;
+
+    if (_playbackCycleCount <= 0)
     {
-        log_debug_m << "Voice stream drop";
-        pa_stream_set_write_callback(_voiceStream, 0, 0);
-        if (pa_stream_disconnect(_voiceStream) < 0)
+        stopSamplePlayback(false);
+        return;
+    }
+    --_playbackCycleCount;
+
+    { //Block for MainloopLocker
+        MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
+
+        QByteArray devNameBuff;
+        const char* devName = currentDeviceName(_sinkDevices, devNameBuff);
+        O_PTR_MSG(pa_context_play_sample_with_proplist(_paContext, _sample.name.constData(),
+                                                       devName, PA_VOLUME_INVALID, nullptr,
+                                                       sample_play, this),
+                  "Failed call pa_context_play_sample_with_proplist()", _paContext, {})
+    }
+
+    // Следующий цикл начинается по окончании проигрывания сэмпла
+    _sampleTimer.start(int(_sample.duration));
+}
+
+void AudioDev::stopSamplePlayback(bool interrupt)
+{
+    _sampleTimer.stop();
+
+    { //Block for MainloopLocker
+        MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
+        _samplePlayback = false;
+
+        // Прерывание проигрывания: сервер удаляет sink input сэмпла
+        uint32_t index = _sampleSinkInput.exchange(PA_INVALID_INDEX);
+        if (interrupt && index != PA_INVALID_INDEX)
+            O_PTR_MSG(pa_context_kill_sink_input(_paContext, index, nullptr, nullptr),
+                      "Failed call pa_context_kill_sink_input()", _paContext, {})
+
+        _palybackAudioStreamInfo.state = data::AudioStreamInfo::State::Terminated;
+        _palybackAudioStreamInfo.index = -1;
+        if (toxConfig().isActive())
         {
-            log_error_m << "Failed call pa_stream_connect_playback()"
-                        << paStrError(_voiceStream);
+            Message::Ptr m = createMessage(_palybackAudioStreamInfo);
+            toxConfig().send(m);
         }
-        pa_stream_unref(_voiceStream);
-        log_debug_m << "Voice stream dropped";
+        playbackFinished();
     }
+    _playbackActive = false;
 
-    log_debug_m << "Create voice stream";
-    _voiceBytes = 0;
+    log_debug_m << "Sample playback stopped (file: " << _sampleFile << ")";
+}
+
+void AudioDev::playbackFinished()
+{
+    if (_playbackTest)
+    {
+        if (toxConfig().isActive())
+        {
+            data::AudioTest audioTest;
+            audioTest.begin = false;
+            audioTest.playback = true;
+
+            Message::Ptr m = createMessage(audioTest);
+            toxConfig().send(m);
+        }
+        _playbackTest = false;
+    }
+    if (_emitPlaybackFinish)
+    {
+        Message::Ptr m = createMessage(_playbackFinish);
+        emit internalMessage(m);
+    }
+    _playbackFinish.code = data::PlaybackFinish::Code::Undefined;
+    _emitPlaybackFinish = true;
+}
+
+void AudioDev::prepareStreams()
+{
+    // Устройства ALSA открываются быстро и захватываются на время открытия,
+    // поэтому заранее не открываются
+    if (!_streamsPrewarm || _backend)
+        return;
+
+    QMutexLocker locker(&_streamLock); (void) locker;
+    MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
+
+    if (!_voiceActive)
+    {
+        VoiceFrameInfo::Ptr voiceFrameInfo = _voiceStreamInfo;
+        if (voiceFrameInfo.empty())
+            voiceFrameInfo = defaultVoiceFrameInfo();
+
+        if (!voiceStreamValid(*voiceFrameInfo))
+            createVoiceStream(voiceFrameInfo, true);
+    }
+    if (!_recordActive)
+    {
+        quint32 latency = readRecordLatency();
+        if (!recordStreamValid(latency))
+            createRecordStream(latency, true);
+    }
+}
+
+bool AudioDev::voiceStreamValid(const VoiceFrameInfo& voiceFrameInfo)
+{
+    if (!_voiceStream || _voiceStreamInfo.empty())
+        return false;
+
+    pa_stream_state_t state = pa_stream_get_state(_voiceStream);
+    if (state != PA_STREAM_CREATING && state != PA_STREAM_READY)
+        return false;
+
+    if (_voiceStreamInfo->channels != voiceFrameInfo.channels
+        || _voiceStreamInfo->sampleCount != voiceFrameInfo.sampleCount
+        || _voiceStreamInfo->samplingRate != voiceFrameInfo.samplingRate)
+    {
+        return false;
+    }
+
+    QByteArray devNameBuff;
+    const char* devName = currentDeviceName(_sinkDevices, devNameBuff);
+    return (_voiceStreamDevice == QByteArray(devName));
+}
+
+bool AudioDev::recordStreamValid(quint32 latency)
+{
+    if (!_recordStream || _recordStreamInfo.empty())
+        return false;
+
+    pa_stream_state_t state = pa_stream_get_state(_recordStream);
+    if (state != PA_STREAM_CREATING && state != PA_STREAM_READY)
+        return false;
+
+    if (_recordStreamInfo->latency != latency)
+        return false;
+
+    QByteArray devNameBuff;
+    const char* devName = currentDeviceName(_sourceDevices, devNameBuff);
+    return (_recordStreamDevice == QByteArray(devName));
+}
+
+void AudioDev::dropVoiceStream()
+{
+    if (!_voiceStream)
+        return;
+
+    log_debug_m << "Voice stream drop";
+    pa_stream_set_write_callback(_voiceStream, 0, 0);
+    if (pa_stream_disconnect(_voiceStream) < 0)
+    {
+        log_error_m << "Failed call pa_stream_disconnect()"
+                    << paStrError(_voiceStream);
+    }
+    pa_stream_unref(_voiceStream);
+    _voiceStream = 0;
+    _voiceStreamInfo = VoiceFrameInfo::Ptr();
+    _voiceStreamDevice.clear();
+    log_debug_m << "Voice stream dropped";
+}
+
+void AudioDev::dropRecordStream()
+{
+    if (!_recordStream)
+        return;
+
+    log_debug_m << "Record stream drop";
+    pa_stream_set_read_callback(_recordStream, 0, 0);
+    if (pa_stream_disconnect(_recordStream) < 0)
+    {
+        log_error_m << "Failed call pa_stream_disconnect()"
+                    << paStrError(_recordStream);
+    }
+    pa_stream_unref(_recordStream);
+    _recordStream = 0;
+    _recordStreamInfo = VoiceFrameInfo::Ptr();
+    _recordStreamDevice.clear();
+    log_debug_m << "Record stream dropped";
+}
+
+bool AudioDev::createVoiceStream(const VoiceFrameInfo::Ptr& voiceFrameInfo, bool corked)
+{
+    dropVoiceStream();
+
+    log_debug_m << "Create voice stream" << (corked ? " (corked)" : "");
 
     pa_sample_spec paSampleSpec;
     paSampleSpec.format = PA_SAMPLE_S16LE;
@@ -392,18 +922,9 @@ void AudioDev::startVoice(const VoiceFrameInfo::Ptr& voiceFrameInfo)
     if (!_voiceStream)
     {
         log_error_m << "Failed call pa_stream_new()" << paStrError(_paContext);
-        return;
+        return false;
     }
 
-    getVoiceFrameInfo(voiceFrameInfo.get());
-    log_debug_m << "Initialization playback VoiceFrameInfo"
-                << "; latency: "       << voiceFrameInfo->latency
-                << "; channels: "  << int(voiceFrameInfo->channels)
-                << "; sample size: "   << voiceFrameInfo->sampleSize
-                << "; sample count: "  << voiceFrameInfo->sampleCount
-                << "; sampling rate: " << voiceFrameInfo->samplingRate
-                << "; buffer size: "   << voiceFrameInfo->bufferSize;
-
     pa_stream_set_state_callback    (_voiceStream, voice_stream_state, this);
     pa_stream_set_started_callback  (_voiceStream, voice_stream_started, this);
     pa_stream_set_write_callback    (_voiceStream, voice_stream_write, this);
@@ -426,13 +947,196 @@ void AudioDev::startVoice(const VoiceFrameInfo::Ptr& voiceFrameInfo)
     pa_stream_flags_t flags = pa_stream_flags_t(PA_STREAM_INTERPOLATE_TIMING
                                                 |PA_STREAM_ADJUST_LATENCY
                                                 |PA_STREAM_AUTO_TIMING_UPDATE);
+    if (corked)
+        flags = pa_stream_flags_t(flags | PA_STREAM_START_CORKED);
 
     if (pa_stream_connect_playback(_voiceStream, devName, &paBuffAttr, flags, 0, 0) < 0)
     {
         log_error_m << "Failed call pa_stream_connect_playback()"
                     << paStrError(_voiceStream);
+        pa_stream_unref(_voiceStream);
+        _voiceStream = 0;
+        return false;
+    }
+    _voiceStreamInfo = voiceFrameInfo;
+    _voiceStreamDevice = QByteArray(devName);
+    return true;
+}
+
+bool AudioDev::createRecordStream(quint32 latency, bool corked)
+{
+    dropRecordStream();
+
+    log_debug_m << "Create record stream" << (corked ? " (corked)" : "");
+
+    // Длительность фрейма записи определяет и размер фрагмента потока
+    // PulseAudio, и длительность фрейма кодека Opus
+    VoiceFrameInfo::Ptr voiceFrameInfo = recordFrameInfo(latency);
+
+    pa_sample_spec paSampleSpec;
+    paSampleSpec.format = PA_SAMPLE_S16LE;
+    paSampleSpec.channels = voiceFrameInfo->channels;
+    paSampleSpec.rate = voiceFrameInfo->samplingRate;
+
+    _recordStream = pa_stream_new(_paContext, "Record", &paSampleSpec, 0);
+    if (!_recordStream)
+    {
+        log_error_m << "Failed call pa_stream_new()" << paStrError(_paContext);
+        return false;
+    }
+
+    pa_stream_set_state_callback    (_recordStream, record_stream_state, this);
+    pa_stream_set_started_callback  (_recordStream, record_stream_started, this);
+    pa_stream_set_read_callback     (_recordStream, record_stream_read, this);
+    pa_stream_set_overflow_callback (_recordStream, record_stream_overflow, this);
+    pa_stream_set_underflow_callback(_recordStream, record_stream_underflow, this);
+    pa_stream_set_suspended_callback(_recordStream, record_stream_suspended, this);
+    pa_stream_set_moved_callback    (_recordStream, record_stream_moved, this);
+
+    pa_buffer_attr paBuffAttr;
+    paBuffAttr.maxlength = pa_usec_to_bytes(qMax(3 * latency, quint32(60000)), &paSampleSpec);
+    paBuffAttr.tlength   = uint32_t(-1);
+    paBuffAttr.prebuf    = uint32_t(-1);
+    paBuffAttr.minreq    = uint32_t(-1);
+    paBuffAttr.fragsize  = pa_usec_to_bytes(latency, &paSampleSpec);
+
+    QByteArray devNameBuff;
+    const char* devName = currentDeviceName(_sourceDevices, devNameBuff);
+    pa_stream_flags_t flags = pa_stream_flags_t(PA_STREAM_INTERPOLATE_TIMING
+                                                |PA_STREAM_ADJUST_LATENCY
+                                                |PA_STREAM_AUTO_TIMING_UPDATE);
+    if (corked)
+        flags = pa_stream_flags_t(flags | PA_STREAM_START_CORKED);
+
+    if (pa_stream_connect_record(_recordStream, devName, &paBuffAttr, flags) < 0)
+    {
+        log_error_m << "Failed call pa_stream_connect_record()"
+                    << paStrError(_recordStream);
+        pa_stream_unref(_recordStream);
+        _recordStream = 0;
+        return false;
+    }
+    _recordStreamInfo = voiceFrameInfo;
+    _recordStreamDevice = QByteArray(devName);
+    return true;
+}
+
+VoiceFrameInfo::Ptr AudioDev::recordFrameInfo(quint32 latency)
+{
+    // Чтобы фильтр шумоподавления работал корректно нужно использовать только
+    // один канал. Если же требуются два канала, то для каждого канала
+    // необходимо использовать свой экземпляр фильтра
+    const quint8 channels = 1;
+    const quint32 sampleSize = sizeof(int16_t);
+
+    // Частота дискретизации записи должна поддерживаться и кодеком Opus,
+    // и фильтрами шумо/эхоподавления
+    quint32 rate = 48000;
+    int samplingRate = 48000;
+    config::base().getValue("audio.record.sampling_rate", samplingRate);
+    if (samplingRate == 8000 || samplingRate == 16000 || samplingRate == 48000)
+        rate = quint32(samplingRate);
+    else
+        log_error_m << "Unsupported record sampling rate: " << samplingRate
+                    << ". Will be used sampling rate: " << rate;
+
+    quint32 sampleCount = quint32(quint64(latency) * rate / 1000000);
+    quint32 bufferSize = sampleCount * sampleSize * channels;
+    VoiceFrameInfo voiceFrameInfo {latency, channels, sampleSize,
+                                   sampleCount, rate, bufferSize};
+    return VoiceFrameInfo::Ptr::create(voiceFrameInfo);
+}
+
+bool AudioDev::resumeStream(pa_stream* stream)
+{
+    // Приостановленный поток может быть возобновлен только после перехода
+    // в состояние READY. Если поток еще создается, то он пересоздается
+    // без флага PA_STREAM_START_CORKED
+    if (pa_stream_get_state(stream) != PA_STREAM_READY)
+        return false;
+
+    // Данные, оставшиеся от предыдущего сеанса, отбрасываются
+    O_PTR_MSG(pa_stream_flush(stream, nullptr, nullptr),
+              "Failed call pa_stream_flush()", stream, {})
+    O_PTR_MSG(pa_stream_cork(stream, 0, nullptr, nullptr),
+              "Failed call pa_stream_cork()", stream, return false)
+    return true;
+}
+
+void AudioDev::suspendStream(pa_stream* stream)
+{
+    O_PTR_MSG(pa_stream_cork(stream, 1, nullptr, nullptr),
+              "Failed call pa_stream_cork()", stream, {})
+    O_PTR_MSG(pa_stream_flush(stream, nullptr, nullptr),
+              "Failed call pa_stream_flush()", stream, {})
+}
+
+void AudioDev::startVoice(const VoiceFrameInfo::Ptr& voiceFrameInfo)
+{
+    stopPlayback();
+
+    QMutexLocker locker(&_streamLock); (void) locker;
+
+    if (_voiceActive)
+    {
+        // Поток воспроизведения создается заранее, с предполагаемыми
+        // параметрами фреймов. Если после перестройки декодера параметры
+        // изменились, то поток пересоздается
+        VoiceFrameInfo::Ptr current = getVoiceFrameInfo();
+        if (!current.empty()
+            && current->channels == voiceFrameInfo->channels
+            && current->sampleCount == voiceFrameInfo->sampleCount
+            && current->samplingRate == voiceFrameInfo->samplingRate)
+        {
+            return;
+        }
+        log_debug_m << "Voice frame format is changed";
+    }
+
+    MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
+
+    _voiceBytes = 0;
+    getVoiceFrameInfo(voiceFrameInfo.get());
+    log_debug_m << "Initialization playback VoiceFrameInfo"
+                << "; latency: "       << voiceFrameInfo->latency
+                << "; channels: "  << int(voiceFrameInfo->channels)
+                << "; sample size: "   << voiceFrameInfo->sampleSize
+                << "; sample count: "  << voiceFrameInfo->sampleCount
+                << "; sampling rate: " << voiceFrameInfo->samplingRate
+                << "; buffer size: "   << voiceFrameInfo->bufferSize;
+
+    // Пределы задержки джиттер-буфера (в миллисекундах)
+    int minDelay = 20;
+    int maxDelay = 200;
+    config::base().getValue("audio.jitter_buffer.min_delay", minDelay);
+    config::base().getValue("audio.jitter_buffer.max_delay", maxDelay);
+    _jitterBuffer.setDelayLimits(quint32(qMax(minDelay, 0)) * 1000,
+                                 quint32(qMax(maxDelay, 0)) * 1000);
+
+    if (_backend)
+    {
+        // Джиттер-буфер инициализируется до открытия устройства: поток
+        // бэкенда запрашивает данные сразу после открытия
+        _backend->stopVoice();
+        _jitterBuffer.reset(*voiceFrameInfo);
+
+        AudioBackend::StreamSpec spec;
+        spec.channels = voiceFrameInfo->channels;
+        spec.samplingRate = voiceFrameInfo->samplingRate;
+        if (!_backend->startVoice(spec))
+            return;
+    }
+    else if (voiceStreamValid(*voiceFrameInfo) && resumeStream(_voiceStream))
+    {
+        // Поток уже в состоянии READY, событие готовности потока не придет
+        _jitterBuffer.reset(*voiceFrameInfo);
+        log_debug_m << "Voice stream resumed";
+    }
+    else if (!createVoiceStream(voiceFrameInfo, false))
+    {
         return;
     }
+    _voiceStatTimer.start(1000);
     _voiceActive = true;
     log_debug_m << "Voice stream start";
 }
@@ -448,18 +1152,27 @@ void AudioDev::stopVoice()
 
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
 
-    pa_stream_set_write_callback(_voiceStream, 0, 0);
-    if (pa_stream_disconnect(_voiceStream) < 0)
-    {
-        log_error_m << "Failed call _voiceStream()"
-                    << paStrError(_voiceStream);
-    }
-    pa_stream_unref(_voiceStream);
-    _voiceStream = 0;
+    // Поток PulseAudio не закрывается, а приостанавливается до следующего
+    // звонка
+    if (_backend)
+        _backend->stopVoice();
+    else if (_streamsPrewarm && voiceStreamValid(*_voiceStreamInfo))
+        suspendStream(_voiceStream);
+    else
+        dropVoiceStream();
+
+    _voiceStatTimer.stop();
+    sendVoiceStat();
 
-    log_debug_m << "Voice ring buffer available: " << voiceRBuff().available();
+    JitterBuffer::Stat stat = _jitterBuffer.stat();
+    log_debug_m << "Voice jitter buffer"
+                << "; delay: " << stat.delay
+                << "; jitter: " << stat.jitter
+                << "; late: " << stat.late
+                << "; lost: " << stat.lost
+                << "; concealed: " << stat.concealed;
 
-    voiceRBuff().reset();
+    _jitterBuffer.clear();
     getVoiceFrameInfo(0, true);
 
     log_debug_m << "Voice bytes (processed): " << _voiceBytes;
@@ -478,47 +1191,37 @@ void AudioDev::startRecord()
 
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
 
-    if (_recordStream)
+    quint32 latency = readRecordLatency(); /* в микросекундах */
+    if (_backend)
     {
-        log_debug_m << "Record stream drop";
-        pa_stream_set_read_callback(_recordStream, 0, 0);
-
-        if (pa_stream_disconnect(_recordStream) < 0)
-            log_error_m << "Failed call pa_stream_connect_playback()"
-                        << paStrError(_recordStream);
+        // Данные, полученные до установки признака _recordActive,
+        // отбрасываются (см. recordData())
+        _recordStreamInfo = recordFrameInfo(latency);
 
-        pa_stream_unref(_recordStream);
-        log_debug_m << "Record stream dropped";
+        AudioBackend::StreamSpec spec;
+        spec.channels = _recordStreamInfo->channels;
+        spec.samplingRate = _recordStreamInfo->samplingRate;
+        if (!_backend->startRecord(spec))
+            return;
     }
-
-    log_debug_m << "Create record stream";
-    _recordBytes = 0;
-
-    pa_sample_spec paSampleSpec;
-    paSampleSpec.format = PA_SAMPLE_S16LE;
-    //paSampleSpec.channels = 2;
-    paSampleSpec.channels = 1;   // Чтобы фильтр шумоподавления работал корректно
-                                 // нужно использовать только один канал.
-                                 // Если же требуются два канала, то для каждого
-                                 // канала необходимо использовать свой экземпляр
-                                 // фильтра.
-    paSampleSpec.rate = 48000;
-
-    _recordStream = pa_stream_new(_paContext, "Record", &paSampleSpec, 0);
-    if (!_recordStream)
+    else if (recordStreamValid(latency) && resumeStream(_recordStream))
+    {
+        log_debug_m << "Record stream resumed";
+    }
+    else if (!createRecordStream(latency, false))
     {
-        log_error_m << "Failed call pa_stream_new()" << paStrError(_paContext);
         return;
     }
 
-    quint32 latency = 20000; /* в микросекундах */
-    quint32 bufferSize = pa_usec_to_bytes(latency, &paSampleSpec);
-    quint32 sampleSize = pa_sample_size(&paSampleSpec);
-    quint32 sampleCount = bufferSize / (sampleSize * paSampleSpec.channels);
-    VoiceFrameInfo voiceFrameInfo {latency, paSampleSpec.channels, sampleSize,
-                                   sampleCount, paSampleSpec.rate, bufferSize};
+    _recordBytes = 0;
+    _recordFrame = nullptr;
+    _recordLatency = latency;
+    _recordOverflows = 0;
+    _recordSessionTimer.reset();
 
+    const VoiceFrameInfo& voiceFrameInfo = *_recordStreamInfo;
     getRecordFrameInfo(&voiceFrameInfo);
+    _recordFrameSize = voiceFrameInfo.bufferSize;
     log_debug_m << "Initialization record VoiceFrameInfo"
                 << "; latency: "       << voiceFrameInfo.latency
                 << "; channels: "  << int(voiceFrameInfo.channels)
@@ -527,33 +1230,6 @@ void AudioDev::startRecord()
                 << "; sampling rate: " << voiceFrameInfo.samplingRate
                 << "; buffer size: "   << voiceFrameInfo.bufferSize;
 
-    pa_stream_set_state_callback    (_recordStream, record_stream_state, this);
-    pa_stream_set_started_callback  (_recordStream, record_stream_started, this);
-    pa_stream_set_read_callback     (_recordStream, record_stream_read, this);
-    pa_stream_set_overflow_callback (_recordStream, record_stream_overflow, this);
-    pa_stream_set_underflow_callback(_recordStream, record_stream_underflow, this);
-    pa_stream_set_suspended_callback(_recordStream, record_stream_suspended, this);
-    pa_stream_set_moved_callback    (_recordStream, record_stream_moved, this);
-
-    pa_buffer_attr paBuffAttr;
-    paBuffAttr.maxlength = 3 * pa_usec_to_bytes(latency, &paSampleSpec);
-    paBuffAttr.tlength   = uint32_t(-1);
-    paBuffAttr.prebuf    = uint32_t(-1);
-    paBuffAttr.minreq    = uint32_t(-1);
-    paBuffAttr.fragsize  = pa_usec_to_bytes(latency, &paSampleSpec);
-
-    QByteArray devNameBuff;
-    const char* devName = currentDeviceName(_sourceDevices, devNameBuff);
-    pa_stream_flags_t flags = pa_stream_flags_t(PA_STREAM_INTERPOLATE_TIMING
-                                                |PA_STREAM_ADJUST_LATENCY
-                                                |PA_STREAM_AUTO_TIMING_UPDATE);
-
-    if (pa_stream_connect_record(_recordStream, devName, &paBuffAttr, flags) < 0)
-    {
-        log_error_m << "Failed call pa_stream_connect_record()"
-                    << paStrError(_recordStream);
-        return;
-    }
     voiceFilters().start();
     _recordActive = true;
     log_debug_m << "Record stream start";
@@ -584,23 +1260,38 @@ void AudioDev::stopRecord()
 
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
 
-    pa_stream_set_read_callback(_recordStream, nullptr, nullptr);
-    if (pa_stream_disconnect(_recordStream) < 0)
-    {
-        log_error_m << "Failed call pa_stream_disconnect()"
-                    << paStrError(_recordStream);
-    }
-    pa_stream_unref(_recordStream);
-    _recordStream = 0;
+    // Поток PulseAudio не закрывается, а приостанавливается до следующего
+    // звонка
+    if (_backend)
+        _backend->stopRecord();
+    else if (_streamsPrewarm && recordStreamValid(_recordStreamInfo->latency))
+        suspendStream(_recordStream);
+    else
+        dropRecordStream();
 
-    log_debug_m << "Record ring buffer (1) available: " << recordRBuff_1().available();
-    log_debug_m << "Record ring buffer (2) available: " << recordRBuff_2().available();
+    log_debug_m << "Record frame queue (1) count: " << recordQueue_1().count();
+    log_debug_m << "Record frame queue (2) count: " << recordQueue_2().count();
 
     voiceFilters().stop();
-    recordRBuff_1().reset();
-    recordRBuff_2().reset();
+
+    // Фреймы возвращаются в пул только потоком VoiceSender, поэтому
+    // недообработанные фреймы передаются ему пустыми
+    if (_recordFrame)
+    {
+        _recordFrame->dataSize = 0;
+        recordQueue_2().push(_recordFrame);
+        _recordFrame = nullptr;
+    }
+    while (VoiceFrame* frame = recordQueue_1().pop())
+    {
+        frame->dataSize = 0;
+        recordQueue_2().push(frame);
+    }
+    voiceSender().wake();
     getRecordFrameInfo(0, true);
 
+    updateRecordLatency();
+
     log_debug_m << "Record bytes (processed): " << _recordBytes;
     log_debug_m << "Record stream stopped";
 
@@ -608,6 +1299,76 @@ void AudioDev::stopRecord()
     _recordActive = false;
 }
 
+quint32 AudioDev::readRecordLatency()
+{
+    string value = "20";
+    config::base().getValue("audio.record.latency", value);
+
+    _recordLatencyAuto = (value == "auto");
+    if (_recordLatencyAuto)
+    {
+        int latency = RECORD_LATENCY_AUTO_MIN;
+        config::state().getValue("audio.record.auto_latency", latency, false);
+        for (quint32 l : recordLatencies)
+            if (l == quint32(latency) && l >= RECORD_LATENCY_AUTO_MIN)
+                return l;
+
+        return RECORD_LATENCY_AUTO_MIN;
+    }
+
+    bool ok;
+    quint32 latency = quint32(QString::fromStdString(value).toDouble(&ok) * 1000);
+    for (quint32 l : recordLatencies)
+        if (ok && l == latency)
+            return l;
+
+    log_error_m << "Unsupported record latency: " << value
+                << ". Will be used latency: 20 ms";
+    return 20000;
+}
+
+void AudioDev::updateRecordLatency()
+{
+    if (!_recordLatencyAuto)
+        return;
+
+    const int count = int(sizeof(recordLatencies) / sizeof(recordLatencies[0]));
+    int index = 0;
+    while (index < count - 1 && recordLatencies[index] < _recordLatency)
+        ++index;
+
+    quint32 overflows = _recordOverflows;
+    quint32 latency = _recordLatency;
+
+    if (overflows >= RECORD_OVERFLOW_LIMIT)
+    {
+        // Устройство не выдерживает текущую задержку
+        _recordCleanSessions = 0;
+        if (index < count - 1)
+            latency = recordLatencies[index + 1];
+    }
+    else if (overflows == 0
+             && _recordSessionTimer.elapsed<chrono::seconds>() >= RECORD_CLEAN_SESSION_TIME)
+    {
+        // После нескольких сеансов без переполнений пробуем уменьшить задержку
+        if (++_recordCleanSessions >= RECORD_CLEAN_SESSIONS
+            && index > 0 && recordLatencies[index - 1] >= RECORD_LATENCY_AUTO_MIN)
+        {
+            latency = recordLatencies[index - 1];
+            _recordCleanSessions = 0;
+        }
+    }
+
+    if (latency == _recordLatency)
+        return;
+
+    log_info_m << "Record latency (auto) changed from " << _recordLatency
+               << " to " << latency << " us; overflows: " << overflows;
+
+    config::state().setValue("audio.record.auto_latency", int(latency));
+    config::state().saveFile();
+}
+
 void AudioDev::stopAudioTests()
 {
     if (_playbackTest)
@@ -665,6 +1426,10 @@ void AudioDev::saveAudioStreamVolume(data::AudioStreamInfo& streamInfo, const ch
 
 bool AudioDev::start()
 {
+    // Потоки бэкенда ALSA создаются при открытии устройств
+    if (_backend)
+        return true;
+
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
     if (pa_threaded_mainloop_start(_paMainLoop) < 0)
     {
@@ -705,15 +1470,17 @@ void AudioDev::command_IncomingConfigConnection(const Message::Ptr& /*message*/)
 {
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
 
+    // Новому конфигуратору отправляется полный список устройств, далее
+    // передаются только изменения
     Message::Ptr m;
     for (int i = 0; i < _sinkDevices.count(); ++i)
     {
-        m = createMessage(_sinkDevices[i]);
+        m = createMessage(*_sinkDevices.devices().item(i));
         toxConfig().send(m);
     }
     for (int i = 0; i < _sourceDevices.count(); ++i)
     {
-        m = createMessage(_sourceDevices[i]);
+        m = createMessage(*_sourceDevices.devices().item(i));
         toxConfig().send(m);
     }
 
@@ -761,20 +1528,19 @@ void AudioDev::command_AudioDevChange(const Message::Ptr& message)
     readFromMessage(message, audioDevChange);
 
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
-    data::AudioDevInfo::List* devices = getDevices(audioDevChange.type);
+    AudioDevRegistry* devices = getDevices(audioDevChange.type);
 
     // ChangeFlag::Volume
     if (audioDevChange.changeFlag == data::AudioDevChange::ChangeFlag::Volume)
     {
-        lst::FindResult fr = devices->findRef(audioDevChange.index);
-        if (fr.failed())
+        data::AudioDevInfo* audioDevInfo = devices->findByIndex(audioDevChange.index);
+        if (audioDevInfo == nullptr)
         {
             log_error_m << "Failed change a device volume level. "
                         << (audioDevChange.type == data::AudioDevType::Sink ? "Sink " : "Source ")
                         << "device not found by index: " << audioDevChange.index;
             return;
         }
-        data::AudioDevInfo* audioDevInfo = devices->item(fr.index());
         audioDevInfo->volume = audioDevChange.value;
 
         pa_cvolume volume;
@@ -799,20 +1565,15 @@ void AudioDev::command_AudioDevChange(const Message::Ptr& message)
     // ChangeFlag::Current
     if (audioDevChange.changeFlag == data::AudioDevChange::ChangeFlag::Current)
     {
-        lst::FindResult fr = devices->findRef(audioDevChange.index);
-        if (fr.failed())
+        data::AudioDevInfo* audioDevInfo = devices->findByIndex(audioDevChange.index);
+        if (audioDevInfo == nullptr)
         {
             log_error_m << "Failed set device as current. "
                         << (audioDevChange.type == data::AudioDevType::Sink ? "Sink " : "Source ")
                         << "device not found by index: " << audioDevChange.index;
             return;
         }
-
-        for (int i = 0; i < devices->count(); ++i)
-            devices->item(i)->isCurrent = false;
-
-        data::AudioDevInfo* audioDevInfo = devices->item(fr.index());
-        audioDevInfo->isCurrent = true;
+        devices->setCurrent(audioDevInfo);
 
         alog::Line logLine = log_verbose_m
             << ((audioDevInfo->type == data::AudioDevType::Sink)
@@ -838,24 +1599,16 @@ void AudioDev::command_AudioDevChange(const Message::Ptr& message)
     // ChangeFlag::Default
     if (audioDevChange.changeFlag == data::AudioDevChange::ChangeFlag::Default)
     {
-        lst::FindResult fr = devices->findRef(audioDevChange.index);
-        if (fr.failed())
+        data::AudioDevInfo* audioDevInfo = devices->findByIndex(audioDevChange.index);
+        if (audioDevInfo == nullptr)
         {
             log_error_m << "Failed set device as default. "
                         << (audioDevChange.type == data::AudioDevType::Sink ? "Sink " : "Source ")
                         << "device not found by index: " << audioDevChange.index;
             return;
         }
-
-        for (int i = 0; i < devices->count(); ++i)
-        {
-            devices->item(i)->isCurrent = false;
-            devices->item(i)->isDefault = false;
-        }
-
-        data::AudioDevInfo* audioDevInfo = devices->item(fr.index());
-        audioDevInfo->isCurrent = true;
-        audioDevInfo->isDefault = true;
+        devices->setCurrent(audioDevInfo);
+        devices->setDefault(audioDevInfo);
 
         const char* confName =
             (audioDevInfo->type == data::AudioDevType::Sink)
@@ -890,6 +1643,13 @@ void AudioDev::command_AudioStreamInfo(const Message::Ptr& message)
     data::AudioStreamInfo audioStreamInfo;
     readFromMessage(message, audioStreamInfo);
 
+    // Громкость потоков регулируется звуковым сервером
+    if (_backend)
+    {
+        log_debug_m << "Stream volume is not supported by ALSA backend";
+        return;
+    }
+
     MainloopLocker mainloopLocker(_paMainLoop); (void) mainloopLocker;
 
     if (audioStreamInfo.state == data::AudioStreamInfo::State::Created
@@ -1019,6 +1779,13 @@ void AudioDev::command_ToxCallState(const Message::Ptr& message)
         stopAudioTests();
     }
 
+    // Потоки голоса и записи подготавливаются, пока вызов ожидает ответа,
+    // чтобы к моменту ответа оставалось только возобновить их
+    if (_callState.callState == data::ToxCallState::CallState::WaitingAnswer)
+    {
+        prepareStreams();
+    }
+
     if (_callState.direction == data::ToxCallState::Direction::Incoming
         && _callState.callState == data::ToxCallState::CallState::WaitingAnswer)
     {
@@ -1121,47 +1888,45 @@ void AudioDev::fillAudioDevInfo(const InfoType* info, data::AudioDevInfo& audioD
 }
 
 template<typename InfoType>
-void AudioDev::updateAudioDevInfo(const InfoType* info, data::AudioDevInfo::List& devices)
+void AudioDev::updateAudioDevInfo(const InfoType* info, AudioDevRegistry& devices)
 {
-    data::AudioDevInfo* audioDevInfoPtr = 0;
-    if (lst::FindResult fr = devices.find(info->name))
+    data::AudioDevInfo audioDevInfo;
+    fillAudioDevInfo(info, audioDevInfo);
+
+    data::AudioDevInfo* audioDevInfoPtr = devices.findByName(audioDevInfo.name);
+    if (audioDevInfoPtr)
     {
-        // Если устройство найдено, то обновляем по нему информацию
-        fillAudioDevInfo(info, devices[fr.index()]);
-        audioDevInfoPtr = &devices[fr.index()];
+        // Если устройство найдено, то обновляем по нему информацию.
+        // Конфигуратор уведомляется только об изменениях
+        if (!devices.update(audioDevInfoPtr, audioDevInfo))
+            return;
     }
     else
     {
-        data::AudioDevInfo audioDevInfo;
-        fillAudioDevInfo(info, audioDevInfo);
+        audioDevInfoPtr = devices.add(audioDevInfo);
 
         enum DeviceDefault {Yes = true, No = false};
-        auto setCurrentDevice = [&audioDevInfo, &devices](DeviceDefault devDefault, int  line)
+        auto setCurrentDevice = [audioDevInfoPtr, &devices](DeviceDefault devDefault, int  line)
         {
-            for (int i = 0; i < devices.count(); ++i)
-            {
-                devices[i].isCurrent = false;
-                devices[i].isDefault = false;
-            }
-            audioDevInfo.isCurrent = true;
-            audioDevInfo.isDefault = bool(devDefault);
+            devices.setCurrent(audioDevInfoPtr);
+            devices.setDefault((devDefault) ? audioDevInfoPtr : nullptr);
 
             constexpr const char* file_name = alog::detail::file_name(__FILE__);
 
             alog::Line logLine =
                 alog::logger().verbose(file_name, __func__, line, "AudioDev")
-                << ((audioDevInfo.type == data::AudioDevType::Sink)
+                << ((audioDevInfoPtr->type == data::AudioDevType::Sink)
                     ? "Sound sink"
                     : "Sound source");
-            logLine << " current: "  << audioDevInfo.isCurrent
-                    << "; default: " << audioDevInfo.isDefault
-                    << "; index: "   << audioDevInfo.index
-                    << "; (card: "   << audioDevInfo.cardIndex << ")"
-                    << "; volume: "  << audioDevInfo.volume
-                    << "; name: "    << audioDevInfo.name;
+            logLine << " current: "  << audioDevInfoPtr->isCurrent
+                    << "; default: " << audioDevInfoPtr->isDefault
+                    << "; index: "   << audioDevInfoPtr->index
+                    << "; (card: "   << audioDevInfoPtr->cardIndex << ")"
+                    << "; volume: "  << audioDevInfoPtr->volume
+                    << "; name: "    << audioDevInfoPtr->name;
         };
 
-        if (devices.empty())
+        if (devices.count() == 1)
             setCurrentDevice(DeviceDefault::No, __LINE__);
 
         // Инициализация isDefault
@@ -1175,25 +1940,13 @@ void AudioDev::updateAudioDevInfo(const InfoType* info, data::AudioDevInfo::List
         {
             setCurrentDevice(DeviceDefault::Yes, __LINE__);
         }
-        else if (devName.empty())
+        else if (devName.empty() && devices.defaultDevice() == nullptr)
         {
-            bool defaultDeviceAssigned = false;
-            for (int i = 0; i < devices.count(); ++i)
-                if (devices[i].isDefault)
-                {
-                    defaultDeviceAssigned = true;
-                    break;
-                }
-
-            if (!defaultDeviceAssigned)
-            {
-                static QRegExp reg {R"(.*Yealink.*VOIP_USB_Phone.*)"};
-                if (reg.exactMatch(audioDevInfo.name))
-                    setCurrentDevice(DeviceDefault::No, __LINE__);
-            }
+            static QRegExp reg {R"(.*Yealink.*VOIP_USB_Phone.*)"};
+            if (reg.exactMatch(audioDevInfo.name))
+                setCurrentDevice(DeviceDefault::No, __LINE__);
         }
-        audioDevInfoPtr = devices.addCopy(audioDevInfo);
-        updateStartVolume(audioDevInfo);
+        updateStartVolume(*audioDevInfoPtr);
     }
 
     if (toxConfig().isActive())
@@ -1238,9 +1991,8 @@ void AudioDev::fillAudioStreamInfo(const pa_sink_input_info* info,
     audioStreamInfo.channels = info->channel_map.channels;
     audioStreamInfo.volume = info->volume.values[0];
 
-    lst::FindResult fr = _sinkDevices.findRef(info->sink);
-    audioStreamInfo.volumeSteps =
-        (fr.success()) ? _sinkDevices[fr.index()].volumeSteps : 0;
+    data::AudioDevInfo* device = _sinkDevices.findByIndex(info->sink);
+    audioStreamInfo.volumeSteps = (device) ? device->volumeSteps : 0;
 }
 
 void AudioDev::fillAudioStreamInfo(const pa_source_output_info* info,
@@ -1254,29 +2006,19 @@ void AudioDev::fillAudioStreamInfo(const pa_source_output_info* info,
     audioStreamInfo.channels = info->channel_map.channels;
     audioStreamInfo.volume = info->volume.values[0];
 
-    lst::FindResult fr = _sourceDevices.findRef(info->source);
-    audioStreamInfo.volumeSteps =
-        (fr.success()) ? _sourceDevices[fr.index()].volumeSteps : 0;
+    data::AudioDevInfo* device = _sourceDevices.findByIndex(info->source);
+    audioStreamInfo.volumeSteps = (device) ? device->volumeSteps : 0;
 }
 
-data::AudioDevInfo::List* AudioDev::getDevices(data::AudioDevType type)
+AudioDevRegistry* AudioDev::getDevices(data::AudioDevType type)
 {
     return (type == data::AudioDevType::Sink) ? &_sinkDevices : &_sourceDevices;
 }
 
-data::AudioDevInfo* AudioDev::currentDevice(const data::AudioDevInfo::List& devices)
-{
-    for (int i = 0; i < devices.count(); ++i)
-        if (devices.item(i)->isCurrent)
-            return devices.item(i);
-
-    return 0;
-}
-
-const char* AudioDev::currentDeviceName(const data::AudioDevInfo::List& devices,
+const char* AudioDev::currentDeviceName(const AudioDevRegistry& devices,
                                         QByteArray& buff)
 {
-    if (data::AudioDevInfo* audioDevInfo = currentDevice(devices))
+    if (data::AudioDevInfo* audioDevInfo = devices.current())
         buff = audioDevInfo->name;
 
     return (!buff.isEmpty()) ? buff.constData() : 0;
@@ -1284,77 +2026,264 @@ const char* AudioDev::currentDeviceName(const data::AudioDevInfo::List& devices,
 
 bool AudioDev::removeDevice(quint32 index, data::AudioDevType type, bool byCardIndex)
 {
-    bool isRemoved = false;
-    bool isCurrent = false;
-    data::AudioDevInfo::List* devices = getDevices(type);
-    for (int i = 0; i < devices->count(); ++i)
+    AudioDevRegistry* devices = getDevices(type);
+    if (!byCardIndex)
+    {
+        data::AudioDevInfo* audioDevInfo = devices->findByIndex(index);
+        if (audioDevInfo)
+            removeDevice(audioDevInfo, *devices);
+        return (audioDevInfo != nullptr);
+    }
+
+    QVector<quint32> indexes = devices->cardDevices(index);
+    for (quint32 devIndex : indexes)
+        removeDevice(devices->findByIndex(devIndex), *devices);
+
+    return !indexes.isEmpty();
+}
+
+void AudioDev::removeDevice(data::AudioDevInfo* audioDevInfo, AudioDevRegistry& devices)
+{
+    if (toxConfig().isActive())
+    {
+        data::AudioDevChange audioDevChange {*audioDevInfo};
+        audioDevChange.changeFlag = data::AudioDevChange::ChangeFlag::Remove;
+
+        Message::Ptr m = createMessage(audioDevChange);
+        toxConfig().send(m);
+    }
+
+    bool isCurrent = audioDevInfo->isCurrent;
+    devices.remove(audioDevInfo);
+
+    if (!isCurrent || devices.empty())
+        return;
+
+    // Выбираем новое текущее устройство: устройство по умолчанию, если
+    // его нет - первое устройство
+    data::AudioDevInfo* current = devices.defaultDevice();
+    if (current == nullptr)
+        current = devices.devices().item(0);
+
+    devices.setCurrent(current);
+
+    if (toxConfig().isActive())
+    {
+        Message::Ptr m = createMessage(*current);
+        toxConfig().send(m);
+
+        data::AudioDevChange audioDevChange {*current};
+        audioDevChange.changeFlag = data::AudioDevChange::ChangeFlag::Current;
+
+        m = createMessage(audioDevChange);
+        toxConfig().send(m);
+    }
+}
+
+void AudioDev::scheduleDeviceEvent(QHash<quint32, bool>& pending, quint32 index, bool removed)
+{
+    // Последнее событие для устройства определяет действие: удаление
+    // или запрос параметров
+    pending[index] = removed;
+
+    // Интервал продлевается с каждым событием, но не более чем до
+    // 5 интервалов от первого события, чтобы при непрерывном потоке
+    // событий изменения все же применялись
+    pa_usec_t now = pa_rtclock_now();
+    pa_usec_t debounce = pa_usec_t(_deviceDebounce) * PA_USEC_PER_MSEC;
+    if (_deviceEventTimer == nullptr)
     {
-        quint32 devIndex = (byCardIndex) ? devices->at(i).cardIndex
-                                         : devices->at(i).index;
-        if (devIndex == index)
+        _deviceEventFirst = now;
+        _deviceEventTimer = pa_context_rttime_new(_paContext, now + debounce,
+                                                  device_events, this);
+        if (_deviceEventTimer == nullptr)
         {
-            if (toxConfig().isActive())
+            log_error_m << "Failed call pa_context_rttime_new()";
+            applyDeviceEvents();
+        }
+        return;
+    }
+    pa_usec_t deadline = qMin(now + debounce, _deviceEventFirst + 5 * debounce);
+    pa_context_rttime_restart(_paContext, _deviceEventTimer, deadline);
+}
+
+void AudioDev::applyDeviceEvents()
+{
+    log_debug_m << "Apply device events"
+                << "; cards: "   << _pendingCards.count()
+                << "; sinks: "   << _pendingSinks.count()
+                << "; sources: " << _pendingSources.count();
+
+    for (auto it = _pendingCards.constBegin(); it != _pendingCards.constEnd(); ++it)
+    {
+        if (it.value())
+        {
+            removeDevice(it.key(), data::AudioDevType::Sink, true);
+            removeDevice(it.key(), data::AudioDevType::Source, true);
+        }
+        else
+        {
+            O_PTR_MSG(pa_context_get_card_info_by_index(_paContext, it.key(), card_info, this),
+                      "Failed call pa_context_get_card_info_by_index()", _paContext, {})
+        }
+    }
+    for (auto it = _pendingSinks.constBegin(); it != _pendingSinks.constEnd(); ++it)
+    {
+        if (it.value())
+        {
+            removeDevice(it.key(), data::AudioDevType::Sink, false);
+        }
+        else
+        {
+            O_PTR_MSG(pa_context_get_sink_info_by_index(_paContext, it.key(), sink_info, this),
+                      "Failed call pa_context_get_sink_info_by_index()", _paContext, {})
+        }
+    }
+    for (auto it = _pendingSources.constBegin(); it != _pendingSources.constEnd(); ++it)
+    {
+        if (it.value())
+        {
+            removeDevice(it.key(), data::AudioDevType::Source, false);
+        }
+        else
+        {
+            O_PTR_MSG(pa_context_get_source_info_by_index(_paContext, it.key(), source_info, this),
+                      "Failed call pa_context_get_source_info_by_index()", _paContext, {})
+        }
+    }
+    _pendingCards.clear();
+    _pendingSinks.clear();
+    _pendingSources.clear();
+}
+
+//------------------------- AudioBackend::Client ----------------------------
+
+size_t AudioDev::playbackData(char* data, size_t nbytes,
+                              const AudioBackend::StreamSpec& spec)
+{
+    // Данные копируются из кэша звуков, обращения к файловой системе
+    // в потоке бэкенда не выполняются
+    size_t len = 0;
+    const SoundCache::Sound::Ptr& sound = _playbackSound;
+    if (_playbackTone)
+    {
+        // Тональный сигнал формируется непосредственно в буфере потока.
+        // Частота дискретизации потока может быть выбрана по устройству
+        _toneGenerator.setSampleRate(spec.samplingRate);
+        quint32 count = _toneGenerator.generate((qint16*)data, quint32(nbytes / sizeof(qint16)));
+        len = count * sizeof(qint16);
+    }
+    else if (!sound.empty())
+    {
+        const char* soundData = sound->data.constData();
+        const quint32 soundSize = quint32(sound->data.size());
+        while (len < nbytes)
+        {
+            if (_playbackPos >= soundSize)
             {
-                data::AudioDevChange audioDevChange {devices->at(i)};
-                audioDevChange.changeFlag = data::AudioDevChange::ChangeFlag::Remove;
+                if (--_playbackCycleCount <= 0)
+                    break;
 
-                Message::Ptr m = createMessage(audioDevChange);
-                toxConfig().send(m);
+                log_debug2_m << "Playback cycle";
+                _playbackPos = 0;
             }
-            isCurrent |= devices->at(i).isCurrent;
-            devices->remove(i--);
-            isRemoved = true;
+            size_t size = qMin(nbytes - len, size_t(soundSize - _playbackPos));
+            memcpy(data + len, soundData + _playbackPos, size);
+            _playbackPos += quint32(size);
+            len += size;
         }
     }
+    return len;
+}
+
+void AudioDev::playbackDrained()
+{
+    QString filePath;
+    if (!_playbackSound.empty())
+        filePath = _playbackSound->filePath;
+    _playbackSound = SoundCache::Sound::Ptr();
+    _playbackTone = false;
+
+    playbackFinished();
+    _playbackActive = false;
+
+    log_debug_m << "Playback stream stopped (file: " << filePath << ")";
+}
 
-    if (isRemoved && isCurrent && !devices->empty())
+size_t AudioDev::voiceData(char* data, size_t nbytes,
+                           const AudioBackend::StreamSpec& spec, quint32 delay)
+{
+    // Заранее созданный (приостановленный) поток запрашивает данные для
+    // предварительной буферизации еще до начала звонка, когда джиттер-буфер
+    // не инициализирован. В этом случае поток заполняется тишиной
+    if (!_voiceActive)
     {
-        // Сбрасываем флаг текущего устройства
-        for (int i = 0; i < devices->count(); ++i)
-            (*devices)[i].isCurrent = false;
+        memset(data, 0, nbytes);
+        return 0;
+    }
 
-        // Выбираем новое текущее устройство
-        isCurrent = false;
-        for (int i = 0; i < devices->count(); ++i)
-            if (devices->at(i).isDefault)
-            {
-                (*devices)[i].isCurrent = true;
+    size_t len = _jitterBuffer.read(data, nbytes);
+    _voiceBytes += len;
 
-                if (toxConfig().isActive())
-                {
-                    Message::Ptr m = createMessage(devices->at(i));
-                    toxConfig().send(m);
+    // Опорный сигнал для эхоподавления снимается в момент передачи данных
+    // в бэкенд, без дополнительной буферизации
+    if (voiceFilters().echoCancel())
+    {
+        quint32 frameSize = spec.channels * sizeof(int16_t);
+        voiceFilters().farEnd((int16_t*)data, quint32(nbytes / frameSize),
+                              spec.channels, spec.samplingRate, delay);
+    }
+    return len;
+}
 
-                    data::AudioDevChange audioDevChange {devices->at(i)};
-                    audioDevChange.changeFlag = data::AudioDevChange::ChangeFlag::Current;
+void AudioDev::recordData(const char* data, size_t nbytes,
+                          const AudioBackend::StreamSpec&, quint32 delay)
+{
+    // Данные, поступившие после приостановки потока, отбрасываются
+    if (!_recordActive)
+        return;
 
-                    m = createMessage(audioDevChange);
-                    toxConfig().send(m);
-                }
-                isCurrent = true;
-                break;
-            }
+    _recordBytes += nbytes;
 
-        if (!isCurrent)
-        {
-            // Если новое текущее устройство не выбрали, то делаем текущим
-            // первое устройство.
-            (*devices)[0].isCurrent = true;
+    if (voiceFilters().echoCancel())
+        voiceFilters().setRecordLatency(delay);
 
-            if (toxConfig().isActive())
+    const char* buff = data;
+    size_t remain = nbytes;
+    while (remain)
+    {
+        if (!_recordFrame)
+        {
+            _recordFrame = recordFramePool().acquire();
+            if (!_recordFrame)
             {
-                Message::Ptr m = createMessage(devices->at(0));
-                toxConfig().send(m);
+                log_error_m << "Record frame pool is exhausted"
+                            << ". Data size: " << remain;
+                ++_recordOverflows;
+                break;
+            }
+            _recordFrame->timestamp = voiceTimestamp();
+        }
 
-                data::AudioDevChange audioDevChange {devices->at(0)};
-                audioDevChange.changeFlag = data::AudioDevChange::ChangeFlag::Current;
+        VoiceFrame* frame = _recordFrame;
+        size_t size = qMin(size_t(_recordFrameSize - frame->dataSize), remain);
+        memcpy(frame->data + frame->dataSize, buff, size);
+        frame->dataSize += size;
+        buff += size;
+        remain -= size;
 
-                m = createMessage(audioDevChange);
-                toxConfig().send(m);
-            }
+        if (frame->dataSize >= _recordFrameSize)
+        {
+            recordQueue_1().push(frame);
+            _recordFrame = nullptr;
+            voiceFilters().wake();
         }
     }
-    return isRemoved;
+}
+
+void AudioDev::recordOverflow()
+{
+    ++_recordOverflows;
 }
 
 //-------------------------- PulseAudio callback -----------------------------
@@ -1386,6 +2315,9 @@ void AudioDev::context_state(pa_context* context, void* userdata)
         case PA_CONTEXT_READY:
             log_debug2_m << "Context event: PA_CONTEXT_READY";
 
+            // Функция вызывается в потоке PulseAudio mainloop
+            realtimeSetupThread("pulse_audio");
+
             pa_context_set_subscribe_callback(context, context_subscribe, ad);
             O_PTR_FAIL(pa_context_subscribe(context,
                                             pa_subscription_mask_t(
@@ -1400,8 +2332,20 @@ void AudioDev::context_state(pa_context* context, void* userdata)
                        "Failed call pa_context_subscribe()", context,
                        break)
 
+            // Начальное заполнение реестров устройств, далее реестры
+            // обновляются по событиям подписки
             O_PTR_FAIL(pa_context_get_card_info_list(context, card_info, ad),
                        "Failed call pa_context_get_card_info_list()", context, {})
+
+            O_PTR_FAIL(pa_context_get_sink_info_list(context, sink_info, ad),
+                       "Failed call pa_context_get_sink_info_list()", context, {})
+
+            O_PTR_FAIL(pa_context_get_source_info_list(context, source_info, ad),
+                       "Failed call pa_context_get_source_info_list()", context, {})
+
+            // Загрузка выполняется в потоке AudioDev, где доступен кэш звуков
+            if (ad->_sampleCache)
+                QMetaObject::invokeMethod(ad, "uploadSamples", Qt::QueuedConnection);
             break;
 
         case PA_CONTEXT_FAILED:
@@ -1429,36 +2373,32 @@ void AudioDev::context_subscribe(pa_context* context, pa_subscription_event_type
     log_debug2_m << "context_subscribe()";
 
     AudioDev* ad = static_cast<AudioDev*>(userdata);
+    bool removed = ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE);
 
+    // События по звуковым картам и устройствам не обрабатываются сразу,
+    // а накапливаются (см. scheduleDeviceEvent()). При подключении устройств
+    // или перезапуске PulseAudio события поступают сериями, в этом случае
+    // каждое устройство запрашивается один раз
     switch (type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK)
     {
         case PA_SUBSCRIPTION_EVENT_CARD:
-            if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE)
-            {
+            // Изменение профиля карты приводит к событиям по ее устройствам,
+            // поэтому событие изменения карты не обрабатывается
+            if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE)
+                break;
+
+            if (removed)
                 log_verbose_m << "Sound card detached; index: " << index;
 
-                ad->removeDevice(index, data::AudioDevType::Sink, true);
-                ad->removeDevice(index, data::AudioDevType::Source, true);
-            }
-            else
-            {
-                O_PTR_MSG(pa_context_get_card_info_by_index(context, index, card_info, ad),
-                          "Failed call pa_context_get_card_info_by_index()", context, {})
-            }
+            ad->scheduleDeviceEvent(ad->_pendingCards, index, removed);
             break;
 
         // Вывод информации по устройству воспроизведения
         case PA_SUBSCRIPTION_EVENT_SINK:
-            if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE)
-            {
+            if (removed)
                 log_verbose_m << "Sound sink detached; index: " << index;
-                ad->removeDevice(index, data::AudioDevType::Sink, false);
-            }
-            else if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE)
-            {
-                O_PTR_MSG(pa_context_get_sink_info_by_index(context, index, sink_change, ad),
-                          "Failed call pa_context_get_sink_info_by_index()", context, {})
-            }
+
+            ad->scheduleDeviceEvent(ad->_pendingSinks, index, removed);
             break;
 
         /** Вывод информации по потоку воспроизведения **/
@@ -1477,16 +2417,10 @@ void AudioDev::context_subscribe(pa_context* context, pa_subscription_event_type
 
         // Вывод информации по устройству записи
         case PA_SUBSCRIPTION_EVENT_SOURCE:
-            if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE)
-            {
+            if (removed)
                 log_verbose_m << "Sound source detached; index: " << index;
-                ad->removeDevice(index, data::AudioDevType::Source, false);
-            }
-            else if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE)
-            {
-                O_PTR_MSG(pa_context_get_source_info_by_index(context, index, source_change, ad),
-                          "Failed call pa_context_get_source_info_by_index()", context, {})
-            }
+
+            ad->scheduleDeviceEvent(ad->_pendingSources, index, removed);
             break;
 
         // Вывод информации по потоку записи
@@ -1510,7 +2444,6 @@ void AudioDev::card_info(pa_context* context, const pa_card_info* card_info,
 {
     log_debug2_m << "card_info(); eol: " << eol;
 
-    AudioDev* ad = static_cast<AudioDev*>(userdata);
     if (eol != 0)
         return;
 
@@ -1539,12 +2472,6 @@ void AudioDev::card_info(pa_context* context, const pa_card_info* card_info,
                      << "; Active profile is undefined";
     }
     */
-
-    O_PTR_MSG(pa_context_get_sink_info_list(context, sink_info, ad),
-              "Failed call pa_context_get_sink_info_list()", context, {})
-
-    O_PTR_MSG(pa_context_get_source_info_list(context, source_info, ad),
-              "Failed call pa_context_get_source_info_list()", context, {})
 }
 
 void AudioDev::sink_info(pa_context* context, const pa_sink_info* info,
@@ -1560,37 +2487,18 @@ void AudioDev::sink_info(pa_context* context, const pa_sink_info* info,
     //if ((info->flags & PA_SOURCE_HARDWARE) != PA_SOURCE_HARDWARE)
     //    return;
 
-    lst::FindResult fr = ad->_sinkDevices.find(info->name);
-    if (fr.failed())
+    if (ad->_sinkDevices.findByName(info->name) == nullptr)
         log_verbose_m << "Sound sink detected"
                       << "; index: " << info->index
                       << "; (card: " << info->card << ")"
                       << "; volume: " << info->volume.values[0]
                       << "; name: " << info->name;
-
-    ad->updateAudioDevInfo(info, ad->_sinkDevices);
-}
-
-void AudioDev::sink_change(pa_context* context, const pa_sink_info* info,
-                           int eol, void* userdata)
-{
-    AudioDev* ad = static_cast<AudioDev*>(userdata);
-    if (eol != 0)
-        return;
-
-    /* См. комментарий в функции AudioDev::sink_info() */
-    //if ((info->flags & PA_SOURCE_HARDWARE) != PA_SOURCE_HARDWARE)
-    //    return;
-
-    lst::FindResult fr = ad->_sinkDevices.findRef(quint32(info->index));
-    if (fr.failed())
-        return;
-
-    log_debug_m << "Sound sink changed"
-                << "; index: " << info->index
-                << "; (card: " << info->card << ")"
-                << "; volume: " << info->volume.values[0]
-                << "; name: " << info->name;
+    else
+        log_debug_m << "Sound sink changed"
+                    << "; index: " << info->index
+                    << "; (card: " << info->card << ")"
+                    << "; volume: " << info->volume.values[0]
+                    << "; name: " << info->name;
 
     ad->updateAudioDevInfo(info, ad->_sinkDevices);
 }
@@ -1606,39 +2514,31 @@ void AudioDev::source_info(pa_context* context, const pa_source_info* info,
     //if ((info->flags & PA_SOURCE_HARDWARE) != PA_SOURCE_HARDWARE)
     //    return;
 
-    lst::FindResult fr = ad->_sourceDevices.find(info->name);
-    if (fr.failed())
+    if (ad->_sourceDevices.findByName(info->name) == nullptr)
         log_verbose_m << "Sound source detected"
                       << "; index: " << info->index
                       << "; (card: " << info->card << ")"
                       << "; volume: " << info->volume.values[0]
                       << "; name: " << info->name;
+    else
+        log_debug_m << "Sound source changed"
+                    << "; index: " << info->index
+                    << "; (card: " << info->card << ")"
+                    << "; volume: " << info->volume.values[0]
+                    << "; name: " << info->name;
 
     ad->updateAudioDevInfo(info, ad->_sourceDevices);
 }
 
-void AudioDev::source_change(pa_context* context, const pa_source_info* info,
-                             int eol, void* userdata)
+void AudioDev::device_events(pa_mainloop_api* api, pa_time_event* event,
+                             const struct timeval*, void* userdata)
 {
-    AudioDev* ad = static_cast<AudioDev*>(userdata);
-    if (eol != 0)
-        return;
-
-    /* См. комментарий в функции AudioDev::sink_info() */
-    //if ((info->flags & PA_SOURCE_HARDWARE) != PA_SOURCE_HARDWARE)
-    //    return;
-
-    lst::FindResult fr = ad->_sourceDevices.findRef(quint32(info->index));
-    if (fr.failed())
-        return;
+    log_debug2_m << "device_events()";
 
-    log_debug_m << "Sound source changed"
-                << "; index: " << info->index
-                << "; (card: " << info->card << ")"
-                << "; volume: " << info->volume.values[0]
-                << "; name: " << info->name;
-
-    ad->updateAudioDevInfo(info, ad->_sourceDevices);
+    AudioDev* ad = static_cast<AudioDev*>(userdata);
+    api->time_free(event);
+    ad->_deviceEventTimer = nullptr;
+    ad->applyDeviceEvents();
 }
 
 void AudioDev::playback_stream_create(pa_context* context, const pa_sink_input_info* info,
@@ -1878,38 +2778,19 @@ void AudioDev::playback_stream_write(pa_stream* stream, size_t nbytes, void* use
         return;
     }
 
-    qint64 len = ad->_playbackFile.read((char*)data, nbytes);
-    if (len == qint64(nbytes))
+    size_t len = ad->playbackData((char*)data, nbytes, streamSpec(stream));
+    if (len > 0)
     {
         if (pa_stream_write(stream, data, len, 0, 0LL, PA_SEEK_RELATIVE) < 0)
             log_error_m << "Failed call pa_stream_write()" << paStrError(stream);
     }
     else
     {
-        log_debug2_m << "Playback cycle";
-        bool success = false;
-        if (--ad->_playbackCycleCount > 0)
-        {
-            if (ad->_playbackFile.seek(ad->_playbackFile.dataChunkPos()))
-            {
-                len = ad->_playbackFile.read((char*)data, nbytes);
-                if (len > 0)
-                {
-                    if (pa_stream_write(stream, data, len, 0, 0LL, PA_SEEK_RELATIVE) < 0)
-                        log_error_m << "Failed call pa_stream_write()" << paStrError(stream);
-                    else
-                        success = true;
-                }
-            }
-        }
-        if (!success)
-        {
-            log_debug_m << "Playback data empty";
-            pa_stream_cancel_write(stream);
-            pa_stream_set_write_callback(stream, 0, 0);
-            O_PTR_MSG(pa_stream_drain(stream, playback_stream_drain, ad),
-                      "Failed call pa_stream_drain()", stream, {})
-        }
+        log_debug_m << "Playback data empty";
+        pa_stream_cancel_write(stream);
+        pa_stream_set_write_callback(stream, 0, 0);
+        O_PTR_MSG(pa_stream_drain(stream, playback_stream_drain, ad),
+                  "Failed call pa_stream_drain()", stream, {})
     }
 }
 
@@ -1938,37 +2819,107 @@ void AudioDev::playback_stream_drain(pa_stream* stream, int success, void *userd
     log_debug2_m << "playback_stream_drain()";
 
     AudioDev* ad = static_cast<AudioDev*>(userdata);
-    ad->_playbackFile.close();
 
-    if (ad->_playbackTest)
+    if (pa_stream_disconnect(stream) < 0)
+        log_error_m << "Failed call pa_stream_disconnect()" << paStrError(stream);
+
+    pa_stream_unref(stream);
+    ad->_playbackStream = 0;
+    ad->playbackDrained();
+}
+
+void AudioDev::upload_stream_state(pa_stream* stream, void* userdata)
+{
+    log_debug2_m << "upload_stream_state()";
+
+    SampleUpload* upload = static_cast<SampleUpload*>(userdata);
+    const SoundCache::Sound::Ptr& sound = upload->sound;
+
+    switch (pa_stream_get_state(stream))
     {
-        if (toxConfig().isActive())
-        {
-            data::AudioTest audioTest;
-            audioTest.begin = false;
-            audioTest.playback = true;
+        case PA_STREAM_TERMINATED:
+            // Поток завершается и при ошибке записи данных (см. upload_stream_write())
+            if (upload->pos == size_t(sound->data.size()))
+            {
+                Sample sample;
+                sample.name = upload->name;
+                sample.duration = quint32(quint64(sound->data.size()) * 1000
+                                          / (sound->blockAlign * sound->sampleRate));
+                sample.duration = qMax(sample.duration, quint32(1));
+                upload->audioDev->_samples[upload->fileName] = sample;
+
+                log_debug_m << "Sample uploaded: " << upload->name
+                            << "; duration: " << sample.duration << " ms";
+            }
+            break;
 
-            Message::Ptr m = createMessage(audioTest);
-            toxConfig().send(m);
+        case PA_STREAM_FAILED:
+            log_error_m << "Failed upload sample " << upload->name
+                        << paStrError(stream);
+            break;
+
+        default:
+            return;
+    }
+
+    pa_stream_set_state_callback(stream, 0, 0);
+    pa_stream_set_write_callback(stream, 0, 0);
+    pa_stream_unref(stream);
+    delete upload;
+}
+
+void AudioDev::upload_stream_write(pa_stream* stream, size_t nbytes, void* userdata)
+{
+    SampleUpload* upload = static_cast<SampleUpload*>(userdata);
+    const QByteArray& data = upload->sound->data;
+
+    size_t size = qMin(nbytes, size_t(data.size()) - upload->pos);
+    if (size > 0)
+    {
+        // Данные копируются библиотекой PulseAudio (free_cb не задан)
+        if (pa_stream_write(stream, data.constData() + upload->pos, size,
+                            nullptr, 0LL, PA_SEEK_RELATIVE) < 0)
+        {
+            log_error_m << "Failed call pa_stream_write()" << paStrError(stream);
+            pa_stream_set_write_callback(stream, 0, 0);
+            pa_stream_disconnect(stream);
+            return;
         }
-        ad->_playbackTest = false;
+        upload->pos += size;
     }
-    if (pa_stream_disconnect(stream) < 0)
-        log_error_m << "Failed call pa_stream_disconnect()" << paStrError(stream);
 
-    if (ad->_emitPlaybackFinish)
+    if (upload->pos == size_t(data.size()))
     {
-        Message::Ptr m = createMessage(ad->_playbackFinish);
-        emit ad->internalMessage(m);
+        pa_stream_set_write_callback(stream, 0, 0);
+        if (pa_stream_finish_upload(stream) < 0)
+            log_error_m << "Failed call pa_stream_finish_upload()" << paStrError(stream);
     }
-    ad->_playbackFinish.code = data::PlaybackFinish::Code::Undefined;
-    ad->_emitPlaybackFinish = true;
+}
 
-    pa_stream_unref(stream);
-    ad->_playbackStream = 0;
-    ad->_playbackActive = false;
+void AudioDev::sample_play(pa_context* context, uint32_t index, void* userdata)
+{
+    log_debug2_m << "sample_play()";
+
+    AudioDev* ad = static_cast<AudioDev*>(userdata);
+    if (index == PA_INVALID_INDEX)
+    {
+        log_error_m << "Failed play sample" << paStrError(context);
+        return;
+    }
+
+    // Проигрывание остановлено до того, как сервер создал sink input
+    if (!ad->_samplePlayback)
+    {
+        O_PTR_MSG(pa_context_kill_sink_input(context, index, nullptr, nullptr),
+                  "Failed call pa_context_kill_sink_input()", context, {})
+        return;
+    }
+    ad->_sampleSinkInput = index;
 
-    log_debug_m << "Playback stream stopped (file: " << ad->_playbackFile.fileName() << ")";
+    // Информация о потоке передается в конфигуратор, уровень громкости
+    // восстанавливается так же, как для потока воспроизведения звуков
+    O_PTR_MSG(pa_context_get_sink_input_info(context, index, playback_stream_create, ad),
+              "Failed call pa_context_get_sink_input_info()", context, {})
 }
 
 void AudioDev::voice_stream_state(pa_stream* stream, void* userdata)
@@ -2011,14 +2962,22 @@ void AudioDev::voice_stream_state(pa_stream* stream, void* userdata)
             O_PTR_MSG(pa_context_get_sink_input_info(context, index, voice_stream_create, ad),
                       "Failed call pa_context_get_sink_info_by_index()", context, {})
 
-            if (VoiceFrameInfo::Ptr voiceFrameInfo = getVoiceFrameInfo())
+            // Фреймы, полученные до готовности потока (в том числе в период
+            // перестройки декодера), воспроизводятся в пределах максимальной
+            // задержки джиттер-буфера. Для заранее созданного (приостановленного)
+            // потока джиттер-буфер инициализируется при возобновлении потока,
+            // см. startVoice()
+            if (ad->_voiceActive)
             {
-                voiceRBuff().init(8 * voiceFrameInfo->bufferSize);
-                log_debug_m  << "Initialization a voice ring buffer"
-                             << "; size: " << voiceRBuff().size();
+                if (VoiceFrameInfo::Ptr voiceFrameInfo = getVoiceFrameInfo())
+                {
+                    ad->_jitterBuffer.reset(*voiceFrameInfo);
+                    log_debug_m  << "Initialization a voice jitter buffer"
+                                 << "; target delay: " << ad->_jitterBuffer.stat().targetDelay;
+                }
+                else
+                    log_error_m << "Failed get VoiceFrameInfo for voice";
             }
-            else
-                log_error_m << "Failed get VoiceFrameInfo for voice";
 
             if (alog::logger().level() >= alog::Level::Debug)
             {
@@ -2072,10 +3031,13 @@ void AudioDev::voice_stream_write(pa_stream* stream, size_t nbytes, void* userda
         return;
     }
 
-    if (voiceRBuff().read((char*)data, nbytes))
-        ad->_voiceBytes += nbytes;
-    else
-        memset(data, 0, nbytes);
+    pa_usec_t latency = 0;
+    int negative = 0;
+    if (voiceFilters().echoCancel())
+        if (pa_stream_get_latency(stream, &latency, &negative) < 0 || negative)
+            latency = 0;
+
+    ad->voiceData((char*)data, nbytes, streamSpec(stream), quint32(latency));
 
     if (pa_stream_write(stream, data, nbytes, 0, 0LL, PA_SEEK_RELATIVE) < 0)
         log_error_m << "Failed call pa_stream_write()" << paStrError(stream);
@@ -2141,18 +3103,9 @@ void AudioDev::record_stream_state(pa_stream* stream, void* userdata)
             O_PTR_MSG(pa_context_get_source_output_info(context, index, record_stream_create, ad),
                       "Failed call pa_context_get_source_output_info()", context, {})
 
-            if (VoiceFrameInfo::Ptr voiceFrameInfo = getRecordFrameInfo())
-            {
-                recordRBuff_1().init(5 * voiceFrameInfo->bufferSize);
-                log_debug_m  << "Initialization a record ring buffer (1)"
-                             << "; size: " << recordRBuff_1().size();
-
-                recordRBuff_2().init(5 * voiceFrameInfo->bufferSize);
-                log_debug_m  << "Initialization a record ring buffer (2)"
-                             << "; size: " << recordRBuff_2().size();
-            }
-            else
-                log_error_m << "Failed get VoiceFrameInfo for record";
+            log_debug_m  << "Record frame pool"
+                         << "; available: " << recordFramePool().available()
+                         << "; frame size: " << ad->_recordFrameSize;
 
             if (alog::logger().level() >= alog::Level::Debug)
             {
@@ -2211,16 +3164,13 @@ void AudioDev::record_stream_read(pa_stream* stream, size_t nbytes, void* userda
 
         if (data && nbytes)
         {
-            if (data)
-            {
-                ad->_recordBytes += nbytes;
+            pa_usec_t latency = 0;
+            int negative = 0;
+            if (voiceFilters().echoCancel())
+                if (pa_stream_get_latency(stream, &latency, &negative) < 0 || negative)
+                    latency = 0;
 
-                if (recordRBuff_1().write((char*)data, nbytes))
-                    voiceFilters().wake();
-                else
-                    log_error_m << "Failed write data to recordRBuff_1"
-                                << ". Data size: " << nbytes;
-            }
+            ad->recordData((const char*)data, nbytes, streamSpec(stream), quint32(latency));
         }
         if (nbytes)
             pa_stream_drop(stream);
@@ -2230,6 +3180,9 @@ void AudioDev::record_stream_read(pa_stream* stream, size_t nbytes, void* userda
 void AudioDev::record_stream_overflow(pa_stream*, void* userdata)
 {
     log_debug2_m << "record_stream_overflow()";
+
+    AudioDev* ad = static_cast<AudioDev*>(userdata);
+    ad->recordOverflow();
 }
 
 void AudioDev::record_stream_underflow(pa_stream*, void* userdata)
@@ -5,12 +5,17 @@
 
 #pragma once
 
-#include "audio/wav_file.h"
+#include "audio/audio_backend.h"
+#include "audio/audio_dev_registry.h"
+#include "audio/sound_cache.h"
+#include "audio/tone_generator.h"
 #include "common/voice_frame.h"
+#include "common/jitter_buffer.h"
 #include "diverter/phone_diverter.h"
 
 #include "shared/list.h"
 #include "shared/defmac.h"
+#include "shared/steady_timer.h"
 #include "shared/safe_singleton.h"
 #include "pproto/func_invoker.h"
 
@@ -26,9 +31,11 @@ using namespace pproto;
 using namespace pproto::transport;
 
 /**
-  Класс для работы с аудио-устройствами через PulseAudio
+  Класс для работы с аудио-устройствами через PulseAudio. Вместо PulseAudio
+  может использоваться бэкенд ALSA (параметр audio.backend), в этом случае
+  потоки звуков, голоса и записи обслуживаются бэкендом
 */
-class AudioDev : public QObject
+class AudioDev : public QObject, public AudioBackend::Client
 {
 public:
     bool init();
@@ -66,6 +73,10 @@ public slots:
                        data::PlaybackFinish::Code playbackFinishCode = data::PlaybackFinish::Code::Undefined);
     void stopPlayback();
 
+    // Воспроизведение тонального сигнала, формируемого генератором
+    void startTone(ToneGenerator::Tone, int cycleCount,
+                   data::PlaybackFinish::Code playbackFinishCode);
+
     // Старт/стоп воспроизведения голоса
     void startVoice(const VoiceFrameInfo::Ptr&);
     void stopVoice();
@@ -80,6 +91,10 @@ public slots:
     // Признак активности записи голосового потока
     bool recordActive() const {return _recordActive;}
 
+    // Статистика джиттер-буфера входящего голосового потока, может
+    // запрашиваться из любого потока
+    JitterBuffer::Stat voiceStat() const {return _jitterBuffer.stat();}
+
 private slots:
     void playRingtoneByTimer();
     void playOutgoingByTimer();
@@ -87,6 +102,16 @@ private slots:
     void playFailByTimer();
     void playErrorByTimer();
 
+    // Отправляет в конфигуратор статистику джиттер-буфера
+    void sendVoiceStat();
+
+    // Загрузка звуков в кэш сэмплов PulseAudio
+    void uploadSamples();
+    void soundChanged(const QString& fileName);
+
+    // Очередной цикл проигрывания сэмпла
+    void playSampleByTimer();
+
 private:
     Q_OBJECT
     DISABLE_DEFAULT_COPY(AudioDev)
@@ -103,17 +128,25 @@ private:
     template<typename InfoType>
     void fillAudioDevInfo(const InfoType*, data::AudioDevInfo&);
 
+    // Добавляет устройство в реестр или обновляет его параметры. Сообщение
+    // конфигуратору отправляется только если параметры устройства изменились
     template<typename InfoType>
-    void updateAudioDevInfo(const InfoType*, data::AudioDevInfo::List& devices);
+    void updateAudioDevInfo(const InfoType*, AudioDevRegistry& devices);
     void updateStartVolume(const data::AudioDevInfo&);
 
     void fillAudioStreamInfo(const pa_sink_input_info*, data::AudioStreamInfo&);
     void fillAudioStreamInfo(const pa_source_output_info*, data::AudioStreamInfo&);
 
-    data::AudioDevInfo::List* getDevices(data::AudioDevType);
-    data::AudioDevInfo* currentDevice(const data::AudioDevInfo::List&);
-    const char* currentDeviceName(const data::AudioDevInfo::List&, QByteArray& buff);
+    AudioDevRegistry* getDevices(data::AudioDevType);
+    const char* currentDeviceName(const AudioDevRegistry&, QByteArray& buff);
     bool removeDevice(quint32 index, data::AudioDevType, bool byCardIndex);
+    void removeDevice(data::AudioDevInfo*, AudioDevRegistry& devices);
+
+    // Откладывает обработку события подписки PulseAudio. События,
+    // поступившие в течение интервала audio.device_debounce, применяются
+    // одним пакетом в applyDeviceEvents()
+    void scheduleDeviceEvent(QHash<quint32, bool>& pending, quint32 index, bool removed);
+    void applyDeviceEvents();
 
     // Останавливает выполнение всех аудио-тестов
     void stopAudioTests();
@@ -121,6 +154,66 @@ private:
     void readAudioStreamVolume (data::AudioStreamInfo&, const char* confKey);
     void saveAudioStreamVolume(data::AudioStreamInfo&, const char* confKey);
 
+    // Задержка записи (в микросекундах) из файла конфигурации или выбранная
+    // в автоматическом режиме
+    quint32 readRecordLatency();
+
+    // В автоматическом режиме по результатам сеанса записи корректирует
+    // задержку для следующего сеанса
+    void updateRecordLatency();
+
+    // Заранее создает потоки голоса и записи в приостановленном (corked)
+    // состоянии, при старте звонка потоки только возобновляются. Потоки
+    // пересоздаются при смене устройства или параметров потока
+    void prepareStreams();
+
+    // Функции создания и закрытия потоков голоса и записи вызываются под
+    // блокировкой _streamLock и mainloop
+    bool createVoiceStream(const VoiceFrameInfo::Ptr&, bool corked);
+    bool createRecordStream(quint32 latency, bool corked);
+    void dropVoiceStream();
+    void dropRecordStream();
+
+    // Проверяет, что поток создан для текущего устройства и заданных
+    // параметров и может быть возобновлен
+    bool voiceStreamValid(const VoiceFrameInfo&);
+    bool recordStreamValid(quint32 latency);
+
+    bool resumeStream(pa_stream*);
+    void suspendStream(pa_stream*);
+
+    // Создает поток воспроизведения звуков, прежний поток закрывается.
+    // Вызывается под блокировкой _streamLock и mainloop
+    bool createPlaybackStream(const pa_sample_spec&, pa_stream_flags_t);
+
+    // Открывает поток воспроизведения звуков бэкенда. Данные звука
+    // (_playbackSound или _toneGenerator) должны быть подготовлены заранее
+    bool startBackendPlayback(AudioBackend::StreamSpec&, int cycleCount,
+                              data::PlaybackFinish::Code);
+
+    // Параметры фрейма записи для заданной задержки (в микросекундах)
+    VoiceFrameInfo::Ptr recordFrameInfo(quint32 latency);
+
+    // Проигрывание звуков из кэша сэмплов PulseAudio. Сервер проигрывает
+    // сэмпл самостоятельно, программа только повторяет его по таймеру
+    void uploadSample(const QString& fileName);
+    bool startSamplePlayback(const QString& fileName, int cycleCount,
+                             data::PlaybackFinish::Code);
+    void stopSamplePlayback(bool interrupt);
+
+    // Уведомления о завершении проигрывания звука
+    void playbackFinished();
+
+    //--- Функции AudioBackend::Client, вызываются в потоке PulseAudio
+    //    mainloop или в потоке бэкенда ---
+    size_t playbackData(char* data, size_t nbytes, const AudioBackend::StreamSpec&) override;
+    void playbackDrained() override;
+    size_t voiceData(char* data, size_t nbytes, const AudioBackend::StreamSpec&,
+                     quint32 delay) override;
+    void recordData(const char* data, size_t nbytes, const AudioBackend::StreamSpec&,
+                    quint32 delay) override;
+    void recordOverflow() override;
+
 private:
     // PulseAudio callback
     static void context_state     (pa_context* context, void* userdata);
@@ -130,12 +223,10 @@ private:
                                    int eol, void* userdata);
     static void sink_info         (pa_context* context, const pa_sink_info* info,
                                    int eol, void* userdata);
-    static void sink_change       (pa_context* context, const pa_sink_info* info,
-                                   int eol, void* userdata);
     static void source_info       (pa_context* context, const pa_source_info* info,
                                    int eol, void* userdata);
-    static void source_change     (pa_context* context, const pa_source_info* info,
-                                   int eol, void* userdata);
+    static void device_events     (pa_mainloop_api*, pa_time_event*,
+                                   const struct timeval*, void* userdata);
 
     static void playback_stream_create(pa_context* context, const pa_sink_input_info* info,
                                        int eol, void* userdata);
@@ -158,6 +249,10 @@ private:
     static void playback_stream_moved    (pa_stream*, void* userdata);
     static void playback_stream_drain    (pa_stream*, int success, void *userdata);
 
+    static void upload_stream_state      (pa_stream*, void* userdata);
+    static void upload_stream_write      (pa_stream*, size_t nbytes, void* userdata);
+    static void sample_play              (pa_context*, uint32_t index, void* userdata);
+
     static void voice_stream_state       (pa_stream*, void* userdata);
     static void voice_stream_started     (pa_stream*, void* userdata);
     static void voice_stream_write       (pa_stream*, size_t nbytes, void* userdata);
@@ -180,14 +275,37 @@ private:
     pa_mainloop_api*      _paApi = {nullptr};
     pa_context*           _paContext = {nullptr};
 
-    data::AudioDevInfo::List _sinkDevices;
-    data::AudioDevInfo::List _sourceDevices;
+    // Бэкенд, заменяющий потоки PulseAudio (параметр audio.backend: alsa).
+    // При использовании PulseAudio равен nullptr
+    AudioBackend* _backend = {nullptr};
+
+    AudioDevRegistry _sinkDevices = {data::AudioDevType::Sink};
+    AudioDevRegistry _sourceDevices = {data::AudioDevType::Source};
+
+    // Отложенные события подписки: ключ - индекс устройства (звуковой
+    // карты), значение - признак удаления. Доступ под блокировкой mainloop
+    QHash<quint32, bool> _pendingSinks;
+    QHash<quint32, bool> _pendingSources;
+    QHash<quint32, bool> _pendingCards;
+    pa_time_event* _deviceEventTimer = {nullptr};
+    pa_usec_t _deviceEventFirst = {0};
+    quint32 _deviceDebounce = {200}; // Интервал (в миллисекундах)
 
     pa_stream* _playbackStream = {nullptr}; // Поток для воспроизведения звуков
     pa_stream* _voiceStream = {nullptr};    // Поток для воспроизведения голоса
     pa_stream* _recordStream = {nullptr};   // Поток для записи голоса
     QMutex _streamLock;
 
+    // Параметры и устройства, для которых созданы потоки голоса и записи
+    VoiceFrameInfo::Ptr _voiceStreamInfo;
+    VoiceFrameInfo::Ptr _recordStreamInfo;
+    QByteArray _voiceStreamDevice;
+    QByteArray _recordStreamDevice;
+
+    // Потоки голоса и записи создаются заранее и не закрываются между
+    // звонками (параметр audio.prewarm_streams)
+    bool _streamsPrewarm = {true};
+
     data::AudioStreamInfo _palybackAudioStreamInfo;
     data::AudioStreamInfo _voiceAudioStreamInfo;
     data::AudioStreamInfo _recordAudioStreamInfo;
@@ -199,13 +317,59 @@ private:
     size_t _voiceBytes = {0};
     size_t _recordBytes = {0};
 
+    // Фрейм, заполняемый в record_stream_read(), и его целевой размер
+    VoiceFrame* _recordFrame = {nullptr};
+    quint32 _recordFrameSize = {0};
+
+    // Задержка записи (в микросекундах). В автоматическом режиме выбирается
+    // наименьшая задержка, при которой не возникают переполнения буферов
+    quint32 _recordLatency = {20000};
+    bool _recordLatencyAuto = {false};
+    quint32 _recordCleanSessions = {0};
+    atomic_uint _recordOverflows = {0};
+    steady_timer _recordSessionTimer;
+
+    // Джиттер-буфер входящего голосового потока
+    JitterBuffer _jitterBuffer;
+    QTimer _voiceStatTimer;
+
     atomic_bool _playbackTest = {false};
     atomic_bool _recordTest = {false};
 
+    // Кэш звуков и звук, который проигрывается в данный момент. Позиция
+    // воспроизведения изменяется только в playbackData()
+    SoundCache _soundCache;
+    SoundCache::Sound::Ptr _playbackSound;
+    quint32 _playbackPos = {0};
+
     atomic_int _playbackCycleCount = {1};
-    WavFile _playbackFile;
     QTimer _playbackTimer;
 
+    // Сигналы контроля посылки вызова, занято, перегрузки и SIT формируются
+    // генератором по национальному плану (параметр audio.tone_plan), иначе
+    // проигрываются файлы звуков. Генератор используется под блокировкой
+    // mainloop
+    bool _toneSynth = {false};
+    ToneGenerator _toneGenerator;
+    atomic_bool _playbackTone = {false};
+
+    // Звуки, загруженные в кэш сэмплов PulseAudio (параметр audio.sample_cache).
+    // Ключ - имя файла звука, доступ выполняется под блокировкой mainloop
+    struct Sample
+    {
+        QByteArray name;
+        quint32 duration = {0}; // Длительность (в миллисекундах)
+    };
+    bool _sampleCache = {true};
+    QHash<QString, Sample> _samples;
+
+    // Проигрываемый сэмпл и индекс sink input, созданного сервером
+    atomic_bool _samplePlayback = {false};
+    atomic_uint _sampleSinkInput = {PA_INVALID_INDEX};
+    Sample _sample;
+    QString _sampleFile;
+    QTimer _sampleTimer;
+
     data::PlaybackFinish _playbackFinish;
     atomic_bool _emitPlaybackFinish = {true};
 
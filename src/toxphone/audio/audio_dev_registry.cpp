@@ -0,0 +1,99 @@
+#include "audio_dev_registry.h"
+
+void AudioDevRegistry::setCurrent(data::AudioDevInfo* device)
+{
+    if (_current)
+        _current->isCurrent = false;
+
+    _current = device;
+    if (_current)
+        _current->isCurrent = true;
+}
+
+void AudioDevRegistry::setDefault(data::AudioDevInfo* device)
+{
+    if (_default)
+        _default->isDefault = false;
+
+    _default = device;
+    if (_default)
+        _default->isDefault = true;
+}
+
+data::AudioDevInfo* AudioDevRegistry::add(const data::AudioDevInfo& info)
+{
+    data::AudioDevInfo* device = _devices.addCopy(info);
+    device->isCurrent = false;
+    device->isDefault = false;
+
+    _byIndex[device->index] = device;
+    _byName[device->name] = device;
+    return device;
+}
+
+bool AudioDevRegistry::update(data::AudioDevInfo* device, const data::AudioDevInfo& info)
+{
+    bool changed = device->cardIndex   != info.cardIndex
+                || device->index       != info.index
+                || device->name        != info.name
+                || device->description != info.description
+                || device->channels    != info.channels
+                || device->baseVolume  != info.baseVolume
+                || device->volume      != info.volume
+                || device->volumeSteps != info.volumeSteps;
+    if (!changed)
+        return false;
+
+    // После перезапуска PulseAudio устройство с прежним именем может
+    // получить новый индекс
+    if (device->index != info.index)
+    {
+        _byIndex.remove(device->index);
+        _byIndex[info.index] = device;
+    }
+    if (device->name != info.name)
+    {
+        _byName.remove(device->name);
+        _byName[info.name] = device;
+    }
+
+    device->cardIndex   = info.cardIndex;
+    device->index       = info.index;
+    device->name        = info.name;
+    device->description = info.description;
+    device->channels    = info.channels;
+    device->baseVolume  = info.baseVolume;
+    device->volume      = info.volume;
+    device->volumeSteps = info.volumeSteps;
+    return true;
+}
+
+void AudioDevRegistry::remove(data::AudioDevInfo* device)
+{
+    if (device == _current)
+        _current = nullptr;
+    if (device == _default)
+        _default = nullptr;
+
+    _byIndex.remove(device->index);
+    _byName.remove(device->name);
+
+    // Удаление выполняется только при отключении устройства, поэтому
+    // поиск позиции в списке допустим
+    for (int i = 0; i < _devices.count(); ++i)
+        if (_devices.item(i) == device)
+        {
+            _devices.remove(i);
+            break;
+        }
+}
+
+QVector<quint32> AudioDevRegistry::cardDevices(quint32 cardIndex) const
+{
+    QVector<quint32> indexes;
+    for (int i = 0; i < _devices.count(); ++i)
+        if (_devices.item(i)->cardIndex == cardIndex)
+            indexes.append(_devices.item(i)->index);
+
+    return indexes;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "commands/commands.h"
+#include "shared/defmac.h"
+
+#include <QtCore>
+
+/**
+  Реестр аудио-устройств одного типа (устройства воспроизведения или записи).
+  Устройства хранятся в списке data::AudioDevInfo::List в порядке
+  обнаружения, для поиска по индексу PulseAudio и по имени используются
+  хэш-индексы. Текущее устройство и устройство по умолчанию запоминаются,
+  поэтому поиск не требует перебора списка.
+
+  Флаги isCurrent и isDefault изменяются только через функции реестра.
+  Доступ к реестру выполняется под блокировкой mainloop.
+*/
+class AudioDevRegistry
+{
+public:
+    AudioDevRegistry(data::AudioDevType type) : _type(type) {}
+
+    data::AudioDevType type() const {return _type;}
+
+    // Устройства в порядке обнаружения
+    const data::AudioDevInfo::List& devices() const {return _devices;}
+    int count() const {return _devices.count();}
+    bool empty() const {return _devices.empty();}
+
+    data::AudioDevInfo* findByIndex(quint32 index) const {return _byIndex.value(index);}
+    data::AudioDevInfo* findByName(const QByteArray& name) const {return _byName.value(name);}
+
+    data::AudioDevInfo* current() const {return _current;}
+    data::AudioDevInfo* defaultDevice() const {return _default;}
+
+    // Назначает текущее устройство (устройство по умолчанию), флаг
+    // у прежнего устройства сбрасывается. Допустим nullptr
+    void setCurrent(data::AudioDevInfo*);
+    void setDefault(data::AudioDevInfo*);
+
+    // Добавляет устройство, флаги isCurrent и isDefault копии сбрасываются
+    data::AudioDevInfo* add(const data::AudioDevInfo&);
+
+    // Обновляет параметры устройства (кроме флагов isCurrent и isDefault).
+    // Возвращает TRUE, если параметры изменились
+    bool update(data::AudioDevInfo* device, const data::AudioDevInfo& info);
+
+    void remove(data::AudioDevInfo*);
+
+    // Индексы устройств, принадлежащих звуковой карте
+    QVector<quint32> cardDevices(quint32 cardIndex) const;
+
+private:
+    DISABLE_DEFAULT_COPY(AudioDevRegistry)
+
+private:
+    const data::AudioDevType _type;
+
+    data::AudioDevInfo::List _devices;
+    QHash<quint32, data::AudioDevInfo*> _byIndex;
+    QHash<QByteArray, data::AudioDevInfo*> _byName;
+
+    data::AudioDevInfo* _current = {nullptr};
+    data::AudioDevInfo* _default = {nullptr};
+};
@@ -0,0 +1,176 @@
+#include "sound_cache.h"
+#include "audio/wav_file.h"
+#include "common/functions.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/qt/logger_operators.h"
+
+#define log_error_m   alog::logger().error  (alog_line_location, "SoundCache")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "SoundCache")
+#define log_info_m    alog::logger().info   (alog_line_location, "SoundCache")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "SoundCache")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "SoundCache")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "SoundCache")
+
+static const char* soundDir = "sound";
+
+void SoundCache::init()
+{
+    if (_watcher == nullptr)
+    {
+        _watcher = new QFileSystemWatcher(this);
+        chk_connect_a(_watcher, &QFileSystemWatcher::fileChanged,
+                      this, &SoundCache::fileChanged);
+        chk_connect_a(_watcher, &QFileSystemWatcher::directoryChanged,
+                      this, &SoundCache::directoryChanged);
+    }
+
+    QString dirPath = getFilePath(soundDir);
+    if (dirPath.isEmpty())
+    {
+        log_error_m << "Sound directory '" << soundDir << "' not found";
+        return;
+    }
+    watch(dirPath);
+    loadDirectory(dirPath);
+}
+
+SoundCache::Sound::Ptr SoundCache::sound(const QString& fileName)
+{
+    Sound::Ptr sound = _sounds.value(fileName);
+    if (!sound.empty())
+        return sound;
+
+    QString filePath = getFilePath(fileName);
+    if (filePath.isEmpty())
+    {
+        log_error_m << "File " << fileName << " not found";
+        return Sound::Ptr();
+    }
+
+    sound = load(filePath);
+    if (!sound.empty())
+    {
+        _sounds[fileName] = sound;
+        watch(filePath);
+    }
+    return sound;
+}
+
+SoundCache::Sound::Ptr SoundCache::load(const QString& filePath)
+{
+    WavFile wavFile {filePath};
+    if (!wavFile.open())
+        return Sound::Ptr();
+
+    const WavFile::Header& header = wavFile.header();
+    if (header.bitsPerSample != 16)
+    {
+        log_error_m << "Only 16 bits per sample is supported"
+                    << ". File: " << filePath;
+        return Sound::Ptr();
+    }
+    if (header.numChannels == 0 || header.sampleRate == 0)
+    {
+        log_error_m << "Invalid audio format. File: " << filePath;
+        return Sound::Ptr();
+    }
+
+    Sound sound;
+    sound.filePath = filePath;
+    sound.channels = header.numChannels;
+    sound.sampleRate = header.sampleRate;
+    sound.blockAlign = header.numChannels * sizeof(qint16);
+    sound.data = wavFile.read(wavFile.dataSize());
+
+    // Данные выравниваются по границе фрейма, чтобы при проигрывании
+    // по кругу не нарушался порядок каналов
+    sound.data.truncate(sound.data.size() - sound.data.size() % sound.blockAlign);
+    if (sound.data.isEmpty())
+    {
+        log_error_m << "Audio data is empty. File: " << filePath;
+        return Sound::Ptr();
+    }
+
+    log_debug_m << "Sound loaded: " << filePath
+                << "; channels: " << sound.channels
+                << "; sample rate: " << sound.sampleRate
+                << "; data size: " << sound.data.size();
+
+    return Sound::Ptr::create(sound);
+}
+
+QStringList SoundCache::loadDirectory(const QString& dirPath)
+{
+    QStringList loaded;
+    QDir dir {dirPath};
+    QStringList files = dir.entryList({"*.wav"}, QDir::Files, QDir::Name);
+    for (const QString& file : files)
+    {
+        QString fileName = QString(soundDir) + "/" + file;
+        if (_sounds.contains(fileName))
+            continue;
+
+        QString filePath = dir.absoluteFilePath(file);
+        Sound::Ptr sound = load(filePath);
+        if (!sound.empty())
+        {
+            _sounds[fileName] = sound;
+            watch(filePath);
+            loaded.append(fileName);
+        }
+    }
+    return loaded;
+}
+
+void SoundCache::watch(const QString& path)
+{
+    if (_watcher == nullptr)
+        return;
+
+    if (!_watcher->files().contains(path) && !_watcher->directories().contains(path))
+        if (!_watcher->addPath(path))
+            log_warn_m << "Failed watch changes of " << path;
+}
+
+void SoundCache::fileChanged(const QString& filePath)
+{
+    QString fileName;
+    for (auto it = _sounds.constBegin(); it != _sounds.constEnd(); ++it)
+        if (it.value()->filePath == filePath)
+        {
+            fileName = it.key();
+            break;
+        }
+
+    if (fileName.isEmpty())
+        return;
+
+    _sounds.remove(fileName);
+
+    // При сохранении файл может быть заменен новым (переименованием),
+    // в этом случае отслеживание для прежнего файла прекращается
+    if (!QFile::exists(filePath))
+    {
+        log_verbose_m << "Sound file removed: " << filePath;
+        emit soundChanged(fileName);
+        return;
+    }
+
+    log_verbose_m << "Sound file changed, reload: " << filePath;
+    Sound::Ptr sound = load(filePath);
+    if (!sound.empty())
+        _sounds[fileName] = sound;
+
+    watch(filePath);
+    emit soundChanged(fileName);
+}
+
+void SoundCache::directoryChanged(const QString& dirPath)
+{
+    // Новые файлы загружаются сразу, замененные переименованием файлы
+    // обрабатываются в fileChanged()
+    for (const QString& fileName : loadDirectory(dirPath))
+        emit soundChanged(fileName);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "shared/defmac.h"
+#include "shared/clife_alloc.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+#include "shared/container_ptr.h"
+
+#include <QtCore>
+
+/**
+  Кэш звуков программы (файлы sound/*.wav). Файлы разбираются один раз:
+  при старте программы или при первом обращении. PCM-данные хранятся
+  в памяти и после загрузки не изменяются, поэтому функция обратного вызова
+  PulseAudio копирует данные из кэша без обращения к файловой системе.
+
+  Изменения файлов отслеживаются через QFileSystemWatcher: измененный файл
+  загружается заново, удаленный - исключается из кэша. Звук, который
+  проигрывается в момент изменения файла, продолжает использовать прежние
+  данные (удерживаются через Sound::Ptr).
+
+  Функции вызываются из потока, в котором создан объект (поток AudioDev).
+*/
+class SoundCache : public QObject
+{
+public:
+    struct Sound
+    {
+        typedef container_ptr<Sound> Ptr;
+
+        QString    filePath;
+        quint16    channels   = {0};
+        quint32    sampleRate = {0};
+        quint32    blockAlign = {0}; // Размер фрейма (все каналы одного сэмпла)
+        QByteArray data;             // PCM-данные, формат S16LE
+    };
+
+    SoundCache() = default;
+
+    // Загружает все файлы *.wav из каталога sound и включает отслеживание
+    // изменений файлов
+    void init();
+
+    // Возвращает звук по имени файла, например "sound/ringtone.wav". Если
+    // звука нет в кэше, то файл загружается. При ошибке возвращается пустой
+    // указатель
+    Sound::Ptr sound(const QString& fileName);
+
+    // Имена файлов загруженных звуков
+    QStringList fileNames() const {return _sounds.keys();}
+    bool contains(const QString& fileName) const {return _sounds.contains(fileName);}
+
+signals:
+    // Звук загружен заново после изменения файла, добавлен или удален
+    void soundChanged(const QString& fileName);
+
+private slots:
+    void fileChanged(const QString& filePath);
+    void directoryChanged(const QString& dirPath);
+
+private:
+    Q_OBJECT
+    DISABLE_DEFAULT_COPY(SoundCache)
+
+    Sound::Ptr load(const QString& filePath);
+
+    // Загружает звуки, отсутствующие в кэше. Возвращает имена файлов
+    // загруженных звуков
+    QStringList loadDirectory(const QString& dirPath);
+    void watch(const QString& path);
+
+private:
+    // Ключ - имя файла (например "sound/ringtone.wav")
+    QHash<QString, Sound::Ptr> _sounds;
+    QFileSystemWatcher* _watcher = {nullptr};
+};
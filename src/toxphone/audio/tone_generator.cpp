@@ -0,0 +1,184 @@
+#include "tone_generator.h"
+
+#include <cmath>
+
+typedef ToneGenerator::Segment Segment;
+typedef ToneGenerator::Cadence Cadence;
+
+// Амплитуда сигнала (около -10 dBFS), делится между компонентами сегмента
+static const double toneAmplitude = 10000.0;
+
+// Длительность сглаживания фронтов сегмента (в миллисекундах)
+static const quint32 toneRampTime = 4;
+
+// Планы сигналов по рекомендации ITU-T E.180 (Supplement 2). Сигнал
+// готовности непрерывный, его цикл длится одну секунду
+
+// EU (CEPT)
+static const Segment euDial[]       = {{1000, 425, 0}};
+static const Segment euRingback[]   = {{1000, 425, 0}, {4000, 0, 0}};
+static const Segment euBusy[]       = {{500, 425, 0}, {500, 0, 0}};
+static const Segment euCongestion[] = {{250, 425, 0}, {250, 0, 0}};
+
+// US
+static const Segment usDial[]       = {{1000, 350, 440}};
+static const Segment usRingback[]   = {{2000, 440, 480}, {4000, 0, 0}};
+static const Segment usBusy[]       = {{500, 480, 620}, {500, 0, 0}};
+static const Segment usCongestion[] = {{250, 480, 620}, {250, 0, 0}};
+
+// RU
+static const Segment ruDial[]       = {{1000, 425, 0}};
+static const Segment ruRingback[]   = {{800, 425, 0}, {3200, 0, 0}};
+static const Segment ruBusy[]       = {{400, 425, 0}, {400, 0, 0}};
+static const Segment ruCongestion[] = {{175, 425, 0}, {175, 0, 0}};
+
+// UK
+static const Segment ukDial[]       = {{1000, 350, 450}};
+static const Segment ukRingback[]   = {{400, 400, 450}, {200, 0, 0},
+                                       {400, 400, 450}, {2000, 0, 0}};
+static const Segment ukBusy[]       = {{375, 400, 0}, {375, 0, 0}};
+static const Segment ukCongestion[] = {{400, 400, 0}, {350, 0, 0},
+                                       {225, 400, 0}, {525, 0, 0}};
+
+// SIT: три восходящих тона и пауза. Для US частоты и длительности заданы
+// по стандарту ANSI T1.401
+static const Segment sit[]   = {{330, 950, 0}, {330, 1400, 0},
+                                {330, 1800, 0}, {1000, 0, 0}};
+static const Segment usSit[] = {{274, 914, 0}, {274, 1371, 0},
+                                {380, 1777, 0}, {1000, 0, 0}};
+
+#define CADENCE(SEGMENTS) {SEGMENTS, int(sizeof(SEGMENTS) / sizeof(Segment))}
+
+// Порядок строк соответствует ToneGenerator::Plan, столбцов - ToneGenerator::Tone
+static const Cadence cadences[4][5] =
+{
+    {CADENCE(euDial), CADENCE(euRingback), CADENCE(euBusy), CADENCE(euCongestion), CADENCE(sit)},
+    {CADENCE(usDial), CADENCE(usRingback), CADENCE(usBusy), CADENCE(usCongestion), CADENCE(usSit)},
+    {CADENCE(ruDial), CADENCE(ruRingback), CADENCE(ruBusy), CADENCE(ruCongestion), CADENCE(sit)},
+    {CADENCE(ukDial), CADENCE(ukRingback), CADENCE(ukBusy), CADENCE(ukCongestion), CADENCE(sit)}
+};
+
+#undef CADENCE
+
+static const char* planNames[] = {"eu", "us", "ru", "uk"};
+
+bool ToneGenerator::planFromString(const QString& name, Plan& plan)
+{
+    for (int i = 0; i < 4; ++i)
+        if (name.compare(planNames[i], Qt::CaseInsensitive) == 0)
+        {
+            plan = Plan(i);
+            return true;
+        }
+
+    return false;
+}
+
+const char* ToneGenerator::planName(Plan plan)
+{
+    return planNames[int(plan)];
+}
+
+const Cadence& ToneGenerator::cadence() const
+{
+    return cadences[int(_plan)][int(_tone)];
+}
+
+void ToneGenerator::start(Tone tone, int cycleCount)
+{
+    _tone = tone;
+    _cyclesLeft = cycleCount;
+    _segment = 0;
+    startSegment();
+}
+
+void ToneGenerator::setSampleRate(quint32 sampleRate)
+{
+    if (sampleRate == 0 || sampleRate == _sampleRate)
+        return;
+
+    // Позиция в сегменте пересчитывается для новой частоты, осцилляторы
+    // запускаются заново
+    quint64 pos = quint64(_segmentPos) * sampleRate / _sampleRate;
+    _sampleRate = sampleRate;
+    startSegment();
+    _segmentPos = quint32(qMin(pos, quint64(_segmentLength)));
+}
+
+void ToneGenerator::startSegment()
+{
+    const Segment& segment = cadence().segments[_segment];
+
+    _segmentPos = 0;
+    _segmentLength = quint32(quint64(segment.duration) * _sampleRate / 1000);
+
+    _oscCount = 0;
+    for (quint16 freq : {segment.freq1, segment.freq2})
+    {
+        if (freq == 0 || freq * 2 >= _sampleRate)
+            continue;
+
+        // Начальные значения соответствуют sin(-w) и sin(-2w), поэтому
+        // осциллятор начинает с нулевой фазы
+        double w = 2 * M_PI * freq / _sampleRate;
+        _oscCoef[_oscCount]  = 2 * std::cos(w);
+        _oscPrev[_oscCount]  = -std::sin(w);
+        _oscPrev2[_oscCount] = -std::sin(2 * w);
+        ++_oscCount;
+    }
+}
+
+quint32 ToneGenerator::generate(qint16* buff, quint32 count)
+{
+    const Cadence& cad = cadence();
+    const quint32 rampLength = qMax(_sampleRate * toneRampTime / 1000, quint32(1));
+
+    quint32 written = 0;
+    while (written < count && _cyclesLeft > 0)
+    {
+        if (_segmentPos >= _segmentLength)
+        {
+            if (++_segment >= cad.count)
+            {
+                _segment = 0;
+                if (--_cyclesLeft <= 0)
+                    break;
+            }
+            startSegment();
+            continue;
+        }
+
+        quint32 size = qMin(count - written, _segmentLength - _segmentPos);
+        qint16* out = buff + written;
+
+        if (_oscCount == 0)
+        {
+            memset(out, 0, size * sizeof(qint16));
+        }
+        else
+        {
+            const double amplitude = toneAmplitude / _oscCount;
+            for (quint32 i = 0; i < size; ++i)
+            {
+                double value = 0;
+                for (int k = 0; k < _oscCount; ++k)
+                {
+                    double y = _oscCoef[k] * _oscPrev[k] - _oscPrev2[k];
+                    _oscPrev2[k] = _oscPrev[k];
+                    _oscPrev[k] = y;
+                    value += y;
+                }
+
+                // Сглаживание фронтов сегмента
+                quint32 pos = _segmentPos + i;
+                quint32 edge = qMin(pos, _segmentLength - pos);
+                double gain = (edge < rampLength) ? double(edge) / rampLength : 1.0;
+
+                out[i] = qint16(value * amplitude * gain);
+            }
+        }
+        _segmentPos += size;
+        written += size;
+    }
+    return written;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "shared/defmac.h"
+#include <QtCore>
+
+/**
+  Генератор тональных сигналов телефонной сети (сигналы готовности, контроля
+  посылки вызова, занято, перегрузки и информационный сигнал SIT).
+
+  Параметры сигналов задаются таблицами национальных планов (EU - по
+  рекомендации CEPT, US, RU, UK). Каждый сигнал описывается каденцией -
+  последовательностью сегментов заданной длительности, в каждом сегменте
+  звучат до двух частот (или тишина). Синусоиды формируются рекурсивными
+  осцилляторами, поэтому генератор не использует файлы и таблицы отсчетов
+  и работает с любой частотой дискретизации. Фронты сегментов сглаживаются,
+  чтобы исключить щелчки.
+
+  Данные формируются в формате S16, один канал.
+*/
+class ToneGenerator
+{
+public:
+    enum class Plan
+    {
+        EU = 0,
+        US = 1,
+        RU = 2,
+        UK = 3
+    };
+
+    enum class Tone
+    {
+        Dial       = 0, // Ответ станции (готовность к набору)
+        Ringback   = 1, // Контроль посылки вызова
+        Busy       = 2, // Занято
+        Congestion = 3, // Перегрузка
+        Sit        = 4  // Special Information Tone (ошибка вызова)
+    };
+
+    // Сегмент каденции: длительность (в миллисекундах) и частоты (в Гц).
+    // Нулевая частота - компонента отсутствует, сегмент без частот - пауза
+    struct Segment
+    {
+        quint16 duration;
+        quint16 freq1;
+        quint16 freq2;
+    };
+
+    struct Cadence
+    {
+        const Segment* segments;
+        int count;
+    };
+
+    ToneGenerator() = default;
+
+    // Преобразует наименование плана (eu, us, ru, uk) в значение Plan.
+    // Возвращает FALSE, если наименование неизвестно
+    static bool planFromString(const QString& name, Plan&);
+    static const char* planName(Plan);
+
+    void setPlan(Plan plan) {_plan = plan;}
+    Plan plan() const {return _plan;}
+
+    // Начало формирования сигнала. cycleCount - количество повторов
+    // каденции сигнала
+    void start(Tone, int cycleCount);
+
+    // Частота дискретизации может быть изменена во время формирования
+    // сигнала (например, после подключения потока к устройству)
+    void setSampleRate(quint32 sampleRate);
+
+    // Заполняет буфер не более чем count сэмплами. Возвращает количество
+    // сформированных сэмплов, 0 - все циклы каденции завершены
+    quint32 generate(qint16* buff, quint32 count);
+
+private:
+    DISABLE_DEFAULT_COPY(ToneGenerator)
+
+    const Cadence& cadence() const;
+    void startSegment();
+
+private:
+    Plan _plan = {Plan::EU};
+    Tone _tone = {Tone::Dial};
+    quint32 _sampleRate = {48000};
+
+    int _cyclesLeft = {0};
+    int _segment = {0};          // Индекс текущего сегмента каденции
+    quint32 _segmentPos = {0};   // Позиция в сегменте (в сэмплах)
+    quint32 _segmentLength = {0};
+
+    // Рекурсивные осцилляторы: y[n] = k * y[n-1] - y[n-2]
+    int _oscCount = {0};
+    double _oscCoef[2] = {0, 0};
+    double _oscPrev[2] = {0, 0};
+    double _oscPrev2[2] = {0, 0};
+};
@@ -0,0 +1,417 @@
+#include "audio_kernels.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AUDIO_KERNELS_X86
+#endif
+
+#define log_error_m   alog::logger().error  (alog_line_location, "AudioKernels")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "AudioKernels")
+#define log_info_m    alog::logger().info   (alog_line_location, "AudioKernels")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "AudioKernels")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "AudioKernels")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "AudioKernels")
+
+// Реализация для NEON находится в отдельном модуле, так как для arm32 он
+// собирается с флагом -mfpu=neon. Возвращает nullptr если NEON не доступен
+const AudioKernels* neonAudioKernels();
+
+//--------------------------------- Scalar -----------------------------------
+
+static inline int16_t saturate16(qint32 v)
+{
+    return int16_t((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+}
+
+static void scalar_s16ToFloat(const int16_t* in, float* out, quint32 count)
+{
+    for (quint32 i = 0; i < count; ++i)
+        out[i] = in[i];
+}
+
+static void scalar_floatToS16(const float* in, int16_t* out, quint32 count)
+{
+    for (quint32 i = 0; i < count; ++i)
+    {
+        float v = in[i];
+        if (v > 32767.f)
+            v = 32767.f;
+        else if (v < -32768.f)
+            v = -32768.f;
+        out[i] = int16_t(lrintf(v));
+    }
+}
+
+static quint32 scalar_peak(const int16_t* pcm, quint32 count)
+{
+    quint32 peak = 0;
+    for (quint32 i = 0; i < count; ++i)
+    {
+        qint32 v = pcm[i];
+        quint32 a = quint32((v < 0) ? -v : v);
+        if (a > peak)
+            peak = a;
+    }
+    return (peak > 32767) ? 32767 : peak;
+}
+
+static quint64 scalar_sumSquares(const int16_t* pcm, quint32 count)
+{
+    quint64 sum = 0;
+    for (quint32 i = 0; i < count; ++i)
+        sum += quint64(qint32(pcm[i]) * qint32(pcm[i]));
+    return sum;
+}
+
+static void scalar_gain(int16_t* pcm, quint32 count, qint32 gain)
+{
+    // Коэффициент ограничивается так же, как в векторных реализациях
+    gain = qBound(-32768, gain, 32767);
+    for (quint32 i = 0; i < count; ++i)
+        pcm[i] = saturate16((qint32(pcm[i]) * gain) >> 12);
+}
+
+static void scalar_mix(int16_t* dst, const int16_t* src, quint32 count)
+{
+    for (quint32 i = 0; i < count; ++i)
+        dst[i] = saturate16(qint32(dst[i]) + qint32(src[i]));
+}
+
+static void scalar_goertzel(const float* in, quint32 count, const float* coef,
+                            float* s1, float* s2)
+{
+    for (quint32 i = 0; i < count; ++i)
+        for (int k = 0; k < GOERTZEL_BANK_SIZE; ++k)
+        {
+            float s0 = in[i] + coef[k] * s1[k] - s2[k];
+            s2[k] = s1[k];
+            s1[k] = s0;
+        }
+}
+
+static const AudioKernels scalarKernels =
+{
+    "scalar",
+    scalar_s16ToFloat,
+    scalar_floatToS16,
+    scalar_peak,
+    scalar_sumSquares,
+    scalar_gain,
+    scalar_mix,
+    scalar_goertzel
+};
+
+#ifdef AUDIO_KERNELS_X86
+
+//---------------------------------- SSE2 ------------------------------------
+
+__attribute__((target("sse2")))
+static void sse2_s16ToFloat(const int16_t* in, float* out, quint32 count)
+{
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i,     _mm_cvtepi32_ps(lo));
+        _mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(hi));
+    }
+    scalar_s16ToFloat(in + i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void sse2_floatToS16(const float* in, int16_t* out, quint32 count)
+{
+    const __m128 maxv = _mm_set1_ps(32767.f);
+    const __m128 minv = _mm_set1_ps(-32768.f);
+
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i),     minv), maxv);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), minv), maxv);
+        __m128i x = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i*)(out + i), x);
+    }
+    scalar_floatToS16(in + i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static quint32 sse2_peak(const int16_t* pcm, quint32 count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i peak = zero;
+
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+        peak = _mm_max_epi16(peak, _mm_max_epi16(x, _mm_subs_epi16(zero, x)));
+    }
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 8));
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 4));
+    peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 2));
+
+    quint32 result = quint32(int16_t(_mm_cvtsi128_si32(peak)));
+    return qMax(result, scalar_peak(pcm + i, count - i));
+}
+
+__attribute__((target("sse2")))
+static quint64 sse2_sumSquares(const int16_t* pcm, quint32 count)
+{
+    // Попарные суммы квадратов (_mm_madd_epi16) не превышают 2^31 и
+    // интерпретируются как беззнаковые
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+        __m128i sq = _mm_madd_epi16(x, x);
+        sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(sq, zero));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(sq, zero));
+    }
+    quint64 buff[2];
+    _mm_storeu_si128((__m128i*)buff, sum);
+    return buff[0] + buff[1] + scalar_sumSquares(pcm + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void sse2_gain(int16_t* pcm, quint32 count, qint32 gain)
+{
+    const __m128i g = _mm_set1_epi16(int16_t(qBound(-32768, gain, 32767)));
+
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+        __m128i lo = _mm_mullo_epi16(x, g);
+        __m128i hi = _mm_mulhi_epi16(x, g);
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 12);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 12);
+        _mm_storeu_si128((__m128i*)(pcm + i), _mm_packs_epi32(a, b));
+    }
+    scalar_gain(pcm + i, count - i, gain);
+}
+
+__attribute__((target("sse2")))
+static void sse2_mix(int16_t* dst, const int16_t* src, quint32 count)
+{
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(a, b));
+    }
+    scalar_mix(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void sse2_goertzel(const float* in, quint32 count, const float* coef,
+                          float* s1, float* s2)
+{
+    const __m128 c0 = _mm_loadu_ps(coef);
+    const __m128 c1 = _mm_loadu_ps(coef + 4);
+    __m128 a1 = _mm_loadu_ps(s1), b1 = _mm_loadu_ps(s1 + 4);
+    __m128 a2 = _mm_loadu_ps(s2), b2 = _mm_loadu_ps(s2 + 4);
+
+    for (quint32 i = 0; i < count; ++i)
+    {
+        __m128 x = _mm_set1_ps(in[i]);
+        __m128 a0 = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(c0, a1)), a2);
+        __m128 b0 = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(c1, b1)), b2);
+        a2 = a1; a1 = a0;
+        b2 = b1; b1 = b0;
+    }
+    _mm_storeu_ps(s1, a1); _mm_storeu_ps(s1 + 4, b1);
+    _mm_storeu_ps(s2, a2); _mm_storeu_ps(s2 + 4, b2);
+}
+
+static const AudioKernels sse2Kernels =
+{
+    "sse2",
+    sse2_s16ToFloat,
+    sse2_floatToS16,
+    sse2_peak,
+    sse2_sumSquares,
+    sse2_gain,
+    sse2_mix,
+    sse2_goertzel
+};
+
+//---------------------------------- AVX2 ------------------------------------
+
+__attribute__((target("avx2")))
+static void avx2_s16ToFloat(const int16_t* in, float* out, quint32 count)
+{
+    quint32 i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in + i + 8));
+        _mm256_storeu_ps(out + i,     _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)));
+        _mm256_storeu_ps(out + i + 8, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)));
+    }
+    sse2_s16ToFloat(in + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_floatToS16(const float* in, int16_t* out, quint32 count)
+{
+    const __m256 maxv = _mm256_set1_ps(32767.f);
+    const __m256 minv = _mm256_set1_ps(-32768.f);
+
+    quint32 i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i),     minv), maxv);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i + 8), minv), maxv);
+        __m256i x = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        // Упаковка выполняется внутри 128-битных половин, восстанавливаем порядок
+        x = _mm256_permute4x64_epi64(x, 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + i), x);
+    }
+    sse2_floatToS16(in + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static quint32 avx2_peak(const int16_t* pcm, quint32 count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i peak = zero;
+
+    quint32 i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        // _mm256_abs_epi16(-32768) дает -32768, поэтому используется
+        // вычитание с насыщением
+        __m256i x = _mm256_loadu_si256((const __m256i*)(pcm + i));
+        peak = _mm256_max_epi16(peak, _mm256_max_epi16(x, _mm256_subs_epi16(zero, x)));
+    }
+    __m128i p = _mm_max_epi16(_mm256_castsi256_si128(peak), _mm256_extracti128_si256(peak, 1));
+    p = _mm_max_epi16(p, _mm_srli_si128(p, 8));
+    p = _mm_max_epi16(p, _mm_srli_si128(p, 4));
+    p = _mm_max_epi16(p, _mm_srli_si128(p, 2));
+
+    quint32 result = quint32(int16_t(_mm_cvtsi128_si32(p)));
+    return qMax(result, sse2_peak(pcm + i, count - i));
+}
+
+__attribute__((target("avx2")))
+static quint64 avx2_sumSquares(const int16_t* pcm, quint32 count)
+{
+    __m256i sum = _mm256_setzero_si256();
+
+    quint32 i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(pcm + i));
+        __m256i sq = _mm256_madd_epi16(x, x);
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sq)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sq, 1)));
+    }
+    quint64 buff[4];
+    _mm256_storeu_si256((__m256i*)buff, sum);
+    return buff[0] + buff[1] + buff[2] + buff[3] + sse2_sumSquares(pcm + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_gain(int16_t* pcm, quint32 count, qint32 gain)
+{
+    const __m256i g = _mm256_set1_epi16(int16_t(qBound(-32768, gain, 32767)));
+
+    quint32 i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(pcm + i));
+        __m256i lo = _mm256_mullo_epi16(x, g);
+        __m256i hi = _mm256_mulhi_epi16(x, g);
+        __m256i a = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 12);
+        __m256i b = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 12);
+        // unpack/packs работают внутри 128-битных половин, порядок сохраняется
+        _mm256_storeu_si256((__m256i*)(pcm + i), _mm256_packs_epi32(a, b));
+    }
+    sse2_gain(pcm + i, count - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void avx2_mix(int16_t* dst, const int16_t* src, quint32 count)
+{
+    quint32 i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epi16(a, b));
+    }
+    sse2_mix(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_goertzel(const float* in, quint32 count, const float* coef,
+                          float* s1, float* s2)
+{
+    // FMA не используется: наличие AVX2 не гарантирует поддержку FMA
+    const __m256 c = _mm256_loadu_ps(coef);
+    __m256 a1 = _mm256_loadu_ps(s1);
+    __m256 a2 = _mm256_loadu_ps(s2);
+
+    for (quint32 i = 0; i < count; ++i)
+    {
+        __m256 x = _mm256_set1_ps(in[i]);
+        __m256 a0 = _mm256_sub_ps(_mm256_add_ps(x, _mm256_mul_ps(c, a1)), a2);
+        a2 = a1;
+        a1 = a0;
+    }
+    _mm256_storeu_ps(s1, a1);
+    _mm256_storeu_ps(s2, a2);
+}
+
+static const AudioKernels avx2Kernels =
+{
+    "avx2",
+    avx2_s16ToFloat,
+    avx2_floatToS16,
+    avx2_peak,
+    avx2_sumSquares,
+    avx2_gain,
+    avx2_mix,
+    avx2_goertzel
+};
+
+#endif // AUDIO_KERNELS_X86
+
+//-------------------------------- Dispatch ----------------------------------
+
+static const AudioKernels* currentKernels = &scalarKernels;
+
+void initAudioKernels()
+{
+    const AudioKernels* kernels = &scalarKernels;
+
+#ifdef AUDIO_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        kernels = &avx2Kernels;
+    else if (__builtin_cpu_supports("sse2"))
+        kernels = &sse2Kernels;
+#endif
+    if (const AudioKernels* neon = neonAudioKernels())
+        kernels = neon;
+
+    currentKernels = kernels;
+    log_verbose_m << "Audio kernels: " << currentKernels->name;
+}
+
+const AudioKernels& audioKernels()
+{
+    return *currentKernels;
+}
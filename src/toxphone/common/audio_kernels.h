@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QtCore>
+#include <math.h>
+
+// Количество фильтров в банке фильтров Гёрцеля (AudioKernels::goertzel)
+#define GOERTZEL_BANK_SIZE 8
+
+/**
+  Набор векторизованных функций для обработки аудио-данных (int16_t, PCM).
+  Реализация (scalar, SSE2, AVX2, NEON) выбирается один раз при старте
+  программы в функции initAudioKernels() в зависимости от возможностей
+  процессора.
+*/
+struct AudioKernels
+{
+    // Наименование выбранной реализации
+    const char* name;
+
+    // Преобразование int16 -> float без нормализации (шкала int16)
+    void (*s16ToFloat)(const int16_t* in, float* out, quint32 count);
+
+    // Преобразование float -> int16 с округлением и насыщением
+    void (*floatToS16)(const float* in, int16_t* out, quint32 count);
+
+    // Пиковое значение сигнала (по модулю)
+    quint32 (*peak)(const int16_t* pcm, quint32 count);
+
+    // Сумма квадратов отсчетов, используется для вычисления мощности и RMS
+    quint64 (*sumSquares)(const int16_t* pcm, quint32 count);
+
+    // Усиление сигнала с насыщением, gain задается в формате Q12
+    // (4096 соответствует коэффициенту 1.0). Во всех реализациях gain
+    // ограничивается диапазоном int16_t
+    void (*gain)(int16_t* pcm, quint32 count, qint32 gain);
+
+    // Смешивание сигналов с насыщением: dst = dst + src
+    void (*mix)(int16_t* dst, const int16_t* src, quint32 count);
+
+    // Банк из GOERTZEL_BANK_SIZE фильтров Гёрцеля, фильтры обрабатываются
+    // параллельно (по одному фильтру на элемент вектора). Для каждого отсчета
+    // x и фильтра k: s0 = x + coef[k] * s1[k] - s2[k], s2[k] = s1[k],
+    // s1[k] = s0. Состояния фильтров s1, s2 обновляются на месте
+    void (*goertzel)(const float* in, quint32 count, const float* coef,
+                     float* s1, float* s2);
+};
+
+// Выбирает реализацию функций, вызывается один раз при старте программы
+void initAudioKernels();
+
+const AudioKernels& audioKernels();
+
+// Вспомогательные функции
+inline float signalRms(const int16_t* pcm, quint32 count)
+{
+    return (count) ? sqrtf(float(audioKernels().sumSquares(pcm, count)) / count) : 0;
+}
@@ -0,0 +1,175 @@
+#include "audio_kernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+static void neon_s16ToFloat(const int16_t* in, float* out, quint32 count)
+{
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(in + i);
+        vst1q_f32(out + i,     vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))));
+        vst1q_f32(out + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))));
+    }
+    for (; i < count; ++i)
+        out[i] = in[i];
+}
+
+static inline int32x4_t neon_round(float32x4_t v)
+{
+    const float32x4_t maxv = vdupq_n_f32(32767.f);
+    const float32x4_t minv = vdupq_n_f32(-32768.f);
+    v = vminq_f32(vmaxq_f32(v, minv), maxv);
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(v);
+#else
+    // vcvtq_s32_f32 выполняет отбрасывание дробной части, поэтому
+    // добавляем 0.5 с учетом знака
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    uint32x4_t neg = vcltq_f32(v, vdupq_n_f32(0));
+    float32x4_t bias = vbslq_f32(neg, vnegq_f32(half), half);
+    return vcvtq_s32_f32(vaddq_f32(v, bias));
+#endif
+}
+
+static void neon_floatToS16(const float* in, int16_t* out, quint32 count)
+{
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int32x4_t a = neon_round(vld1q_f32(in + i));
+        int32x4_t b = neon_round(vld1q_f32(in + i + 4));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+    for (; i < count; ++i)
+    {
+        float v = qBound(-32768.f, in[i], 32767.f);
+        out[i] = int16_t(lrintf(v));
+    }
+}
+
+static quint32 neon_peak(const int16_t* pcm, quint32 count)
+{
+    int16x8_t peak = vdupq_n_s16(0);
+
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+        peak = vmaxq_s16(peak, vqabsq_s16(vld1q_s16(pcm + i)));
+
+#if defined(__aarch64__)
+    quint32 result = quint32(vmaxvq_s16(peak));
+#else
+    int16x4_t p = vmax_s16(vget_low_s16(peak), vget_high_s16(peak));
+    p = vpmax_s16(p, p);
+    p = vpmax_s16(p, p);
+    quint32 result = quint32(vget_lane_s16(p, 0));
+#endif
+    for (; i < count; ++i)
+    {
+        qint32 v = pcm[i];
+        quint32 a = quint32(qMin((v < 0) ? -v : v, 32767));
+        if (a > result)
+            result = a;
+    }
+    return result;
+}
+
+static quint64 neon_sumSquares(const int16_t* pcm, quint32 count)
+{
+    int64x2_t sum = vdupq_n_s64(0);
+
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(pcm + i);
+        sum = vpadalq_s32(sum, vmull_s16(vget_low_s16(x),  vget_low_s16(x)));
+        sum = vpadalq_s32(sum, vmull_s16(vget_high_s16(x), vget_high_s16(x)));
+    }
+    quint64 result = quint64(vgetq_lane_s64(sum, 0) + vgetq_lane_s64(sum, 1));
+    for (; i < count; ++i)
+        result += quint64(qint32(pcm[i]) * qint32(pcm[i]));
+    return result;
+}
+
+static void neon_gain(int16_t* pcm, quint32 count, qint32 gain)
+{
+    gain = qBound(-32768, gain, 32767);
+    const int16x4_t g = vdup_n_s16(int16_t(gain));
+
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t x = vld1q_s16(pcm + i);
+        int32x4_t a = vshrq_n_s32(vmull_s16(vget_low_s16(x),  g), 12);
+        int32x4_t b = vshrq_n_s32(vmull_s16(vget_high_s16(x), g), 12);
+        vst1q_s16(pcm + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+    for (; i < count; ++i)
+        pcm[i] = int16_t(qBound(-32768, (qint32(pcm[i]) * gain) >> 12, 32767));
+}
+
+static void neon_mix(int16_t* dst, const int16_t* src, quint32 count)
+{
+    quint32 i = 0;
+    for (; i + 8 <= count; i += 8)
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+
+    for (; i < count; ++i)
+        dst[i] = int16_t(qBound(-32768, qint32(dst[i]) + qint32(src[i]), 32767));
+}
+
+static void neon_goertzel(const float* in, quint32 count, const float* coef,
+                          float* s1, float* s2)
+{
+    const float32x4_t c0 = vld1q_f32(coef);
+    const float32x4_t c1 = vld1q_f32(coef + 4);
+    float32x4_t a1 = vld1q_f32(s1), b1 = vld1q_f32(s1 + 4);
+    float32x4_t a2 = vld1q_f32(s2), b2 = vld1q_f32(s2 + 4);
+
+    for (quint32 i = 0; i < count; ++i)
+    {
+        float32x4_t x = vdupq_n_f32(in[i]);
+        float32x4_t a0 = vsubq_f32(vmlaq_f32(x, c0, a1), a2);
+        float32x4_t b0 = vsubq_f32(vmlaq_f32(x, c1, b1), b2);
+        a2 = a1; a1 = a0;
+        b2 = b1; b1 = b0;
+    }
+    vst1q_f32(s1, a1); vst1q_f32(s1 + 4, b1);
+    vst1q_f32(s2, a2); vst1q_f32(s2 + 4, b2);
+}
+
+static const AudioKernels neonKernels =
+{
+    "neon",
+    neon_s16ToFloat,
+    neon_floatToS16,
+    neon_peak,
+    neon_sumSquares,
+    neon_gain,
+    neon_mix,
+    neon_goertzel
+};
+
+const AudioKernels* neonAudioKernels()
+{
+#if !defined(__aarch64__)
+    if ((getauxval(AT_HWCAP) & HWCAP_NEON) == 0)
+        return nullptr;
+#endif
+    return &neonKernels;
+}
+
+#else
+
+const AudioKernels* neonAudioKernels()
+{
+    return nullptr;
+}
+
+#endif
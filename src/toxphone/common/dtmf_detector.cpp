@@ -0,0 +1,140 @@
+#include "dtmf_detector.h"
+#include <cmath>
+
+// Частоты нижней (строки клавиатуры) и верхней (столбцы) групп
+static const float dtmfFreqs[GOERTZEL_BANK_SIZE] =
+{
+    697.f, 770.f, 852.f, 941.f, 1209.f, 1336.f, 1477.f, 1633.f
+};
+
+static const char dtmfDigits[4][4] =
+{
+    {'1', '2', '3', 'A'},
+    {'4', '5', '6', 'B'},
+    {'7', '8', '9', 'C'},
+    {'*', '0', '#', 'D'}
+};
+
+// Минимальная амплитуда каждой из частот: -36 dBFS. Значение задается
+// для мощности тона (A^2/2)
+static const float minTonePower = 0.5f * 520.f * 520.f;
+
+// Допустимый перекос уровней: верхняя частота слабее нижней не более чем
+// на 8 дБ (normal twist), нижняя слабее верхней не более чем на 4 дБ
+// (reverse twist)
+static const float normalTwist = 0.158f;
+static const float reverseTwist = 0.398f;
+
+// Частота должна превышать остальные частоты своей группы на 8 дБ
+static const float relativePeak = 6.3f;
+
+// Доля энергии блока, приходящаяся на две частоты цифры
+static const float toneToTotal = 0.5f;
+
+void DtmfDetector::reset(const VoiceFrameInfo& info)
+{
+    _channels = qMax(quint32(info.channels), quint32(1));
+
+    quint32 samplingRate = info.samplingRate;
+    if (samplingRate % 8000 == 0 && samplingRate / 8000 <= 6)
+    {
+        _decimation = samplingRate / 8000;
+        samplingRate = 8000;
+    }
+    else
+        _decimation = 1;
+
+    _blockSize = qBound(quint32(1), quint32(quint64(DTMF_BLOCK_SIZE) * samplingRate / 8000),
+                        quint32(DTMF_BLOCK_MAX));
+
+    for (int k = 0; k < GOERTZEL_BANK_SIZE; ++k)
+        _coef[k] = float(2 * std::cos(2 * M_PI * dtmfFreqs[k] / samplingRate));
+
+    _blockCount = 0;
+    _blockEnergy = 0;
+    _decimCount = 0;
+    _decimSum = 0;
+    _lastHit = 0;
+    _digit = 0;
+}
+
+QString DtmfDetector::process(const int16_t* pcm, quint32 count)
+{
+    QString digits;
+    for (quint32 i = 0; i < count; ++i)
+    {
+        _decimSum += pcm[i * _channels];
+        if (++_decimCount < _decimation)
+            continue;
+
+        float x = float(_decimSum) / _decimation;
+        _decimSum = 0;
+        _decimCount = 0;
+
+        _block[_blockCount++] = x;
+        _blockEnergy += x * x;
+        if (_blockCount < _blockSize)
+            continue;
+
+        char hit = analyze();
+        if (hit && hit == _lastHit && hit != _digit)
+        {
+            _digit = hit;
+            digits += QChar(hit);
+        }
+        else if (hit == 0 && _lastHit == 0)
+        {
+            _digit = 0;
+        }
+        _lastHit = hit;
+
+        _blockCount = 0;
+        _blockEnergy = 0;
+    }
+    return digits;
+}
+
+char DtmfDetector::analyze()
+{
+    float s1[GOERTZEL_BANK_SIZE] = {0};
+    float s2[GOERTZEL_BANK_SIZE] = {0};
+    audioKernels().goertzel(_block, _blockSize, _coef, s1, s2);
+
+    // Мощность тона (A^2/2) на частоте фильтра
+    const float norm = 2.f / (float(_blockSize) * _blockSize);
+    float power[GOERTZEL_BANK_SIZE];
+    for (int k = 0; k < GOERTZEL_BANK_SIZE; ++k)
+        power[k] = (s1[k] * s1[k] + s2[k] * s2[k] - _coef[k] * s1[k] * s2[k]) * norm;
+
+    int row = 0;
+    int col = 4;
+    for (int k = 1; k < 4; ++k)
+    {
+        if (power[k] > power[row])
+            row = k;
+        if (power[k + 4] > power[col])
+            col = k + 4;
+    }
+
+    if (power[row] < minTonePower || power[col] < minTonePower)
+        return 0;
+
+    if (power[col] < power[row] * normalTwist
+        || power[row] < power[col] * reverseTwist)
+        return 0;
+
+    for (int k = 0; k < 4; ++k)
+    {
+        if (k != row && power[k] * relativePeak > power[row])
+            return 0;
+        if (k + 4 != col && power[k + 4] * relativePeak > power[col])
+            return 0;
+    }
+
+    // Средняя мощность блока
+    float total = float(_blockEnergy / _blockSize);
+    if (power[row] + power[col] < total * toneToTotal)
+        return 0;
+
+    return dtmfDigits[row][col - 4];
+}
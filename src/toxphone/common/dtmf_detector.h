@@ -0,0 +1,70 @@
+#pragma once
+
+#include "voice_frame.h"
+#include "audio_kernels.h"
+#include "shared/defmac.h"
+
+#include <QtCore>
+
+// Длительность блока анализа: 102 сэмпла при частоте 8 кГц (12.75 мс).
+// Сигнал длительностью 40 мс (минимум по ITU-T Q.24) всегда полностью
+// покрывает два блока, что необходимо для подтверждения цифры
+#define DTMF_BLOCK_SIZE 102
+
+// Максимальный размер блока (в сэмплах): блок при частоте 48 кГц без
+// понижения частоты дискретизации
+#define DTMF_BLOCK_MAX (DTMF_BLOCK_SIZE * 6)
+
+/**
+  Детектор DTMF-сигналов во входящем голосовом потоке. Уровни восьми частот
+  DTMF вычисляются банком фильтров Гёрцеля (векторизованная функция
+  AudioKernels::goertzel) по блокам длительностью 12.75 мс. Если частота
+  дискретизации кратна 8 кГц, то сигнал предварительно прореживается
+  до 8 кГц усреднением, что в несколько раз снижает объем вычислений.
+
+  Блок содержит цифру, если уровни одной частоты нижней группы и одной
+  частоты верхней группы достаточны, преобладают над остальными частотами
+  своих групп, перекос уровней (twist) находится в допустимых пределах,
+  и сумма уровней составляет основную часть энергии блока (отсечение речи).
+  Цифра считается нажатой, если она обнаружена в двух блоках подряд,
+  и отпущенной после двух блоков подряд без цифры.
+
+  Все буферы выделены заранее, функции не используют блокировок.
+*/
+class DtmfDetector
+{
+public:
+    DtmfDetector() = default;
+
+    void reset(const VoiceFrameInfo&);
+
+    // Обработка голосового фрейма, count - количество фреймов сэмплов.
+    // Для многоканального сигнала анализируется первый канал. Возвращает
+    // цифры ('0'-'9', '*', '#', 'A'-'D'), нажатие которых обнаружено
+    // в этом фрейме, обычно пустую строку
+    QString process(const int16_t* pcm, quint32 count);
+
+private:
+    DISABLE_DEFAULT_COPY(DtmfDetector)
+
+    // Анализ заполненного блока, возвращает цифру или 0
+    char analyze();
+
+private:
+    float _block[DTMF_BLOCK_MAX];
+    quint32 _blockSize = {DTMF_BLOCK_SIZE};
+    quint32 _blockCount = {0};
+    double  _blockEnergy = {0};
+
+    // Прореживание: количество усредняемых сэмплов и накопленная сумма
+    quint32 _decimation = {1};
+    quint32 _decimCount = {0};
+    qint32  _decimSum = {0};
+
+    quint32 _channels = {1};
+
+    float _coef[GOERTZEL_BANK_SIZE] = {0};
+
+    char _lastHit = {0}; // Результат анализа предыдущего блока
+    char _digit = {0};   // Нажатая цифра
+};
@@ -0,0 +1,97 @@
+#include "echo_delay_estimator.h"
+#include "audio_kernels.h"
+
+#include <math.h>
+
+// Минимальная нормированная корреляция, при которой оценка считается
+// достоверной
+#define ECHO_MIN_CORRELATION 0.5f
+
+void EchoDelayEstimator::reset()
+{
+    _farCount = 0;
+    _nearCount = 0;
+    _delay = -1;
+}
+
+void EchoDelayEstimator::farEnd(const int16_t* pcm, quint32 count)
+{
+    _far[_farCount % ECHO_FAR_HISTORY] = level(pcm, count);
+    ++_farCount;
+}
+
+void EchoDelayEstimator::nearEnd(const int16_t* pcm, quint32 count)
+{
+    quint32 index = _nearCount % ECHO_NEAR_HISTORY;
+    _near[index] = level(pcm, count);
+    _nearFar[index] = _farCount;
+    ++_nearCount;
+}
+
+bool EchoDelayEstimator::estimate()
+{
+    if (_nearCount < ECHO_NEAR_HISTORY)
+        return false;
+
+    // Индексы дальнего сигнала должны оставаться в пределах истории
+    const quint32 oldest = _nearFar[_nearCount % ECHO_NEAR_HISTORY];
+    if (oldest < ECHO_MAX_LAG + 1
+        || _farCount - oldest + ECHO_MAX_LAG + 1 > ECHO_FAR_HISTORY)
+        return false;
+
+    float nearMean = 0;
+    for (int i = 0; i < ECHO_NEAR_HISTORY; ++i)
+        nearMean += _near[i];
+    nearMean /= ECHO_NEAR_HISTORY;
+
+    float nearVar = 0;
+    for (int i = 0; i < ECHO_NEAR_HISTORY; ++i)
+        nearVar += (_near[i] - nearMean) * (_near[i] - nearMean);
+
+    if (nearVar <= 0)
+        return false;
+
+    float bestCorr = 0;
+    int bestLag = -1;
+    for (int lag = 0; lag <= ECHO_MAX_LAG; ++lag)
+    {
+        float farMean = 0;
+        for (int i = 0; i < ECHO_NEAR_HISTORY; ++i)
+        {
+            quint32 f = _nearFar[i] - 1 - lag;
+            farMean += _far[f % ECHO_FAR_HISTORY];
+        }
+        farMean /= ECHO_NEAR_HISTORY;
+
+        float cov = 0;
+        float farVar = 0;
+        for (int i = 0; i < ECHO_NEAR_HISTORY; ++i)
+        {
+            quint32 f = _nearFar[i] - 1 - lag;
+            float a = _near[i] - nearMean;
+            float b = _far[f % ECHO_FAR_HISTORY] - farMean;
+            cov += a * b;
+            farVar += b * b;
+        }
+        if (farVar <= 0)
+            continue;
+
+        float corr = cov / sqrtf(nearVar * farVar);
+        if (corr > bestCorr)
+        {
+            bestCorr = corr;
+            bestLag = lag;
+        }
+    }
+
+    if (bestLag < 0 || bestCorr < ECHO_MIN_CORRELATION)
+        return false;
+
+    _delay = bestLag * 10;
+    return true;
+}
+
+float EchoDelayEstimator::level(const int16_t* pcm, quint32 count)
+{
+    return signalRms(pcm, count);
+}
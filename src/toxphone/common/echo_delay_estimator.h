@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QtCore>
+
+// Количество 10-мс фрагментов в истории опорного сигнала
+#define ECHO_FAR_HISTORY  128
+
+// Количество 10-мс фрагментов ближнего сигнала, по которым выполняется оценка
+#define ECHO_NEAR_HISTORY 50
+
+// Максимальная искомая задержка (в 10-мс фрагментах)
+#define ECHO_MAX_LAG      40
+
+/**
+  Оценка задержки эха по корреляции огибающих сигналов. Для каждого 10-мс
+  фрагмента дальнего (воспроизводимого) и ближнего (записанного) сигналов
+  вычисляется среднеквадратичный уровень, затем ищется сдвиг, при котором
+  нормированная корреляция огибающих максимальна.
+  Класс не является потокобезопасным.
+*/
+class EchoDelayEstimator
+{
+public:
+    EchoDelayEstimator() = default;
+
+    void reset();
+
+    // Добавление 10-мс фрагмента дальнего/ближнего сигнала
+    void farEnd(const int16_t* pcm, quint32 count);
+    void nearEnd(const int16_t* pcm, quint32 count);
+
+    // Выполняет оценку задержки. Возвращает TRUE, если получено достоверное
+    // значение, доступное через delay()
+    bool estimate();
+
+    // Задержка (в миллисекундах), -1 если оценка еще не выполнена
+    int delay() const {return _delay;}
+
+private:
+    static float level(const int16_t* pcm, quint32 count);
+
+private:
+    float   _far[ECHO_FAR_HISTORY] = {0};
+    quint32 _farCount = {0};
+
+    float   _near[ECHO_NEAR_HISTORY] = {0};
+    quint32 _nearFar[ECHO_NEAR_HISTORY] = {0}; // Значение _farCount в момент
+                                                // поступления ближнего фрагмента
+    quint32 _nearCount = {0};
+
+    int _delay = {-1};
+};
@@ -0,0 +1,311 @@
+#include "jitter_buffer.h"
+#include "voice_latency.h"
+
+#include <string.h>
+
+// Средний уровень сигнала (по модулю), ниже которого фрейм считается тишиной
+#define JITTER_SILENCE_LEVEL 300
+
+void JitterBuffer::setDelayLimits(quint32 minDelay, quint32 maxDelay)
+{
+    _minDelay = minDelay;
+    _maxDelay = qMax(minDelay, maxDelay);
+}
+
+void JitterBuffer::reset(const VoiceFrameInfo& voiceFrameInfo)
+{
+    clear(false);
+
+    _bytesPerSecond = voiceFrameInfo.samplingRate * voiceFrameInfo.sampleSize
+                      * voiceFrameInfo.channels;
+    _sampleAlign = qMax(voiceFrameInfo.sampleSize * voiceFrameInfo.channels, quint32(1));
+
+    _concealer.reset(voiceFrameInfo);
+    _concealedBytes = 0;
+
+    _lastArrival = 0;
+    _lastDuration = voiceFrameInfo.latency;
+    _lastSilence = false;
+    _jitter = 0;
+    _peakJitter = 0;
+    updateTargetDelay();
+
+    // Из фреймов, накопленных до готовности потока воспроизведения, лишние
+    // (сверх максимальной задержки) отбрасываются, начиная с самых старых
+    quint32 maxFrames = qMax(_maxDelay / qMax(voiceFrameInfo.latency, quint32(1)), quint32(1));
+    while (voiceQueue().count() > maxFrames)
+        voiceFramePool().release(voiceQueue().pop());
+
+    _statDelay = 0;
+    _statTargetDelay = _targetDelay;
+    _statJitter = 0;
+    _statReceived = 0;
+    _statLate = 0;
+    _statLost = 0;
+    _statConcealed = 0;
+}
+
+void JitterBuffer::clear(bool dropQueue)
+{
+    while (_count)
+        releaseFront();
+
+    if (dropQueue)
+        while (VoiceFrame* frame = voiceQueue().pop())
+            voiceFramePool().release(frame);
+
+    _head = 0;
+    _frameOffset = 0;
+    _bufferedBytes = 0;
+    _silenceBytes = 0;
+
+    _buffering = true;
+    _underrun = false;
+    _pause = false;
+    _underrunBytes = 0;
+    _underrunFrames = 0;
+}
+
+void JitterBuffer::receive()
+{
+    while (_count < VOICE_QUEUE_MAX_CAPACITY)
+    {
+        VoiceFrame* frame = voiceQueue().pop();
+        if (frame == nullptr)
+            break;
+
+        // Оценка джиттера по отклонению интервала между поступлениями фреймов
+        // от длительности предыдущего фрейма (RFC 3550, п. 6.4.1). Интервал
+        // больше максимальной задержки буфер компенсировать не может: это
+        // пауза в потоке или обрыв связи, в оценке джиттера он не учитывается
+        qint64 d = (frame->timestamp - _lastArrival) - qint64(_lastDuration);
+        if (_lastArrival && qAbs(d) <= qint64(_maxDelay))
+        {
+            quint32 ad = quint32(qAbs(d));
+
+            _jitter = quint32(qint64(_jitter) + (qint64(ad) - qint64(_jitter)) / 16);
+            _peakJitter -= _peakJitter / 64;
+            if (ad > _peakJitter)
+                _peakJitter = ad;
+        }
+        _lastArrival = frame->timestamp;
+        _lastDuration = bytesToTime(frame->dataSize);
+        _lastSilence = isSilence(frame);
+        ++_statReceived;
+
+        // Фрейм, для которого уже была воспроизведена тишина, считается
+        // опоздавшим, а не потерянным
+        if (_underrunFrames)
+        {
+            --_underrunFrames;
+            ++_statLate;
+            --_statLost;
+        }
+
+        _frames[(_head + _count) % VOICE_QUEUE_MAX_CAPACITY] = frame;
+        ++_count;
+        _bufferedBytes += frame->dataSize;
+    }
+    updateTargetDelay();
+}
+
+void JitterBuffer::updateTargetDelay()
+{
+    quint32 delay = _lastDuration + qMax(3 * _jitter, _peakJitter);
+    _targetDelay = qBound(_minDelay, delay, _maxDelay);
+}
+
+size_t JitterBuffer::read(char* buff, size_t size)
+{
+    // Буфер не инициализирован (см. reset())
+    if (_bytesPerSecond == 0)
+    {
+        memset(buff, 0, size);
+        return 0;
+    }
+
+    receive();
+
+    size_t done = 0;
+    size_t dataBytes = 0;
+    while (done < size)
+    {
+        if (_buffering)
+        {
+            // Накопление завершается только при наличии фреймов, иначе при
+            // нулевой целевой задержке цикл не завершится
+            if (_count
+                && (_bufferedBytes >= timeToBytes(_targetDelay)
+                    || _count == VOICE_QUEUE_MAX_CAPACITY))
+            {
+                _buffering = false;
+                _underrun = false;
+                _pause = false;
+                _underrunBytes = 0;
+                _underrunFrames = 0;
+            }
+            else
+            {
+                size_t n = size - done;
+                if (_underrun)
+                {
+                    // Данные закончились во время воспроизведения, вместо
+                    // тишины выполняется маскирование потерь
+                    _concealer.conceal((int16_t*)(buff + done), n / sizeof(int16_t));
+
+                    quint32 frameBytes = qMax(timeToBytes(_lastDuration), _sampleAlign);
+                    if (!_pause)
+                    {
+                        _underrunBytes += n;
+                        while (_underrunBytes >= frameBytes)
+                        {
+                            _underrunBytes -= frameBytes;
+                            ++_underrunFrames;
+                            ++_statLost;
+                        }
+
+                        // Исчерпание данных дольше максимальной задержки
+                        // считается паузой в потоке, учтенные потери
+                        // отменяются
+                        if (quint64(_underrunFrames) * _lastDuration > _maxDelay)
+                        {
+                            _statLost -= _underrunFrames;
+                            _underrunFrames = 0;
+                            _underrunBytes = 0;
+                            _pause = true;
+                        }
+                    }
+                    _concealedBytes += n;
+                    while (_concealedBytes >= frameBytes)
+                    {
+                        _concealedBytes -= frameBytes;
+                        ++_statConcealed;
+                    }
+                }
+                else
+                    memset(buff + done, 0, n);
+
+                done += n;
+                break;
+            }
+        }
+
+        if (_silenceBytes)
+        {
+            size_t n = qMin(size_t(_silenceBytes), size - done);
+            memset(buff + done, 0, n);
+            _silenceBytes -= n;
+            done += n;
+            continue;
+        }
+
+        VoiceFrame* frame = front();
+        if (frame == nullptr)
+        {
+            // Данные, закончившиеся на фрейме тишины, - пауза в речи
+            // (отправитель не передает фреймы во время пауз)
+            _buffering = true;
+            _underrun = true;
+            _pause = _lastSilence;
+            continue;
+        }
+
+        // Подстройка задержки выполняется только на границе фреймов
+        if (_frameOffset == 0)
+        {
+            quint32 delay = bytesToTime(_bufferedBytes);
+            quint32 duration = bytesToTime(frame->dataSize);
+
+            if (delay > _maxDelay + duration
+                || (delay > _targetDelay + duration && isSilence(frame)))
+            {
+                releaseFront();
+                continue;
+            }
+            if (delay + duration < _targetDelay && isSilence(frame))
+            {
+                _silenceBytes = frame->dataSize - frame->dataSize % _sampleAlign;
+                if (_silenceBytes)
+                    continue;
+            }
+        }
+
+        if (_frameOffset == 0)
+            voiceLatency().add(VoiceLatency::ReceiveToPlayback,
+                               voiceTimestamp() - frame->timestamp);
+
+        size_t n = qMin(size_t(frame->dataSize - _frameOffset), size - done);
+        memcpy(buff + done, frame->data + _frameOffset, n);
+        _concealer.play((int16_t*)(buff + done), n / sizeof(int16_t));
+        _frameOffset += n;
+        done += n;
+        dataBytes += n;
+
+        _bufferedBytes -= n;
+
+        if (_frameOffset >= frame->dataSize)
+            releaseFront();
+    }
+
+    _statDelay = bytesToTime(_bufferedBytes);
+    _statTargetDelay = _targetDelay;
+    _statJitter = _jitter;
+
+    return dataBytes;
+}
+
+JitterBuffer::Stat JitterBuffer::stat() const
+{
+    Stat stat;
+    stat.delay       = _statDelay;
+    stat.targetDelay = _statTargetDelay;
+    stat.jitter      = _statJitter;
+    stat.received    = _statReceived;
+    stat.late        = _statLate;
+    stat.lost        = _statLost;
+    stat.concealed   = _statConcealed;
+    return stat;
+}
+
+VoiceFrame* JitterBuffer::front() const
+{
+    return (_count) ? _frames[_head] : nullptr;
+}
+
+void JitterBuffer::releaseFront()
+{
+    VoiceFrame* frame = _frames[_head];
+    _bufferedBytes -= (frame->dataSize - _frameOffset);
+    _frameOffset = 0;
+
+    _head = (_head + 1) % VOICE_QUEUE_MAX_CAPACITY;
+    --_count;
+    voiceFramePool().release(frame);
+}
+
+quint32 JitterBuffer::bytesToTime(quint32 bytes) const
+{
+    if (_bytesPerSecond == 0)
+        return 0;
+    return quint32(quint64(bytes) * 1000000 / _bytesPerSecond);
+}
+
+quint32 JitterBuffer::timeToBytes(quint32 time) const
+{
+    quint32 bytes = quint32(quint64(time) * _bytesPerSecond / 1000000);
+    return bytes - bytes % _sampleAlign;
+}
+
+bool JitterBuffer::isSilence(const VoiceFrame* frame)
+{
+    const int16_t* pcm = (const int16_t*)frame->data;
+    quint32 count = frame->dataSize / sizeof(int16_t);
+    if (count == 0)
+        return true;
+
+    quint64 sum = 0;
+    for (quint32 i = 0; i < count; ++i)
+        sum += qAbs(int(pcm[i]));
+
+    return (sum / count) < JITTER_SILENCE_LEVEL;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "voice_frame.h"
+#include "loss_concealer.h"
+#include "shared/defmac.h"
+
+#include <QtCore>
+#include <atomic>
+
+/**
+  Адаптивный джиттер-буфер для входящего голосового потока. Располагается
+  между voiceQueue() и потоком воспроизведения PulseAudio.
+
+  По времени поступления фреймов (VoiceFrame::timestamp) оценивается джиттер
+  сети, на его основе вычисляется целевая задержка воспроизведения. Текущая
+  задержка подстраивается под целевую только на участках тишины: лишние
+  тихие фреймы отбрасываются, недостающие - дополняются тишиной. При
+  исчерпании данных буфер заново накапливает целевую задержку, на это время
+  отсутствующие данные маскируются (см. LossConcealer).
+
+  ToxAV не передает признак паузы в потоке, поэтому паузы определяются
+  по косвенным признакам: исчерпание данных после фрейма тишины (отправитель
+  не передает фреймы во время пауз в речи) или длительностью больше
+  максимальной задержки считается паузой, а не потерей. Интервалы между
+  поступлениями фреймов больше максимальной задержки не учитываются
+  в оценке джиттера.
+
+  Все функции, кроме stat(), вызываются только из потока PulseAudio (или под
+  блокировкой его mainloop).
+*/
+class JitterBuffer
+{
+public:
+    struct Stat
+    {
+        quint32 delay       = {0}; // Текущая задержка (в микросекундах)
+        quint32 targetDelay = {0}; // Целевая задержка (в микросекундах)
+        quint32 jitter      = {0}; // Оценка джиттера (в микросекундах)
+        quint32 received    = {0}; // Количество поступивших фреймов
+        quint32 late        = {0}; // Количество опоздавших фреймов
+        quint32 lost        = {0}; // Количество потерянных фреймов
+        quint32 concealed   = {0}; // Количество маскированных фреймов
+    };
+
+    JitterBuffer() = default;
+
+    // Пределы целевой задержки (в микросекундах)
+    void setDelayLimits(quint32 minDelay, quint32 maxDelay);
+
+    // Сбрасывает состояние и статистику, возвращает в пул фреймы буфера.
+    // Фреймы, ожидающие в voiceQueue(), сохраняются (в пределах максимальной
+    // задержки) и будут воспроизведены
+    void reset(const VoiceFrameInfo&);
+
+    // Возвращает в пул фреймы буфера, а также (если dropQueue равен TRUE)
+    // все фреймы из voiceQueue()
+    void clear(bool dropQueue = true);
+
+    // Заполняет буфер воспроизведения размером size. Возвращает количество
+    // байт реальных аудио-данных, остаток буфера заполняется тишиной или
+    // синтезированным сигналом (при маскировании потерь)
+    size_t read(char* buff, size_t size);
+
+    // Статистика, может вызываться из любого потока
+    Stat stat() const;
+
+private:
+    DISABLE_DEFAULT_COPY(JitterBuffer)
+
+    // Извлекает поступившие фреймы из voiceQueue() и обновляет оценку джиттера
+    void receive();
+    void updateTargetDelay();
+
+    VoiceFrame* front() const;
+    void releaseFront();
+
+    quint32 bytesToTime(quint32 bytes) const;
+    quint32 timeToBytes(quint32 time) const;
+
+    static bool isSilence(const VoiceFrame*);
+
+private:
+    VoiceFrame* _frames[VOICE_QUEUE_MAX_CAPACITY] = {0};
+    quint32 _head = {0};
+    quint32 _count = {0};
+
+    quint32 _frameOffset = {0};   // Позиция чтения в первом фрейме
+    quint32 _bufferedBytes = {0}; // Объем непроигранных данных
+    quint32 _silenceBytes = {0};  // Объем вставляемой тишины
+
+    quint32 _bytesPerSecond = {0};
+    quint32 _sampleAlign = {1};
+
+    quint32 _minDelay = {20000};
+    quint32 _maxDelay = {200000};
+
+    qint64  _lastArrival = {0};
+    quint32 _lastDuration = {0};
+    quint32 _jitter = {0};     // Сглаженный джиттер (RFC 3550)
+    quint32 _peakJitter = {0}; // Пиковое значение джиттера с затуханием
+    quint32 _targetDelay = {0};
+
+    LossConcealer _concealer;
+    quint32 _concealedBytes = {0};
+
+    bool _buffering = {true};  // Накопление данных до целевой задержки
+    bool _underrun = {false};  // Данные закончились во время воспроизведения
+    bool _pause = {false};     // Исчерпание данных считается паузой в потоке
+    bool _lastSilence = {false}; // Последний поступивший фрейм - тишина
+    quint32 _underrunBytes = {0};
+    quint32 _underrunFrames = {0};
+
+    std::atomic<quint32> _statDelay = {0};
+    std::atomic<quint32> _statTargetDelay = {0};
+    std::atomic<quint32> _statJitter = {0};
+    std::atomic<quint32> _statReceived = {0};
+    std::atomic<quint32> _statLate = {0};
+    std::atomic<quint32> _statLost = {0};
+    std::atomic<quint32> _statConcealed = {0};
+};
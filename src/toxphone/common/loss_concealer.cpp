@@ -0,0 +1,186 @@
+#include "loss_concealer.h"
+
+#include <string.h>
+
+// Верхняя граница уровня комфортного шума
+#define PLC_NOISE_LEVEL_MAX 100
+
+// История должна вмещать два максимальных периода основного тона (50 Гц)
+// для частоты дискретизации 48 кГц, см. estimatePitch()
+static_assert(PLC_HISTORY_MAX >= 2 * (48000 / 50) * 2, "PLC history is too small");
+
+void LossConcealer::reset(const VoiceFrameInfo& voiceFrameInfo)
+{
+    _channels = qBound(quint32(1), quint32(voiceFrameInfo.channels), quint32(2));
+    _samplingRate = voiceFrameInfo.samplingRate;
+
+    // Размер вычисляется без округления количества сэмплов на миллисекунду,
+    // иначе для 44.1 кГц история получается меньше двух периодов 50 Гц
+    _historySize = quint32(quint64(_samplingRate) * 40 / 1000) * _channels;
+    if (_historySize > PLC_HISTORY_MAX)
+        _historySize = PLC_HISTORY_MAX;
+    _historySize -= _historySize % _channels;
+    _historyCount = 0;
+
+    _pitch = 0;
+    _concealPos = 0;
+    _active = false;
+
+    _noiseLevel = 0;
+    _random = 1;
+}
+
+void LossConcealer::play(int16_t* pcm, quint32 count)
+{
+    if (count == 0 || _historySize == 0)
+        return;
+
+    if (_active)
+    {
+        // Плавный переход от синтезированного сигнала к реальному
+        int16_t synth[PLC_MERGE_MAX];
+        quint32 frames = qMin(count, quint32(PLC_MERGE_MAX)) / _channels;
+        frames = qMin(frames, (_samplingRate / 1000) * 5);
+        if (frames)
+        {
+            synthesize(synth, frames);
+            for (quint32 i = 0; i < frames; ++i)
+                for (quint32 c = 0; c < _channels; ++c)
+                {
+                    quint32 n = i * _channels + c;
+                    pcm[n] = int16_t((int(synth[n]) * int(frames - i) + int(pcm[n]) * int(i)) / int(frames));
+                }
+        }
+        _active = false;
+        _concealPos = 0;
+    }
+
+    // Оценка уровня фонового шума: быстрое снижение, медленный рост
+    quint64 sum = 0;
+    for (quint32 i = 0; i < count; ++i)
+        sum += qAbs(int(pcm[i]));
+    quint32 level = quint32(sum / count);
+    if (level < _noiseLevel)
+        _noiseLevel = level;
+    else
+        _noiseLevel += (level - _noiseLevel) / 64 + 1;
+    if (_noiseLevel > PLC_NOISE_LEVEL_MAX)
+        _noiseLevel = PLC_NOISE_LEVEL_MAX;
+
+    // Сохранение истории
+    if (count >= _historySize)
+    {
+        memcpy(_history, pcm + (count - _historySize), _historySize * sizeof(int16_t));
+        _historyCount = _historySize;
+    }
+    else
+    {
+        quint32 keep = qMin(_historyCount, _historySize - count);
+        memmove(_history, _history + (_historyCount - keep), keep * sizeof(int16_t));
+        memcpy(_history + keep, pcm, count * sizeof(int16_t));
+        _historyCount = keep + count;
+    }
+}
+
+void LossConcealer::conceal(int16_t* pcm, quint32 count)
+{
+    if (!_active)
+    {
+        _active = true;
+        _concealPos = 0;
+        estimatePitch();
+    }
+
+    quint32 frames = count / _channels;
+    synthesize(pcm, frames);
+    _concealPos += frames;
+
+    for (quint32 i = frames * _channels; i < count; ++i)
+        pcm[i] = 0;
+}
+
+void LossConcealer::estimatePitch()
+{
+    _pitch = 0;
+    if (_samplingRate == 0)
+        return;
+
+    // Поиск периода основного тона в диапазоне 50..400 Гц по максимуму
+    // нормированной автокорреляции. Для ограничения времени вычислений
+    // используется прореживание до ~12 кГц и только первый канал.
+    const quint32 minLag = _samplingRate / 400;
+    const quint32 maxLag = _samplingRate / 50;
+    const quint32 window = maxLag;
+    const quint32 step = qMax(_samplingRate / 12000, quint32(1));
+    const quint32 frames = _historyCount / _channels;
+
+    if (frames < maxLag + window)
+        return;
+
+    const int16_t* x = _history + (frames - window) * _channels;
+
+    float bestScore = 0;
+    for (quint32 lag = minLag; lag <= maxLag; lag += step)
+    {
+        float corr = 0;
+        float energy = 0;
+        for (quint32 i = 0; i < window; i += step)
+        {
+            float a = x[i * _channels];
+            float b = x[(int(i) - int(lag)) * int(_channels)];
+            corr += a * b;
+            energy += b * b;
+        }
+        if (corr > 0 && energy > 0)
+        {
+            float score = corr * corr / energy;
+            if (score > bestScore)
+            {
+                bestScore = score;
+                _pitch = lag;
+            }
+        }
+    }
+}
+
+void LossConcealer::synthesize(int16_t* pcm, quint32 frames)
+{
+    // Первые 10 мс период повторяется без затухания, следующие 50 мс
+    // амплитуда снижается до нуля с переходом в комфортный шум
+    const quint32 fadeStart = (_samplingRate / 1000) * 10;
+    const quint32 fadeLength = qMax((_samplingRate / 1000) * 50, quint32(1));
+    const quint32 historyFrames = _historyCount / _channels;
+
+    for (quint32 i = 0; i < frames; ++i)
+    {
+        quint32 pos = _concealPos + i;
+
+        int gain = 0; // В формате Q15
+        if (_pitch && pos < fadeStart)
+            gain = 32768;
+        else if (_pitch && pos < fadeStart + fadeLength)
+            gain = int(32768 - quint64(pos - fadeStart) * 32768 / fadeLength);
+
+        for (quint32 c = 0; c < _channels; ++c)
+        {
+            int value = 0;
+            if (gain)
+            {
+                quint32 src = historyFrames - _pitch + (pos % _pitch);
+                value = (int(_history[src * _channels + c]) * gain) >> 15;
+            }
+            value += (int(noise()) * (32768 - gain)) >> 15;
+            pcm[i * _channels + c] = int16_t(qBound(-32768, value, 32767));
+        }
+    }
+}
+
+int16_t LossConcealer::noise()
+{
+    if (_noiseLevel == 0)
+        return 0;
+
+    _random = _random * 1103515245 + 12345;
+    int r = int((_random >> 16) & 0x7FFF) - 0x4000; // -16384..16383
+    return int16_t((r * int(_noiseLevel)) / 16384);
+}
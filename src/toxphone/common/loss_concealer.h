@@ -0,0 +1,64 @@
+#pragma once
+
+#include "voice_frame.h"
+#include "shared/defmac.h"
+
+#include <QtCore>
+
+// Максимальный размер истории: 40 мс (два периода основного тона 50 Гц),
+// 48 кГц, 2 канала
+#define PLC_HISTORY_MAX (40 * 48 * 2)
+
+// Максимальный размер участка сглаживания при возобновлении потока:
+// 5 мс, 48 кГц, 2 канала
+#define PLC_MERGE_MAX (5 * 48 * 2)
+
+/**
+  Маскирование потерь голосового потока (PLC). Вместо тишины на месте
+  отсутствующих данных синтезируется сигнал: повторяется последний период
+  основного тона с затуханием, затем сигнал плавно переходит в комфортный
+  шум. При возобновлении потока выполняется сглаживание стыка.
+
+  Все буферы выделены заранее, функции не используют блокировок и имеют
+  ограниченное время выполнения, что позволяет вызывать их из потока
+  PulseAudio.
+*/
+class LossConcealer
+{
+public:
+    LossConcealer() = default;
+
+    void reset(const VoiceFrameInfo&);
+
+    // Обработка реальных аудио-данных: сглаживание стыка после маскирования
+    // и сохранение истории. Параметр count - количество сэмплов (int16_t)
+    void play(int16_t* pcm, quint32 count);
+
+    // Синтез count сэмплов на месте отсутствующих данных
+    void conceal(int16_t* pcm, quint32 count);
+
+    // Признак выполнения маскирования
+    bool active() const {return _active;}
+
+private:
+    DISABLE_DEFAULT_COPY(LossConcealer)
+
+    void estimatePitch();
+    void synthesize(int16_t* pcm, quint32 frames);
+    int16_t noise();
+
+private:
+    int16_t _history[PLC_HISTORY_MAX];
+    quint32 _historySize = {0};  // Емкость истории (в сэмплах)
+    quint32 _historyCount = {0}; // Заполнение истории (в сэмплах)
+
+    quint32 _channels = {1};
+    quint32 _samplingRate = {0};
+
+    quint32 _pitch = {0};       // Период основного тона (в фреймах сэмплов)
+    quint32 _concealPos = {0};  // Позиция от начала маскирования (в фреймах сэмплов)
+    bool    _active = {false};
+
+    quint32 _noiseLevel = {0};
+    quint32 _random = {1};
+};
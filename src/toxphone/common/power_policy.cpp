@@ -0,0 +1,365 @@
+#include "power_policy.h"
+#include "voice_frame.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/config/appl_conf.h"
+#include "shared/qt/logger_operators.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <time.h>
+
+#define log_error_m   alog::logger().error  (alog_line_location, "PowerPolicy")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "PowerPolicy")
+#define log_info_m    alog::logger().info   (alog_line_location, "PowerPolicy")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "PowerPolicy")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "PowerPolicy")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "PowerPolicy")
+
+using namespace std;
+
+// Количество ступеней частоты, если драйвер не предоставляет список
+// допустимых частот (scaling_available_frequencies)
+#define POWER_POLICY_DEFAULT_STEPS 4
+
+static bool readValue(const QString& fileName, QByteArray& value)
+{
+    QFile file {fileName};
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    value = file.readAll().trimmed();
+    return true;
+}
+
+static bool readValue(const QString& fileName, quint32& value)
+{
+    QByteArray data;
+    if (!readValue(fileName, data))
+        return false;
+
+    bool ok;
+    value = data.toUInt(&ok);
+    return ok;
+}
+
+static bool writeValue(const QString& fileName, quint32 value)
+{
+    QFile file {fileName};
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QByteArray data = QByteArray::number(value) + '\n';
+    return (file.write(data) == data.size());
+}
+
+PowerPolicy& powerPolicy()
+{
+    return safe::singleton<PowerPolicy, 0>();
+}
+
+PowerPolicy::PowerPolicy()
+{
+    resetAudioLoad();
+}
+
+bool PowerPolicy::init()
+{
+    bool active = true;
+    config::base().getValue("power_policy.active", active);
+    if (!active)
+    {
+        log_verbose_m << "Power policy is disabled";
+        return false;
+    }
+
+    QString sysfsRoot = "/sys";
+    config::base().getValue("power_policy.sysfs_root", sysfsRoot);
+
+    int loadHigh = 60;
+    config::base().getValue("power_policy.load_high", loadHigh);
+    _loadHigh = quint32(qBound(1, loadHigh, 100));
+
+    int loadLow = 30;
+    config::base().getValue("power_policy.load_low", loadLow);
+    _loadLow = qMin(quint32(qMax(loadLow, 0)), _loadHigh);
+
+    int stepDownDelay = 3;
+    config::base().getValue("power_policy.step_down_delay", stepDownDelay);
+    _stepDownDelay = quint32(qMax(stepDownDelay, 1));
+
+    int setupTimeout = 30;
+    config::base().getValue("power_policy.setup_timeout", setupTimeout);
+    _setupTimeout = quint32(qMax(setupTimeout, 1));
+
+    QStringList paths;
+    QDir cpufreqDir {sysfsRoot + "/devices/system/cpu/cpufreq"};
+    for (const QString& name : cpufreqDir.entryList({"policy*"}, QDir::Dirs, QDir::Name))
+        paths.append(cpufreqDir.absoluteFilePath(name));
+
+    // Старые ядра не создают директории policyN
+    if (paths.isEmpty())
+        paths.append(sysfsRoot + "/devices/system/cpu/cpu0/cpufreq");
+
+    _policies.clear();
+    _steps = 0;
+    for (const QString& path : paths)
+    {
+        CpuPolicy policy;
+        if (readPolicy(path, policy))
+        {
+            _steps = qMax(_steps, policy.freqs.count());
+            _policies.append(policy);
+        }
+    }
+
+    if (_policies.isEmpty())
+    {
+        log_info_m << "Control of CPU frequency is not available"
+                   << "; sysfs root: " << sysfsRoot;
+        return false;
+    }
+
+    _state = State::Idle;
+    _active = true;
+    setFloor(-1, true);
+    log_verbose_m << "CPU frequency policies: " << _policies.count()
+                  << "; frequency steps: " << _steps;
+    return true;
+}
+
+void PowerPolicy::deinit()
+{
+    if (!_active)
+        return;
+
+    setFloor(-1);
+    _state = State::Idle;
+    _active = false;
+}
+
+bool PowerPolicy::readPolicy(const QString& path, CpuPolicy& policy)
+{
+    quint32 cpuMin, cpuMax, scalingMin;
+    if (!readValue(path + "/cpuinfo_min_freq", cpuMin)
+        || !readValue(path + "/cpuinfo_max_freq", cpuMax)
+        || !readValue(path + "/scaling_min_freq", scalingMin))
+    {
+        return false;
+    }
+
+    // В режиме ожидания используется минимальная частота процессора, а не
+    // текущее значение scaling_min_freq: оно может остаться завышенным после
+    // аварийного завершения программы во время звонка
+    policy.minFreq = cpuMin;
+
+    if (!QFileInfo(path + "/scaling_min_freq").isWritable())
+    {
+        log_warn_m << "File " << path << "/scaling_min_freq is not writable"
+                   << ". Control of CPU frequency for this policy is disabled";
+        return false;
+    }
+
+    policy.path = path;
+    policy.freqs.clear();
+
+    QByteArray available;
+    if (readValue(path + "/scaling_available_frequencies", available))
+    {
+        for (const QByteArray& item : available.simplified().split(' '))
+        {
+            bool ok;
+            quint32 freq = item.toUInt(&ok);
+            if (ok && freq >= cpuMin && freq <= cpuMax)
+                policy.freqs.append(freq);
+        }
+        std::sort(policy.freqs.begin(), policy.freqs.end());
+        policy.freqs.erase(std::unique(policy.freqs.begin(), policy.freqs.end()),
+                           policy.freqs.end());
+    }
+    if (policy.freqs.count() < 2)
+    {
+        policy.freqs.clear();
+        for (int i = 0; i < POWER_POLICY_DEFAULT_STEPS; ++i)
+            policy.freqs.append(cpuMin + (cpuMax - cpuMin) * i
+                                         / (POWER_POLICY_DEFAULT_STEPS - 1));
+    }
+
+    log_debug_m << "CPU frequency policy " << path
+                << "; min: " << cpuMin << "; max: " << cpuMax
+                << "; scaling min: " << scalingMin;
+    return true;
+}
+
+void PowerPolicy::setFloor(int step, bool force)
+{
+    if (step == _step && !force)
+        return;
+
+    for (const CpuPolicy& policy : _policies)
+    {
+        quint32 freq = policy.minFreq;
+        if (step >= 0)
+        {
+            // Ступени политик с разным количеством частот сопоставляются
+            // пропорционально
+            int index = (_steps > 1)
+                        ? (step * (policy.freqs.count() - 1) + (_steps - 1) / 2) / (_steps - 1)
+                        : policy.freqs.count() - 1;
+            freq = policy.freqs[index];
+
+            // Нижняя граница не может превышать верхнюю
+            quint32 maxFreq;
+            if (readValue(policy.path + "/scaling_max_freq", maxFreq))
+                freq = qMin(freq, maxFreq);
+        }
+        if (!writeValue(policy.path + "/scaling_min_freq", freq))
+            log_error_m << "Failed write " << freq
+                        << " to " << policy.path << "/scaling_min_freq";
+    }
+    log_debug_m << "CPU frequency floor step: " << step
+                << (step < 0 ? " (idle)" : "");
+    _step = step;
+}
+
+void PowerPolicy::callSetup()
+{
+    if (!_active)
+        return;
+
+    if (_state == State::Idle)
+    {
+        _state = State::Setup;
+        _stateTimer.reset();
+        resetAudioLoad();
+    }
+    setFloor(_steps - 1);
+}
+
+void PowerPolicy::callStarted()
+{
+    if (!_active)
+        return;
+
+    if (_state != State::Call)
+        resetAudioLoad();
+
+    _state = State::Call;
+    _lowLoadTimer.reset();
+    setFloor(_steps - 1);
+}
+
+void PowerPolicy::callFinished()
+{
+    if (!_active)
+        return;
+
+    _state = State::Idle;
+    resetAudioLoad();
+    setFloor(-1);
+}
+
+void PowerPolicy::resetAudioLoad()
+{
+    // Загрузка предыдущего звонка не должна влиять на решения в следующем
+    for (int i = 0; i < AudioThreadCount; ++i)
+        _audioLoad[i] = 0;
+}
+
+void PowerPolicy::update()
+{
+    if (!_active)
+        return;
+
+    if (_state == State::Setup)
+    {
+        // Трубка снята, но вызов так и не состоялся
+        if (_stateTimer.elapsed<chrono::seconds>() > _setupTimeout)
+            callFinished();
+        return;
+    }
+    if (_state != State::Call)
+        return;
+
+    quint32 load = 0;
+    for (int i = 0; i < AudioThreadCount; ++i)
+        load = qMax(load, quint32(_audioLoad[i]));
+
+    if (load >= _loadHigh)
+    {
+        setFloor(_steps - 1);
+        _lowLoadTimer.reset();
+    }
+    else if (load < _loadLow)
+    {
+        if (_step > 0 && _lowLoadTimer.elapsed<chrono::seconds>() >= _stepDownDelay)
+        {
+            setFloor(_step - 1);
+            _lowLoadTimer.reset();
+        }
+    }
+    else
+        _lowLoadTimer.reset();
+}
+
+//-------------------------------- ThreadLoad --------------------------------
+
+// Процессорное время текущего потока (в микросекундах)
+static qint64 threadCpuTime()
+{
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return -1;
+
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+quint32 ThreadLoad::measure()
+{
+    qint64 cpuTime = threadCpuTime();
+    if (cpuTime < 0)
+        return 0;
+
+    qint64 time = voiceTimestamp();
+
+    quint32 load = 0;
+    if (_cpuTime >= 0 && time > _time)
+        load = quint32((cpuTime - _cpuTime) * 100 / (time - _time));
+
+    _cpuTime = cpuTime;
+    _time = time;
+    return load;
+}
+
+//------------------------------- SectionLoad --------------------------------
+
+void SectionLoad::begin()
+{
+    _begin = threadCpuTime();
+}
+
+void SectionLoad::end()
+{
+    if (_begin < 0)
+        return;
+
+    qint64 cpuTime = threadCpuTime();
+    if (cpuTime > _begin)
+        _cpuTime += cpuTime - _begin;
+    _begin = -1;
+}
+
+quint32 SectionLoad::measure()
+{
+    qint64 time = voiceTimestamp();
+
+    quint32 load = 0;
+    if (_time >= 0 && time > _time)
+        load = quint32(_cpuTime * 100 / (time - _time));
+
+    _cpuTime = 0;
+    _time = time;
+    return load;
+}
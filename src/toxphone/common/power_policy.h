@@ -0,0 +1,123 @@
+#pragma once
+
+#include "shared/defmac.h"
+#include "shared/steady_timer.h"
+#include "shared/safe_singleton.h"
+
+#include <QtCore>
+#include <atomic>
+
+/**
+  Управление нижней границей частоты процессора (scaling_min_freq) на время
+  звонка. Запись выполняется напрямую в sysfs, корень sysfs задается
+  в конфигурации (параметр power_policy.sysfs_root), что позволяет проверять
+  работу компонента на подготовленном дереве файлов.
+
+  Частота поднимается до максимальной в момент начала установки соединения
+  (снятие трубки, входящий/исходящий вызов). Во время разговора нижняя
+  граница подстраивается по нагрузке аудио-потоков: при высокой нагрузке
+  сразу поднимается до максимума, при низкой - ступенчато снижается. После
+  завершения звонка нижняя граница возвращается к минимальной частоте
+  процессора (cpuinfo_min_freq).
+
+  Функции init(), deinit(), callSetup(), callStarted(), callFinished()
+  и update() вызываются из главного потока, setAudioLoad() - из любого.
+*/
+class PowerPolicy
+{
+public:
+    bool init();
+    void deinit();
+
+    // Начало установки соединения: трубка снята, входящий или исходящий
+    // вызов ожидает ответа
+    void callSetup();
+
+    // Соединение установлено, начат разговор
+    void callStarted();
+
+    // Звонок завершен (или трубка положена без вызова)
+    void callFinished();
+
+    // Аудио-потоки, по загрузке которых подстраивается частота. EncoderThread -
+    // кодирование голоса (toxav_audio_send_frame) в потоке ToxNet
+    enum AudioThread {FiltersThread = 0, EncoderThread = 1, AudioThreadCount};
+
+    // Загрузка аудио-потока (в процентах процессорного времени)
+    void setAudioLoad(AudioThread thread, quint32 load) {_audioLoad[thread] = load;}
+
+    // Периодическая подстройка частоты, вызывается раз в секунду
+    void update();
+
+private:
+    DISABLE_DEFAULT_COPY(PowerPolicy)
+    PowerPolicy();
+
+    enum class State {Idle, Setup, Call};
+
+    struct CpuPolicy
+    {
+        QString path;            // Директория политики cpufreq
+        quint32 minFreq = {0};   // Нижняя граница в режиме ожидания (в кГц)
+        QVector<quint32> freqs;  // Допустимые частоты по возрастанию (в кГц)
+    };
+
+    bool readPolicy(const QString& path, CpuPolicy&);
+    void setFloor(int step, bool force = false);
+    void resetAudioLoad();
+
+private:
+    bool _active = {false};
+    State _state = {State::Idle};
+    QVector<CpuPolicy> _policies;
+
+    int _steps = {0}; // Количество ступеней частоты (наибольшее по политикам)
+    int _step = {-1}; // Текущая ступень (-1 - режим ожидания)
+
+    std::atomic<quint32> _audioLoad[AudioThreadCount];
+
+    quint32 _loadHigh = {60};
+    quint32 _loadLow = {30};
+    quint32 _stepDownDelay = {3};  // В секундах
+    quint32 _setupTimeout = {30};  // В секундах
+
+    steady_timer _stateTimer;
+    steady_timer _lowLoadTimer;
+
+    template<typename T, int> friend T& safe::singleton();
+};
+PowerPolicy& powerPolicy();
+
+/**
+  Измерение загрузки потока: отношение процессорного времени потока
+  к прошедшему времени. Функция measure() вызывается из измеряемого потока
+  и возвращает загрузку (в процентах) с момента предыдущего вызова.
+*/
+class ThreadLoad
+{
+public:
+    quint32 measure();
+
+private:
+    qint64 _cpuTime = {-1}; // В микросекундах
+    qint64 _time = {0};
+};
+
+/**
+  Измерение загрузки участка кода: отношение процессорного времени потока,
+  потраченного между begin() и end(), к прошедшему времени. Функции
+  вызываются из одного потока, measure() возвращает загрузку (в процентах)
+  с момента предыдущего вызова.
+*/
+class SectionLoad
+{
+public:
+    void begin();
+    void end();
+    quint32 measure();
+
+private:
+    qint64 _begin = {-1};   // В микросекундах
+    qint64 _cpuTime = {0};  // Суммарное время участка (в микросекундах)
+    qint64 _time = {-1};
+};
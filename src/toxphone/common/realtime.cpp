@@ -0,0 +1,169 @@
+#include "realtime.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/config/appl_conf.h"
+#include "shared/qt/logger_operators.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#define log_error_m   alog::logger().error  (alog_line_location, "Realtime")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "Realtime")
+#define log_info_m    alog::logger().info   (alog_line_location, "Realtime")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "Realtime")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "Realtime")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "Realtime")
+
+using namespace std;
+
+// Разбирает список процессоров вида "2,3" или "1-3"
+static bool parseCpuList(const string& list, cpu_set_t& cpuSet, int& cpuCount)
+{
+    CPU_ZERO(&cpuSet);
+    cpuCount = 0;
+
+    const int cpuMax = int(sysconf(_SC_NPROCESSORS_CONF));
+    const char* p = list.c_str();
+    while (*p)
+    {
+        while (*p == ' ' || *p == ',')
+            ++p;
+        if (*p == '\0')
+            break;
+
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            return false;
+
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            ++p;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return false;
+            p = end;
+        }
+        if (first < 0 || last < first || last >= cpuMax)
+            return false;
+
+        for (long cpu = first; cpu <= last; ++cpu)
+        {
+            CPU_SET(int(cpu), &cpuSet);
+            ++cpuCount;
+        }
+    }
+    return true;
+}
+
+void realtimeLockMemory()
+{
+    bool lockMemory = false;
+    config::base().getValue("realtime.lock_memory", lockMemory);
+    if (!lockMemory)
+        return;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        log_warn_m << "Failed lock process memory (mlockall): " << strerror(errno)
+                   << ". Memory pages may be swapped out";
+        return;
+    }
+    log_verbose_m << "Process memory is locked";
+}
+
+void realtimeSetupThread(const char* name)
+{
+    const string prefix = string("realtime.threads.") + name;
+    const pid_t tid = pid_t(syscall(SYS_gettid));
+
+    string policyName = "other";
+    config::base().getValue(prefix + ".policy", policyName, false);
+
+    int priority = 0;
+    config::base().getValue(prefix + ".priority", priority, false);
+
+    int niceValue = 0;
+    config::base().getValue(prefix + ".nice", niceValue, false);
+
+    string cpus;
+    config::base().getValue(prefix + ".cpus", cpus, false);
+
+    if (policyName == "fifo" || policyName == "rr")
+    {
+        int policy = (policyName == "fifo") ? SCHED_FIFO : SCHED_RR;
+        priority = std::max(priority, sched_get_priority_min(policy));
+        priority = std::min(priority, sched_get_priority_max(policy));
+
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+
+        int err = pthread_setschedparam(pthread_self(), policy, &param);
+        if (err == 0)
+        {
+            log_verbose_m << "Thread '" << name << "' (tid " << tid << ")"
+                          << " policy: " << policyName
+                          << "; priority: " << priority;
+        }
+        else
+        {
+            log_warn_m << "Failed set " << policyName << " policy for thread '"
+                       << name << "': " << strerror(err)
+                       << ". Thread will work with normal priority";
+        }
+    }
+    else if (policyName != "other")
+    {
+        log_error_m << "Unknown scheduling policy '" << policyName
+                    << "' for thread '" << name << "'";
+    }
+
+    // Значение nice применяется к потокам с политикой other, а также
+    // используется как запасной вариант, если real-time политика недоступна
+    if (niceValue != 0)
+    {
+        int policy = SCHED_OTHER;
+        sched_param param;
+        pthread_getschedparam(pthread_self(), &policy, &param);
+        if (policy == SCHED_OTHER)
+        {
+            if (setpriority(PRIO_PROCESS, id_t(tid), niceValue) == 0)
+                log_verbose_m << "Thread '" << name << "' (tid " << tid << ")"
+                              << " nice: " << niceValue;
+            else
+                log_warn_m << "Failed set nice " << niceValue << " for thread '"
+                           << name << "': " << strerror(errno);
+        }
+    }
+
+    if (!cpus.empty())
+    {
+        cpu_set_t cpuSet;
+        int cpuCount;
+        if (!parseCpuList(cpus, cpuSet, cpuCount) || cpuCount == 0)
+        {
+            log_error_m << "Invalid cpu list '" << cpus
+                        << "' for thread '" << name << "'";
+            return;
+        }
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (err == 0)
+            log_verbose_m << "Thread '" << name << "' (tid " << tid << ")"
+                          << " pinned to cpus: " << cpus;
+        else
+            log_warn_m << "Failed set cpu affinity for thread '" << name
+                       << "': " << strerror(err);
+    }
+}
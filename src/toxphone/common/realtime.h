@@ -0,0 +1,18 @@
+#pragma once
+
+/**
+  Настройка планирования потоков и памяти процесса для аудио-тракта
+  (см. секцию realtime в файле конфигурации).
+
+  Если у процесса недостаточно привилегий (нет CAP_SYS_NICE/CAP_IPC_LOCK,
+  или исчерпан лимит RLIMIT_RTPRIO/RLIMIT_MEMLOCK), то выводится
+  предупреждение и работа продолжается с обычным приоритетом.
+*/
+
+// Блокирует страницы памяти процесса (mlockall), если это задано параметром
+// realtime.lock_memory
+void realtimeLockMemory();
+
+// Применяет к текущему потоку политику планирования, приоритет и привязку
+// к процессорам из секции realtime.threads.<name>
+void realtimeSetupThread(const char* name);
@@ -0,0 +1,106 @@
+#include "resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+// Количество фаз полифазного фильтра. Промежуточные значения вычисляются
+// линейной интерполяцией между соседними фазами
+#define RESAMPLER_PHASES 128
+
+// Длина фильтра для интерполяции (при понижении частоты дискретизации
+// увеличивается пропорционально коэффициенту понижения)
+#define RESAMPLER_TAPS 16
+
+// Частота среза относительно частоты Найквиста
+#define RESAMPLER_CUTOFF 0.9
+
+bool Resampler::init(quint32 inRate, quint32 outRate)
+{
+    _inChunk = 0;
+    _outChunk = 0;
+    _taps = 0;
+    _coeffs.clear();
+    _buff.clear();
+
+    if (inRate == 0 || outRate == 0 || (inRate % 100) || (outRate % 100))
+        return false;
+
+    // Частота среза в единицах частоты дискретизации входного сигнала
+    double cutoff = 0.5 * RESAMPLER_CUTOFF;
+    quint32 taps = RESAMPLER_TAPS;
+    if (outRate < inRate)
+    {
+        cutoff = cutoff * outRate / inRate;
+        taps = (RESAMPLER_TAPS * inRate + outRate - 1) / outRate;
+    }
+    taps += taps % 2;
+
+    _inChunk = inRate / 100;
+    _outChunk = outRate / 100;
+    _taps = taps;
+
+    _coeffs.resize((RESAMPLER_PHASES + 1) * taps);
+    for (quint32 phase = 0; phase <= RESAMPLER_PHASES; ++phase)
+    {
+        float* c = &_coeffs[phase * taps];
+        double sum = 0;
+        for (quint32 k = 0; k < taps; ++k)
+        {
+            // Расстояние от точки интерполяции до k-го сэмпла окна
+            double x = double(k) - double(taps / 2 - 1) - double(phase) / RESAMPLER_PHASES;
+            double s = (x == 0) ? 1.0 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+            double n = (x + double(taps) / 2) / double(taps);
+            double w = 0.42 - 0.5 * cos(2 * M_PI * n) + 0.08 * cos(4 * M_PI * n);
+            c[k] = float(s * w);
+            sum += c[k];
+        }
+        // Нормализация: единичное усиление на постоянной составляющей
+        for (quint32 k = 0; k < taps; ++k)
+            c[k] = float(c[k] / sum);
+    }
+
+    _buff.resize(taps + _inChunk);
+    reset();
+    return true;
+}
+
+void Resampler::reset()
+{
+    std::fill(_buff.begin(), _buff.end(), 0.f);
+}
+
+void Resampler::process(const float* in, float* out)
+{
+    if (_taps == 0)
+        return;
+
+    float* buff = _buff.data();
+    memcpy(buff + _taps, in, _inChunk * sizeof(float));
+
+    // Позиция k-го выходного сэмпла во входном фрагменте равна
+    // k * inChunk / outChunk, отсчет ведется с учетом задержки фильтра
+    for (quint32 k = 0; k < _outChunk; ++k)
+    {
+        quint32 pos = k * _inChunk;
+        quint32 index = pos / _outChunk;
+        quint32 frac = pos % _outChunk;
+
+        quint32 phase = (frac * RESAMPLER_PHASES) / _outChunk;
+        float mu = float(frac * RESAMPLER_PHASES - phase * _outChunk) / _outChunk;
+
+        const float* x = buff + index + 1;
+        const float* c1 = &_coeffs[phase * _taps];
+        const float* c2 = c1 + _taps;
+
+        float s1 = 0;
+        float s2 = 0;
+        for (quint32 i = 0; i < _taps; ++i)
+        {
+            s1 += x[i] * c1[i];
+            s2 += x[i] * c2[i];
+        }
+        out[k] = s1 + (s2 - s1) * mu;
+    }
+
+    memmove(buff, buff + _inChunk, _taps * sizeof(float));
+}
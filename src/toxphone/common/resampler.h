@@ -0,0 +1,48 @@
+#pragma once
+
+#include "shared/defmac.h"
+
+#include <QtCore>
+#include <vector>
+
+/**
+  Передискретизация сигнала (один канал) с использованием полифазного
+  фильтра на основе sinc-функции с окном Блэкмана. Сигнал обрабатывается
+  10-мс фрагментами, поэтому частоты дискретизации должны быть кратны 100.
+  Фильтр вносит задержку, равную половине длины фильтра (около 0.5 мс).
+  Класс не является потокобезопасным.
+*/
+class Resampler
+{
+public:
+    Resampler() = default;
+
+    // Возвращает FALSE, если частоты дискретизации не поддерживаются
+    bool init(quint32 inRate, quint32 outRate);
+
+    // Сброс истории сигнала
+    void reset();
+
+    // Количество входных/выходных сэмплов в 10-мс фрагменте
+    quint32 inChunk() const {return _inChunk;}
+    quint32 outChunk() const {return _outChunk;}
+
+    // Преобразование 10-мс фрагмента: in содержит inChunk() сэмплов,
+    // out должен вмещать outChunk() сэмплов
+    void process(const float* in, float* out);
+
+private:
+    DISABLE_DEFAULT_COPY(Resampler)
+
+private:
+    quint32 _inChunk = {0};
+    quint32 _outChunk = {0};
+    quint32 _taps = {0};
+
+    // Коэффициенты фильтра: (RESAMPLER_PHASES + 1) фаз по _taps значений
+    std::vector<float> _coeffs;
+
+    // Последние _taps входных сэмплов предыдущего фрагмента и текущий
+    // фрагмент
+    std::vector<float> _buff;
+};
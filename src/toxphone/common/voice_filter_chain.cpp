@@ -0,0 +1,104 @@
+#include "voice_filter_chain.h"
+
+#include <chrono>
+
+static inline quint64 nanoTimestamp()
+{
+    using namespace std::chrono;
+    return quint64(duration_cast<nanoseconds>(
+                   steady_clock::now().time_since_epoch()).count());
+}
+
+void VoiceFilterChain::Timing::add(quint64 time)
+{
+    if (frames == 0 || time < min)
+        min = time;
+    if (time > max)
+        max = time;
+    sum += time;
+    ++frames;
+}
+
+void VoiceFilterChain::Timing::fill(Stat& stat) const
+{
+    stat.frames = frames;
+    if (frames)
+    {
+        stat.min = quint32(min / 1000);
+        stat.avg = quint32(sum / frames / 1000);
+        stat.max = quint32(max / 1000);
+    }
+}
+
+void VoiceFilterChain::clear()
+{
+    for (int i = 0; i < VOICE_FILTER_CHAIN_MAX; ++i)
+    {
+        _stages[i] = nullptr;
+        _timing[i] = Timing();
+    }
+    _total = Timing();
+    _count = 0;
+}
+
+bool VoiceFilterChain::append(VoiceFilterStage* stage)
+{
+    if (stage == nullptr || _count >= VOICE_FILTER_CHAIN_MAX)
+        return false;
+
+    _stages[_count] = stage;
+    _timing[_count] = Timing();
+    ++_count;
+    return true;
+}
+
+bool VoiceFilterChain::contains(const VoiceFilterStage* stage) const
+{
+    for (int i = 0; i < _count; ++i)
+        if (_stages[i] == stage)
+            return true;
+
+    return false;
+}
+
+void VoiceFilterChain::process(VoiceFrame* frame)
+{
+    quint64 begin = nanoTimestamp();
+    quint64 time = begin;
+    for (int i = 0; i < _count; ++i)
+    {
+        _stages[i]->process(frame);
+
+        quint64 end = nanoTimestamp();
+        _timing[i].add(end - time);
+        time = end;
+    }
+    _total.add(time - begin);
+}
+
+QVector<VoiceFilterChain::Stat> VoiceFilterChain::stat(bool reset)
+{
+    QVector<Stat> result;
+    result.reserve(_count + 1);
+
+    for (int i = 0; i < _count; ++i)
+    {
+        Stat stat;
+        stat.name = _stages[i]->name();
+        _timing[i].fill(stat);
+        result.append(stat);
+
+        if (reset)
+            _timing[i] = Timing();
+    }
+
+    Stat stat;
+    stat.name = "total";
+    _total.fill(stat);
+    result.append(stat);
+
+    if (reset)
+        _total = Timing();
+
+    return result;
+}
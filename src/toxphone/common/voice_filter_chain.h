@@ -0,0 +1,90 @@
+#pragma once
+
+#include "voice_frame.h"
+#include "shared/defmac.h"
+
+#include <QtCore>
+
+// Максимальное количество ступеней в цепочке фильтров
+#define VOICE_FILTER_CHAIN_MAX 8
+
+/**
+  Ступень обработки записанного голосового сигнала. Обработка выполняется
+  на месте, в буфере фрейма, данные между ступенями не копируются.
+  Сигнал: один канал, int16_t, частота дискретизации передается в init().
+*/
+class VoiceFilterStage
+{
+public:
+    virtual ~VoiceFilterStage() = default;
+
+    // Наименование ступени, используется в конфигурации и в статистике
+    virtual const char* name() const = 0;
+
+    // Инициализация ступени. Возвращает FALSE, если ступень не может
+    // работать с заданными параметрами потока
+    virtual bool init(const VoiceFrameInfo&) = 0;
+
+    // Сброс состояния, вызывается при включении ступени в цепочку
+    virtual void reset() {}
+
+    // Обработка фрейма
+    virtual void process(VoiceFrame*) = 0;
+};
+
+/**
+  Упорядоченная цепочка ступеней обработки. Цепочка не владеет ступенями,
+  это позволяет перестраивать ее во время работы без пересоздания фильтров
+  и без остановки потока. Для каждой ступени собирается статистика времени
+  обработки одного фрейма.
+  Класс не является потокобезопасным.
+*/
+class VoiceFilterChain
+{
+public:
+    struct Stat
+    {
+        const char* name = {nullptr};
+        quint32 frames = {0}; // Количество обработанных фреймов
+        quint32 min = {0};    // Время обработки фрейма (в микросекундах)
+        quint32 avg = {0};
+        quint32 max = {0};
+    };
+
+    VoiceFilterChain() = default;
+
+    void clear();
+    bool append(VoiceFilterStage*);
+
+    int count() const {return _count;}
+    VoiceFilterStage* stage(int index) const {return _stages[index];}
+    bool contains(const VoiceFilterStage*) const;
+
+    // Последовательная обработка фрейма всеми ступенями цепочки
+    void process(VoiceFrame*);
+
+    // Статистика по ступеням и по цепочке в целом (последний элемент,
+    // наименование "total"). Если reset равен TRUE, то статистика
+    // сбрасывается
+    QVector<Stat> stat(bool reset);
+
+private:
+    DISABLE_DEFAULT_COPY(VoiceFilterChain)
+
+    struct Timing
+    {
+        quint32 frames = {0};
+        quint64 sum = {0};  // В наносекундах
+        quint64 min = {0};
+        quint64 max = {0};
+
+        void add(quint64 time);
+        void fill(Stat&) const;
+    };
+
+private:
+    VoiceFilterStage* _stages[VOICE_FILTER_CHAIN_MAX] = {0};
+    Timing _timing[VOICE_FILTER_CHAIN_MAX];
+    Timing _total;
+    int _count = {0};
+};
@@ -0,0 +1,598 @@
+#include "voice_filter_stages.h"
+#include "audio_kernels.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+
+#include <string.h>
+#include <math.h>
+
+extern "C" {
+#include "filter_audio.h"
+#include "rnnoise.h"
+}
+
+#define log_error_m   alog::logger().error  (alog_line_location, "VoiceFilter")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "VoiceFilter")
+#define log_info_m    alog::logger().info   (alog_line_location, "VoiceFilter")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "VoiceFilter")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "VoiceFilter")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "VoiceFilter")
+
+// Частота среза фильтра верхних частот (Гц)
+#define HIGHPASS_CUTOFF 100.0
+
+// Мощность опорного сигнала, начиная с которой учитывается ERLE
+#define ECHO_FAR_ACTIVE_POWER 10000.0
+
+// RNNoise обрабатывает 10-мс фрагменты сигнала с частотой 48 кГц
+#define RNNOISE_FRAME_SIZE    480
+#define RNNOISE_SAMPLING_RATE 48000
+
+// Порог вероятности речи, вычисленной RNNoise
+#define VAD_PROBABILITY 0.5f
+
+// Превышение энергии сигнала над уровнем шума для детектора речи (дБ).
+// При превышении меньше VAD_SNR_STRONG дополнительно проверяется частота
+// переходов через ноль: у шума она, как правило, выше, чем у речи
+#define VAD_SNR        9.f
+#define VAD_SNR_STRONG 15.f
+#define VAD_ZCR_MAX    0.3f
+
+// Минимальный уровень речевого сигнала (дБ относительно единицы int16)
+#define VAD_LEVEL_MIN  30.f
+
+// Порог ограничителя: -1 дБ от полной шкалы
+#define LIMITER_THRESHOLD 29204.f
+
+// Время восстановления усиления ограничителя (мс)
+#define LIMITER_RELEASE 50.f
+
+static double signalPower(const int16_t* pcm, quint32 count)
+{
+    if (count == 0)
+        return 0;
+
+    return double(audioKernels().sumSquares(pcm, count)) / count;
+}
+
+// Фильтры WebRtc и RNNoise обрабатывают сигнал 10-мс фрагментами, поэтому
+// длительность фрейма записи должна быть кратна 10 мс
+static bool checkChunkFraming(const char* stage, const VoiceFrameInfo& info,
+                              quint32 chunkSampleCount)
+{
+    if (chunkSampleCount && info.sampleCount
+        && (info.sampleCount % chunkSampleCount) == 0)
+        return true;
+
+    log_error_m << "Voice filter stage '" << stage << "' requires frame duration"
+                << " multiple of 10 ms. Record latency: " << info.latency << " us";
+    return false;
+}
+
+static inline quint32 frameSampleCount(const VoiceFrame* frame)
+{
+    return frame->dataSize / sizeof(int16_t);
+}
+
+//------------------------------ HighPassStage -------------------------------
+
+bool HighPassStage::init(const VoiceFrameInfo& info)
+{
+    if (info.samplingRate == 0)
+        return false;
+
+    // Коэффициенты по формулам RBJ Audio EQ Cookbook, Q = 1/sqrt(2)
+    double w0 = 2 * M_PI * HIGHPASS_CUTOFF / info.samplingRate;
+    double alpha = sin(w0) / (2 * M_SQRT1_2);
+    double cosw0 = cos(w0);
+    double a0 = 1 + alpha;
+
+    _b0 = float( (1 + cosw0) / 2 / a0);
+    _b1 = float(-(1 + cosw0) / a0);
+    _b2 = _b0;
+    _a1 = float(-2 * cosw0 / a0);
+    _a2 = float((1 - alpha) / a0);
+
+    reset();
+    return true;
+}
+
+void HighPassStage::reset()
+{
+    _x1 = _x2 = 0;
+    _y1 = _y2 = 0;
+}
+
+void HighPassStage::process(VoiceFrame* frame)
+{
+    int16_t* pcm = (int16_t*)frame->data;
+    quint32 count = frameSampleCount(frame);
+
+    for (quint32 i = 0; i < count; ++i)
+    {
+        float x = pcm[i];
+        float y = _b0 * x + _b1 * _x1 + _b2 * _x2 - _a1 * _y1 - _a2 * _y2;
+        _x2 = _x1; _x1 = x;
+        _y2 = _y1; _y1 = y;
+        pcm[i] = int16_t(qBound(-32768.f, y, 32767.f));
+    }
+}
+
+//----------------------------- EchoCancelStage ------------------------------
+
+EchoCancelStage::~EchoCancelStage()
+{
+    if (_filter)
+        kill_filter_audio(_filter);
+}
+
+bool EchoCancelStage::init(const VoiceFrameInfo& info)
+{
+    _samplingRate = info.samplingRate;
+    _chunkSampleCount = info.samplingRate / 100;
+    if (_chunkSampleCount == 0 || _chunkSampleCount > VOICE_CHUNK_MAX)
+    {
+        log_error_m << "Echo cancellation is not supported for sampling rate "
+                    << info.samplingRate;
+        return false;
+    }
+    if (!checkChunkFraming(name(), info, _chunkSampleCount))
+        return false;
+
+    // Для эхоподавления используется отдельный экземпляр фильтра, это
+    // позволяет оценивать ослабление эха без учета шумоподавления
+    _filter = new_filter_audio(info.samplingRate);
+    if (!_filter)
+    {
+        log_error_m << "Failed call new_filter_audio() for echo filter";
+        return false;
+    }
+    enable_disable_filters(_filter, 1, 0, 0, 0);
+
+    reset();
+    return true;
+}
+
+void EchoCancelStage::reset()
+{
+    _farResampler.reset();
+    _farInCount = 0;
+    _farChunkCount = 0;
+    _farActive = 0;
+    _delayEstimator.reset();
+    _delay = -1;
+    _delayEstimated = false;
+    _chunks = 0;
+    _powerIn = 0;
+    _powerOut = 0;
+    _statReady = false;
+    _erle = 0;
+}
+
+void EchoCancelStage::farEnd(const int16_t* pcm, quint32 count, quint32 samplingRate)
+{
+    if (samplingRate == _samplingRate)
+    {
+        farChunk(pcm, count);
+        return;
+    }
+
+    if (samplingRate != _farRate)
+    {
+        _farRate = samplingRate;
+        _farInCount = 0;
+        _farRateError = !(samplingRate / 100 <= VOICE_CHUNK_MAX
+                          && _farResampler.init(samplingRate, _samplingRate));
+        if (_farRateError)
+            log_error_m << "Echo cancellation is inactive: failed resample"
+                        << " far-end signal from " << samplingRate
+                        << " Hz to " << _samplingRate << " Hz";
+    }
+    if (_farRateError)
+        return;
+
+    const AudioKernels& kernels = audioKernels();
+    const quint32 inChunk = _farResampler.inChunk();
+    while (count)
+    {
+        quint32 n = qMin(count, inChunk - _farInCount);
+        kernels.s16ToFloat(pcm, _farIn + _farInCount, n);
+        _farInCount += n;
+        pcm += n;
+        count -= n;
+
+        if (_farInCount == inChunk)
+        {
+            float out[VOICE_CHUNK_MAX];
+            int16_t chunk[VOICE_CHUNK_MAX];
+            _farResampler.process(_farIn, out);
+            kernels.floatToS16(out, chunk, _chunkSampleCount);
+            farChunk(chunk, _chunkSampleCount);
+            _farInCount = 0;
+        }
+    }
+}
+
+void EchoCancelStage::farChunk(const int16_t* pcm, quint32 count)
+{
+    while (count)
+    {
+        quint32 n = qMin(count, _chunkSampleCount - _farChunkCount);
+        memcpy(_farChunk + _farChunkCount, pcm, n * sizeof(int16_t));
+        _farChunkCount += n;
+        pcm += n;
+        count -= n;
+
+        if (_farChunkCount == _chunkSampleCount)
+        {
+            if (pass_audio_output(_filter, _farChunk, _chunkSampleCount) < 0)
+                log_error_m << "Failed call pass_audio_output() for echo filter";
+
+            _delayEstimator.farEnd(_farChunk, _chunkSampleCount);
+            if (signalPower(_farChunk, _chunkSampleCount) > ECHO_FAR_ACTIVE_POWER)
+                _farActive = ECHO_MAX_LAG;
+            _farChunkCount = 0;
+        }
+    }
+}
+
+void EchoCancelStage::setLatency(quint32 playback, quint32 record)
+{
+    _playbackLatency = playback;
+    _recordLatency = record;
+}
+
+bool EchoCancelStage::takeStat(quint32& delay, bool& delayEstimated, qint32& erle)
+{
+    if (!_statReady)
+        return false;
+
+    delay = quint32(_delay);
+    delayEstimated = _delayEstimated;
+    erle = _erle;
+    _statReady = false;
+    return true;
+}
+
+void EchoCancelStage::process(VoiceFrame* frame)
+{
+    int16_t* pcm = (int16_t*)frame->data;
+    quint32 sampleCount = frameSampleCount(frame);
+
+    for (quint32 i = 0; i + _chunkSampleCount <= sampleCount; i += _chunkSampleCount)
+    {
+        _delayEstimator.nearEnd(pcm + i, _chunkSampleCount);
+
+        double powerIn = signalPower(pcm + i, _chunkSampleCount);
+        if (filter_audio(_filter, pcm + i, _chunkSampleCount) < 0)
+        {
+            log_error_m << "Failed call filter_audio() for echo filter";
+            break;
+        }
+
+        // ERLE учитывается только при наличии опорного сигнала
+        if (_farActive)
+        {
+            --_farActive;
+            _powerIn  += powerIn;
+            _powerOut += signalPower(pcm + i, _chunkSampleCount);
+        }
+
+        // Раз в секунду уточняется задержка эха. Если корреляция
+        // сигналов недостаточна, то используется сумма задержек
+        // потоков воспроизведения и записи.
+        if (++_chunks >= 100 || _delay < 0)
+        {
+            int delay;
+            _delayEstimated = _delayEstimator.estimate();
+            if (_delayEstimated)
+                delay = _delayEstimator.delay();
+            else
+                delay = int(_playbackLatency + _recordLatency) / 1000;
+
+            if (_delay < 0 || qAbs(delay - _delay) >= 10)
+            {
+                _delay = delay;
+                set_echo_delay_ms(_filter, int16_t(_delay));
+                log_debug_m << "Echo delay: " << _delay << " ms"
+                            << (_delayEstimated ? " (estimated)" : "");
+            }
+
+            _erle = 0;
+            if (_powerIn > 0 && _powerOut > 0)
+                _erle = qint32(100 * log10(_powerIn / _powerOut));
+            _statReady = true;
+
+            _chunks = 0;
+            _powerIn = 0;
+            _powerOut = 0;
+        }
+    }
+}
+
+//----------------------------- WebRtcNoiseStage -----------------------------
+
+WebRtcNoiseStage::~WebRtcNoiseStage()
+{
+    if (_filter)
+        kill_filter_audio(_filter);
+}
+
+bool WebRtcNoiseStage::init(const VoiceFrameInfo& info)
+{
+    _chunkSampleCount = info.samplingRate / 100;
+    if (!checkChunkFraming(name(), info, _chunkSampleCount))
+        return false;
+
+    _filter = new_filter_audio(info.samplingRate);
+    if (!_filter)
+    {
+        log_error_m << "Failed call new_filter_audio() for noise filter";
+        return false;
+    }
+    enable_disable_filters(_filter, 0, 1, 0, 0);
+    return true;
+}
+
+void WebRtcNoiseStage::process(VoiceFrame* frame)
+{
+    int16_t* pcm = (int16_t*)frame->data;
+    quint32 sampleCount = frameSampleCount(frame);
+
+    for (quint32 i = 0; i + _chunkSampleCount <= sampleCount; i += _chunkSampleCount)
+        if (filter_audio(_filter, pcm + i, _chunkSampleCount) < 0)
+        {
+            log_error_m << "Failed call filter_audio() for noise filter";
+            break;
+        }
+}
+
+//------------------------------- RNNoiseStage -------------------------------
+
+RNNoiseStage::~RNNoiseStage()
+{
+    if (_filter)
+        rnnoise_destroy(_filter);
+}
+
+bool RNNoiseStage::init(const VoiceFrameInfo& info)
+{
+    _chunkSampleCount = info.samplingRate / 100;
+    if (!checkChunkFraming(name(), info, _chunkSampleCount))
+        return false;
+
+    // Если частота записи отличается от 48 кГц, то для RNNoise сигнал
+    // передискретизируется
+    _resample = (info.samplingRate != RNNOISE_SAMPLING_RATE);
+    if (_resample)
+    {
+        if (_chunkSampleCount > RNNOISE_FRAME_SIZE
+            || !_upsampler.init(info.samplingRate, RNNOISE_SAMPLING_RATE)
+            || !_downsampler.init(RNNOISE_SAMPLING_RATE, info.samplingRate))
+        {
+            log_error_m << "RNNoise is not supported for sampling rate "
+                        << info.samplingRate;
+            return false;
+        }
+    }
+
+    _filter = rnnoise_create(0);
+    if (!_filter)
+    {
+        log_error_m << "Failed call rnnoise_create()";
+        return false;
+    }
+    return true;
+}
+
+void RNNoiseStage::reset()
+{
+    _upsampler.reset();
+    _downsampler.reset();
+    _voiceProbability = 0;
+    _frameTimestamp = -1;
+}
+
+bool RNNoiseStage::voiceProbability(const VoiceFrame* frame, float& probability) const
+{
+    if (frame->timestamp != _frameTimestamp)
+        return false;
+
+    probability = _voiceProbability;
+    return true;
+}
+
+void RNNoiseStage::process(VoiceFrame* frame)
+{
+    int16_t* pcm = (int16_t*)frame->data;
+    quint32 sampleCount = frameSampleCount(frame);
+
+    // Фрейм (20/40 мс) обрабатывается целиком за одно пробуждение потока,
+    // как последовательность 10-мс фрагментов
+    const AudioKernels& kernels = audioKernels();
+    float chunk[RNNOISE_FRAME_SIZE];
+    float channel[RNNOISE_FRAME_SIZE];
+    float probability = 0;
+    for (quint32 i = 0; i + _chunkSampleCount <= sampleCount; i += _chunkSampleCount)
+    {
+        float p;
+        if (_resample)
+        {
+            kernels.s16ToFloat(pcm + i, chunk, _chunkSampleCount);
+            _upsampler.process(chunk, channel);
+            p = rnnoise_process_frame(_filter, channel, channel);
+            _downsampler.process(channel, chunk);
+            kernels.floatToS16(chunk, pcm + i, _chunkSampleCount);
+        }
+        else
+        {
+            kernels.s16ToFloat(pcm + i, channel, RNNOISE_FRAME_SIZE);
+            p = rnnoise_process_frame(_filter, channel, channel);
+            kernels.floatToS16(channel, pcm + i, RNNOISE_FRAME_SIZE);
+        }
+        probability = qMax(probability, p);
+    }
+    _voiceProbability = probability;
+    _frameTimestamp = frame->timestamp;
+}
+
+//--------------------------------- VadStage ---------------------------------
+
+bool VadStage::init(const VoiceFrameInfo& info)
+{
+    _samplingRate = info.samplingRate;
+
+    // Детектор по энергии сигнала работает с фрагментами любой длины,
+    // фреймы короче 10 мс анализируются целиком
+    _chunkSampleCount = info.samplingRate / 100;
+    if (info.sampleCount && info.sampleCount < _chunkSampleCount)
+        _chunkSampleCount = info.sampleCount;
+    if (_chunkSampleCount == 0)
+        return false;
+
+    reset();
+    return true;
+}
+
+void VadStage::reset()
+{
+    _hangoverRemain = 0;
+    _noiseLevel = -1;
+}
+
+void VadStage::process(VoiceFrame* frame)
+{
+    const int16_t* pcm = (const int16_t*)frame->data;
+    quint32 sampleCount = frameSampleCount(frame);
+
+    bool speech = false;
+    float probability;
+    if (_rnnoise && _rnnoise->voiceProbability(frame, probability))
+    {
+        speech = (probability >= VAD_PROBABILITY);
+    }
+    else
+    {
+        // Уровень шума должен обновляться по всем фрагментам фрейма
+        for (quint32 i = 0; i + _chunkSampleCount <= sampleCount; i += _chunkSampleCount)
+            if (detect(pcm + i, _chunkSampleCount))
+                speech = true;
+    }
+
+    quint32 duration = sampleCount * 1000 / _samplingRate;
+    if (speech)
+    {
+        _hangoverRemain = _hangover;
+    }
+    else if (_hangoverRemain)
+    {
+        _hangoverRemain -= qMin(_hangoverRemain, duration);
+        speech = true;
+    }
+    frame->speech = speech;
+}
+
+bool VadStage::detect(const int16_t* pcm, quint32 count)
+{
+    float power = float(audioKernels().sumSquares(pcm, count)) / count;
+    float level = 10 * log10f(power + 1);
+
+    quint32 crossings = 0;
+    for (quint32 i = 1; i < count; ++i)
+        if ((pcm[i - 1] < 0) != (pcm[i] < 0))
+            ++crossings;
+    float zcr = float(crossings) / count;
+
+    // Уровень шума быстро снижается и медленно (около 5 дБ/с) растет,
+    // поэтому во время речи он остается близким к уровню пауз
+    if (_noiseLevel < 0 || level < _noiseLevel)
+        _noiseLevel = (_noiseLevel < 0) ? level : (_noiseLevel + level) / 2;
+    else
+        _noiseLevel += 5.f * count / _samplingRate;
+
+    float snr = level - _noiseLevel;
+    if (level < VAD_LEVEL_MIN || snr < VAD_SNR)
+        return false;
+
+    return (snr >= VAD_SNR_STRONG || zcr <= VAD_ZCR_MAX);
+}
+
+//--------------------------------- AgcStage ---------------------------------
+
+AgcStage::~AgcStage()
+{
+    if (_filter)
+        kill_filter_audio(_filter);
+}
+
+bool AgcStage::init(const VoiceFrameInfo& info)
+{
+    _chunkSampleCount = info.samplingRate / 100;
+    if (!checkChunkFraming(name(), info, _chunkSampleCount))
+        return false;
+
+    _filter = new_filter_audio(info.samplingRate);
+    if (!_filter)
+    {
+        log_error_m << "Failed call new_filter_audio() for AGC filter";
+        return false;
+    }
+    enable_disable_filters(_filter, 0, 0, 1, 0);
+    return true;
+}
+
+void AgcStage::process(VoiceFrame* frame)
+{
+    int16_t* pcm = (int16_t*)frame->data;
+    quint32 sampleCount = frameSampleCount(frame);
+
+    for (quint32 i = 0; i + _chunkSampleCount <= sampleCount; i += _chunkSampleCount)
+        if (filter_audio(_filter, pcm + i, _chunkSampleCount) < 0)
+        {
+            log_error_m << "Failed call filter_audio() for AGC filter";
+            break;
+        }
+}
+
+//------------------------------- LimiterStage -------------------------------
+
+bool LimiterStage::init(const VoiceFrameInfo& info)
+{
+    if (info.samplingRate == 0)
+        return false;
+
+    // Коэффициент экспоненциального восстановления усиления
+    _release = 1.f - expf(-1000.f / (LIMITER_RELEASE * info.samplingRate));
+    reset();
+    return true;
+}
+
+void LimiterStage::reset()
+{
+    _gain = 1.f;
+}
+
+void LimiterStage::process(VoiceFrame* frame)
+{
+    int16_t* pcm = (int16_t*)frame->data;
+    quint32 count = frameSampleCount(frame);
+
+    // Если усиление не снижено и пик ниже порога, то обработка не требуется
+    if (_gain >= 1.f && audioKernels().peak(pcm, count) <= quint32(LIMITER_THRESHOLD))
+        return;
+
+    for (quint32 i = 0; i < count; ++i)
+    {
+        float x = pcm[i];
+        float a = fabsf(x);
+        if (a * _gain > LIMITER_THRESHOLD)
+            _gain = LIMITER_THRESHOLD / a;
+        else
+            _gain += (1.f - _gain) * _release;
+
+        pcm[i] = int16_t(x * _gain);
+    }
+    if (_gain > 0.9999f)
+        _gain = 1.f;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "voice_filter_chain.h"
+#include "echo_delay_estimator.h"
+#include "resampler.h"
+
+#include <QtCore>
+
+struct Filter_Audio;
+struct DenoiseState;
+
+// Максимальный размер 10-мс фрагмента (48 кГц)
+#define VOICE_CHUNK_MAX 480
+
+/**
+  Фильтр верхних частот (биквадратный фильтр Баттерворта 2-го порядка),
+  подавляет постоянную составляющую и низкочастотный шум
+*/
+class HighPassStage : public VoiceFilterStage
+{
+public:
+    const char* name() const override {return "highpass";}
+    bool init(const VoiceFrameInfo&) override;
+    void reset() override;
+    void process(VoiceFrame*) override;
+
+private:
+    float _b0 = {0}, _b1 = {0}, _b2 = {0};
+    float _a1 = {0}, _a2 = {0};
+    float _x1 = {0}, _x2 = {0};
+    float _y1 = {0}, _y2 = {0};
+};
+
+/**
+  Эхоподавление (WebRtc AECM из библиотеки filter_audio). Опорный сигнал
+  передается через функцию farEnd() перед обработкой записанных фреймов.
+  Если частота опорного сигнала (toxav декодирует голос с частотой 48 кГц)
+  отличается от частоты записи, то опорный сигнал передискретизируется.
+  Задержка эха уточняется раз в секунду по корреляции сигналов, если
+  корреляция недостаточна, то используется сумма задержек аудио-потоков.
+*/
+class EchoCancelStage : public VoiceFilterStage
+{
+public:
+    ~EchoCancelStage();
+
+    const char* name() const override {return "echo";}
+    bool init(const VoiceFrameInfo&) override;
+    void reset() override;
+    void process(VoiceFrame*) override;
+
+    // Передача опорного (воспроизводимого) сигнала, samplingRate - частота
+    // дискретизации опорного сигнала
+    void farEnd(const int16_t* pcm, quint32 count, quint32 samplingRate);
+
+    // Задержки потоков воспроизведения и записи (в микросекундах)
+    void setLatency(quint32 playback, quint32 record);
+
+    // Возвращает TRUE раз в секунду, когда доступна новая статистика:
+    // задержка эха (в мс) и ослабление эха ERLE (в десятых долях дБ)
+    bool takeStat(quint32& delay, bool& delayEstimated, qint32& erle);
+
+private:
+    // Передача 10-мс фрагмента опорного сигнала с частотой записи
+    void farChunk(const int16_t* pcm, quint32 count);
+
+private:
+    Filter_Audio* _filter = {nullptr};
+    quint32 _samplingRate = {0};
+    quint32 _chunkSampleCount = {0};
+
+    // Передискретизация опорного сигнала
+    Resampler _farResampler;
+    quint32 _farRate = {0};
+    bool    _farRateError = {false};
+    float   _farIn[VOICE_CHUNK_MAX];
+    quint32 _farInCount = {0};
+
+    int16_t _farChunk[VOICE_CHUNK_MAX];
+    quint32 _farChunkCount = {0};
+    quint32 _farActive = {0};
+
+    quint32 _playbackLatency = {0};
+    quint32 _recordLatency = {0};
+
+    EchoDelayEstimator _delayEstimator;
+    int     _delay = {-1};
+    bool    _delayEstimated = {false};
+    quint32 _chunks = {0};
+    double  _powerIn = {0};
+    double  _powerOut = {0};
+
+    bool    _statReady = {false};
+    qint32  _erle = {0};
+};
+
+/**
+  Шумоподавление WebRtc (библиотека filter_audio)
+*/
+class WebRtcNoiseStage : public VoiceFilterStage
+{
+public:
+    ~WebRtcNoiseStage();
+
+    const char* name() const override {return "webrtc_noise";}
+    bool init(const VoiceFrameInfo&) override;
+    void process(VoiceFrame*) override;
+
+private:
+    Filter_Audio* _filter = {nullptr};
+    quint32 _chunkSampleCount = {0};
+};
+
+/**
+  Шумоподавление RNNoise. Фрейм (20/40 мс) обрабатывается целиком, как
+  последовательность 10-мс фрагментов. Если частота записи отличается
+  от 48 кГц, то сигнал передискретизируется.
+*/
+class RNNoiseStage : public VoiceFilterStage
+{
+public:
+    ~RNNoiseStage();
+
+    const char* name() const override {return "rnnoise";}
+    bool init(const VoiceFrameInfo&) override;
+    void reset() override;
+    void process(VoiceFrame*) override;
+
+    // Вероятность наличия речи во фрейме (максимальная по 10-мс фрагментам),
+    // полученная от RNNoise. Возвращает FALSE, если фрейм не обрабатывался
+    // этой ступенью
+    bool voiceProbability(const VoiceFrame*, float& probability) const;
+
+private:
+    DenoiseState* _filter = {nullptr};
+    quint32 _chunkSampleCount = {0};
+
+    float  _voiceProbability = {0};
+    qint64 _frameTimestamp = {-1};
+
+    bool _resample = {false};
+    Resampler _upsampler;
+    Resampler _downsampler;
+};
+
+/**
+  Детектор речевой активности (VAD). Если в цепочке перед детектором
+  находится RNNoise, то используется вычисленная им вероятность речи, иначе
+  используется детектор по энергии сигнала относительно уровня шума и по
+  частоте переходов через ноль. После окончания речи фреймы еще некоторое
+  время (hangover) считаются речевыми, чтобы не обрезать окончания слов.
+  Результат сохраняется в поле VoiceFrame::speech.
+*/
+class VadStage : public VoiceFilterStage
+{
+public:
+    const char* name() const override {return "vad";}
+    bool init(const VoiceFrameInfo&) override;
+    void reset() override;
+    void process(VoiceFrame*) override;
+
+    // Источник вероятности речи, может быть nullptr
+    void setRNNoise(const RNNoiseStage* rnnoise) {_rnnoise = rnnoise;}
+
+    // Время удержания признака речи (в миллисекундах)
+    void setHangover(quint32 hangover) {_hangover = hangover;}
+
+private:
+    bool detect(const int16_t* pcm, quint32 count);
+
+private:
+    const RNNoiseStage* _rnnoise = {nullptr};
+    quint32 _samplingRate = {0};
+    quint32 _chunkSampleCount = {0};
+
+    quint32 _hangover = {300};
+    quint32 _hangoverRemain = {0};
+
+    float _noiseLevel = {-1}; // Уровень шума (в дБ), -1 - не определен
+};
+
+/**
+  Автоматическая регулировка усиления (WebRtc AGC из библиотеки filter_audio)
+*/
+class AgcStage : public VoiceFilterStage
+{
+public:
+    ~AgcStage();
+
+    const char* name() const override {return "agc";}
+    bool init(const VoiceFrameInfo&) override;
+    void process(VoiceFrame*) override;
+
+private:
+    Filter_Audio* _filter = {nullptr};
+    quint32 _chunkSampleCount = {0};
+};
+
+/**
+  Ограничитель пикового уровня: мгновенная атака и плавное (50 мс)
+  восстановление усиления. Исключает перегрузку кодека после усиления
+*/
+class LimiterStage : public VoiceFilterStage
+{
+public:
+    const char* name() const override {return "limiter";}
+    bool init(const VoiceFrameInfo&) override;
+    void reset() override;
+    void process(VoiceFrame*) override;
+
+private:
+    float _gain = {1.f};
+    float _release = {0};
+};
@@ -1,6 +1,12 @@
 #include "voice_filters.h"
 #include "voice_frame.h"
+#include "voice_latency.h"
+#include "realtime.h"
+#include "power_policy.h"
+#include "audio_kernels.h"
+#include "voice_filter_stages.h"
 #include "toxphone_appl.h"
+#include "tox/voice_sender.h"
 #include "common/functions.h"
 
 #include "shared/logger/logger.h"
@@ -11,15 +17,12 @@
 #include "pproto/commands/pool.h"
 #include "pproto/transport/tcp.h"
 
+#include <algorithm>
 #include <string>
+#include <string.h>
 
 using namespace std;
 
-extern "C" {
-#include "filter_audio.h"
-#include "rnnoise.h"
-}
-
 #define log_error_m   alog::logger().error  (alog_line_location, "VoiceFilter")
 #define log_warn_m    alog::logger().warn   (alog_line_location, "VoiceFilter")
 #define log_info_m    alog::logger().info   (alog_line_location, "VoiceFilter")
@@ -27,8 +30,6 @@ extern "C" {
 #define log_debug_m   alog::logger().debug  (alog_line_location, "VoiceFilter")
 #define log_debug2_m  alog::logger().debug2 (alog_line_location, "VoiceFilter")
 
-#define RNNOISE_FRAME_SIZE 480
-
 VoiceFilters& voiceFilters()
 {
     return safe::singleton<VoiceFilters, 0>();
@@ -44,6 +45,8 @@ VoiceFilters::VoiceFilters()
 
     FUNC_REGISTRATION(IncomingConfigConnection)
     FUNC_REGISTRATION(AudioNoise)
+    FUNC_REGISTRATION(AudioEchoCancel)
+    FUNC_REGISTRATION(VoiceFilterChain)
 
     #undef FUNC_REGISTRATION
 }
@@ -68,9 +71,49 @@ void VoiceFilters::sendRecordLevet(quint32 maxLevel, quint32 time)
     }
 }
 
+void VoiceFilters::farEnd(const int16_t* pcm, quint32 sampleCount, quint8 channels,
+                          quint32 samplingRate, quint32 latency)
+{
+    if (!_echoCancel || channels == 0)
+        return;
+
+    _farEndRate = samplingRate;
+    _playbackLatency = latency;
+
+    const quint32 frameSamples = VOICE_FRAME_MAX_SIZE / sizeof(int16_t);
+    while (sampleCount)
+    {
+        // Если пул пуст, то поток фильтров не успевает забирать данные,
+        // опорный сигнал отбрасывается
+        VoiceFrame* frame = echoFramePool().acquire();
+        if (frame == nullptr)
+            return;
+
+        quint32 count = qMin(sampleCount, frameSamples);
+        int16_t* data = (int16_t*)frame->data;
+        if (channels == 2)
+        {
+            for (quint32 i = 0; i < count; ++i)
+                data[i] = int16_t((int(pcm[2 * i]) + int(pcm[2 * i + 1])) / 2);
+        }
+        else
+        {
+            for (quint32 i = 0; i < count; ++i)
+                data[i] = pcm[i * channels];
+        }
+        frame->dataSize = count * sizeof(int16_t);
+        frame->timestamp = voiceTimestamp();
+        echoQueue().push(frame);
+
+        pcm += count * channels;
+        sampleCount -= count;
+    }
+}
+
 void VoiceFilters::run()
 {
     log_info_m << "Started";
+    realtimeSetupThread("voice_filters");
 
     VoiceFrameInfo::Ptr recordFrameInfo = getRecordFrameInfo();
     if (recordFrameInfo.empty())
@@ -80,19 +123,42 @@ void VoiceFilters::run()
         return;
     }
 
-    Filter_Audio* webrtcFilter = new_filter_audio(recordFrameInfo->samplingRate);
-    if (!webrtcFilter)
+    // Ступени обработки создаются один раз, при изменении настроек из них
+    // перестраивается цепочка фильтров
+    HighPassStage    highPassStage;
+    EchoCancelStage  echoCancelStage;
+    WebRtcNoiseStage webrtcNoiseStage;
+    RNNoiseStage     rnnoiseStage;
+    VadStage         vadStage;
+    AgcStage         agcStage;
+    LimiterStage     limiterStage;
+
+    VoiceFilterStage* stages[] = {&highPassStage, &echoCancelStage, &webrtcNoiseStage,
+                                  &rnnoiseStage, &vadStage, &agcStage, &limiterStage};
+
+    int vadHangover = 300;
+    config::base().getValue("audio.vad.hangover", vadHangover);
+    vadStage.setHangover(quint32(qMax(vadHangover, 0)));
+    QVector<VoiceFilterStage*> validStages;
+    for (VoiceFilterStage* stage : stages)
     {
-        log_error_m << "Failed call new_filter_audio() for noise filter";
-        Application::stop(1);
-        return;
+        if (stage->init(*recordFrameInfo))
+            validStages.append(stage);
+        else
+            log_error_m << "Voice filter stage '" << stage->name()
+                        << "' is not available";
     }
-    enable_disable_filters(webrtcFilter, 0, 1, 0, 0);
 
-    DenoiseState* rnnoiseFilter = rnnoise_create(0);
-    data::AudioNoise::FilterType filterType = data::AudioNoise::FilterType::WebRtc;
-    quint32 recordDataSize = 0;
-    char recordDataBuff[4000];
+    // Опорный сигнал, накопленный пока запись была остановлена, не актуален
+    while (VoiceFrame* frame = echoQueue().pop())
+        echoFramePool().release(frame);
+
+    VoiceFilterChain filterChain;
+    steady_timer filterStatTimer;
+
+    ThreadLoad threadLoad;
+    steady_timer threadLoadTimer;
+    threadLoad.measure();
 
     _filterChanged = true;
 
@@ -103,93 +169,55 @@ void VoiceFilters::run()
 
         if (_filterChanged)
         {
-            filterType = rereadFilterType();
-            if (filterType == data::AudioNoise::FilterType::WebRtc)
-            {
-                log_verbose_m << "Using WebRtc noise suppression";
-                switch (recordFrameInfo->latency)
-                {
-                    case 40000:
-                        recordDataSize = recordFrameInfo->bufferSize / 4;
-                        break;
-
-                    case 20000:
-                        recordDataSize = recordFrameInfo->bufferSize / 2;
-                        break;
-
-                    case 10000:
-                        recordDataSize = recordFrameInfo->bufferSize;
-                        break;
-
-                    case 5000:
-                        recordDataSize = recordFrameInfo->bufferSize * 2;
-                        break;
+            _filterChanged = false;
+            rebuildFilterChain(filterChain, validStages);
+            _echoCancel = filterChain.contains(&echoCancelStage);
 
-                    default:
-                        recordDataSize = recordFrameInfo->bufferSize;
-                }
-            }
-            else if (filterType == data::AudioNoise::FilterType::RNNoise)
-            {
-                log_verbose_m << "Using RNNoise noise suppression";
-                recordDataSize = RNNOISE_FRAME_SIZE * recordFrameInfo->sampleSize;
-            }
-            else
+            // Детектор речи использует вероятность от RNNoise, только если
+            // шумоподавление RNNoise выполняется перед ним
+            vadStage.setRNNoise(nullptr);
+            for (int i = 0; i < filterChain.count(); ++i)
             {
-                log_verbose_m << "Not used noise suppression";
-                recordDataSize = recordFrameInfo->bufferSize;
+                if (filterChain.stage(i) == &vadStage)
+                    break;
+                if (filterChain.stage(i) == &rnnoiseStage)
+                    vadStage.setRNNoise(&rnnoiseStage);
             }
-            _filterChanged = false;
+            filterStatTimer.reset();
         }
 
-        if (recordRBuff_1().read(recordDataBuff, recordDataSize))
+        // Опорный сигнал передается эхоподавителю перед обработкой
+        // записанных данных
+        while (VoiceFrame* frame = echoQueue().pop())
         {
-            int16_t* pcm = (int16_t*)recordDataBuff;
-            if (filterType == data::AudioNoise::FilterType::WebRtc)
-            {
-                if (filter_audio(webrtcFilter, pcm, recordDataSize / sizeof(int16_t)) < 0)
-                    log_error_m << "Failed call filter_audio() for noise filter";
-            }
-            else if (filterType == data::AudioNoise::FilterType::RNNoise)
-            {
-                float channel[RNNOISE_FRAME_SIZE];
-
-                float* c = channel;
-                int16_t* p = pcm;
-                for (int i = 0; i < RNNOISE_FRAME_SIZE; ++i)
-                    *c++ = *p++;
-
-                rnnoise_process_frame(rnnoiseFilter, channel, channel);
-
-                c = channel;
-                p = pcm;
-                for (int i = 0; i < RNNOISE_FRAME_SIZE; ++i)
-                    *p++ = *c++;
-            }
+            if (_echoCancel)
+                echoCancelStage.farEnd((const int16_t*)frame->data,
+                                       frame->dataSize / sizeof(int16_t),
+                                       _farEndRate);
+            echoFramePool().release(frame);
+        }
+        echoCancelStage.setLatency(_playbackLatency, _recordLatency);
 
-            /*** Отладка эхоподавления ***/
-            //secondVoiceRB().write((char*)data, recordDataSize);
-            /***/
+        while (VoiceFrame* frame = recordQueue_1().pop())
+        {
+            frame->filterIn = voiceTimestamp();
+            filterChain.process(frame);
 
-            if (!recordRBuff_2().write((char*)recordDataBuff, recordDataSize))
-            {
-                log_error_m << "Failed write data to recordRBuff_2"
-                            << ". Data size: " << recordDataSize;
-            }
+            quint32 echoDelay; bool echoDelayEstimated; qint32 erle;
+            if (echoCancelStage.takeStat(echoDelay, echoDelayEstimated, erle))
+                sendEchoStat(echoDelay, echoDelayEstimated, erle);
 
             // Уровень сигнала для микрофона отправляем именно из этой точки,
             // т.к. это позволит учитывать уровень усиления сигнала полученный
-            // в функции filter_audio() при активном флаге gain.
+            // в цепочке фильтров.
+            // Уровень вычисляется до передачи фрейма в recordQueue_2(), так
+            // как после передачи фрейм принадлежит потоку VoiceSender.
             if (toxConfig().isActive())
             {
-                pcm = (int16_t*)recordDataBuff;
-                for (size_t i = 0; i < (recordDataSize / sizeof(int16_t)); ++i)
-                {
-                    if (*pcm > 0)
-                        if (_recordLevetMax < quint32(*pcm))
-                            _recordLevetMax = *pcm;
-                    ++pcm;
-                }
+                quint32 sampleCount = frame->dataSize / sizeof(int16_t);
+                quint32 peak = audioKernels().peak((const int16_t*)frame->data, sampleCount);
+                if (_recordLevetMax < peak)
+                    _recordLevetMax = peak;
                 if (_recordLevetTimer.elapsed() > 200)
                 {
                     sendRecordLevet(_recordLevetMax, 200);
@@ -197,17 +225,46 @@ void VoiceFilters::run()
                     _recordLevetTimer.reset();
                 }
             }
+
+            frame->filterOut = voiceTimestamp();
+            if (frame->dataSize)
+            {
+                voiceLatency().add(VoiceLatency::CaptureToFilter,
+                                   frame->filterIn - frame->timestamp);
+                voiceLatency().add(VoiceLatency::Filter,
+                                   frame->filterOut - frame->filterIn);
+            }
+
+            if (!recordQueue_2().push(frame))
+            {
+                // Не должно происходить: емкость очереди не меньше размера пула
+                log_error_m << "Failed push frame to recordQueue_2"
+                            << ". Data size: " << frame->dataSize;
+            }
+
+            // Обработанный фрейм передается на отправку без ожидания
+            voiceSender().wake();
         }
 
-        if (!threadStop()
-            && recordRBuff_1().available() < recordDataSize)
+        if (filterStatTimer.elapsed() > 1000)
         {
-            QMutexLocker locker(&_threadLock); (void) locker;
-            _threadCond.wait(&_threadLock, 10);
+            sendFilterStat(filterChain.stat(true));
+            filterStatTimer.reset();
         }
+
+        if (threadLoadTimer.elapsed() > 1000)
+        {
+            powerPolicy().setAudioLoad(PowerPolicy::FiltersThread, threadLoad.measure());
+            threadLoadTimer.reset();
+        }
+
+        // Поток пробуждается функцией wake() при поступлении записанного
+        // фрейма или при изменении настроек фильтров. Ожидание ограничено
+        // по времени только для проверки признака остановки потока
+        QMutexLocker locker(&_threadLock); (void) locker;
+        if (!threadStop() && !_filterChanged && recordQueue_1().empty())
+            _threadCond.wait(&_threadLock, 100);
     }
-    kill_filter_audio(webrtcFilter);
-    rnnoise_destroy(rnnoiseFilter);
 
     _recordLevetMax = 0;
     sendRecordLevet(_recordLevetMax, 200);
@@ -215,6 +272,78 @@ void VoiceFilters::run()
     log_info_m << "Stopped";
 }
 
+void VoiceFilters::rebuildFilterChain(VoiceFilterChain& filterChain,
+                                      const QVector<VoiceFilterStage*>& validStages)
+{
+    auto findStage = [&validStages](const char* name) -> VoiceFilterStage*
+    {
+        for (VoiceFilterStage* stage : validStages)
+            if (strcmp(stage->name(), name) == 0)
+                return stage;
+        return nullptr;
+    };
+
+    data::AudioNoise::FilterType filterType = rereadFilterType();
+    bool echoCancel = rereadEchoCancel();
+
+    // Ступени, не входившие в предыдущую цепочку, сбрасываются
+    VoiceFilterStage* prevStages[VOICE_FILTER_CHAIN_MAX] = {0};
+    int prevCount = filterChain.count();
+    for (int i = 0; i < prevCount; ++i)
+        prevStages[i] = filterChain.stage(i);
+
+    filterChain.clear();
+    QString chainNames;
+
+    for (const QString& name : rereadFilterChain())
+    {
+        VoiceFilterStage* stage = nullptr;
+        if (name == "noise")
+        {
+            // Шумоподавление выбирается командой AudioNoise
+            if (filterType == data::AudioNoise::FilterType::RNNoise)
+            {
+                stage = findStage("rnnoise");
+                if (stage == nullptr)
+                    log_error_m << "RNNoise is not available, will be used WebRtc"
+                                   " noise suppression";
+            }
+            if (stage == nullptr && filterType != data::AudioNoise::FilterType::None)
+                stage = findStage("webrtc_noise");
+        }
+        else if (name == "echo")
+        {
+            // Эхоподавление включается командой AudioEchoCancel
+            if (echoCancel)
+                stage = findStage("echo");
+        }
+        else
+        {
+            stage = findStage(name.toUtf8().constData());
+            if (stage == nullptr)
+                log_warn_m << "Voice filter stage '" << name << "' is unknown or not available";
+        }
+
+        if (stage == nullptr || filterChain.contains(stage))
+            continue;
+
+        if (std::find(prevStages, prevStages + prevCount, stage) == prevStages + prevCount)
+            stage->reset();
+
+        if (!filterChain.append(stage))
+        {
+            log_error_m << "Voice filter chain is too long"
+                        << ". Max count of stages: " << VOICE_FILTER_CHAIN_MAX;
+            break;
+        }
+        if (!chainNames.isEmpty())
+            chainNames += ", ";
+        chainNames += stage->name();
+    }
+    log_verbose_m << "Voice filter chain: "
+                  << (chainNames.isEmpty() ? QString("empty") : chainNames);
+}
+
 void VoiceFilters::message(const pproto::Message::Ptr& message)
 {
     if (message->processed())
@@ -235,6 +364,18 @@ void VoiceFilters::command_IncomingConfigConnection(const Message::Ptr& /*messag
 
     Message::Ptr m = createMessage(audioNoise);
     toxConfig().send(m);
+
+    data::AudioEchoCancel audioEchoCancel;
+    audioEchoCancel.enable = rereadEchoCancel();
+
+    m = createMessage(audioEchoCancel);
+    toxConfig().send(m);
+
+    data::VoiceFilterChain voiceFilterChain;
+    voiceFilterChain.stages = rereadFilterChain();
+
+    m = createMessage(voiceFilterChain);
+    toxConfig().send(m);
 }
 
 void VoiceFilters::command_AudioNoise(const Message::Ptr& message)
@@ -252,6 +393,7 @@ void VoiceFilters::command_AudioNoise(const Message::Ptr& message)
     config::state().saveFile();
 
     _filterChanged = true;
+    wake();
 }
 
 data::AudioNoise::FilterType VoiceFilters::rereadFilterType()
@@ -267,3 +409,91 @@ data::AudioNoise::FilterType VoiceFilters::rereadFilterType()
 
     return filterType;
 }
+
+void VoiceFilters::command_AudioEchoCancel(const Message::Ptr& message)
+{
+    data::AudioEchoCancel audioEchoCancel;
+    readFromMessage(message, audioEchoCancel);
+
+    config::state().setValue("audio.streams.echo_cancel", audioEchoCancel.enable);
+    config::state().saveFile();
+
+    _filterChanged = true;
+    wake();
+}
+
+bool VoiceFilters::rereadEchoCancel()
+{
+    bool echoCancel = false;
+    config::state().getValue("audio.streams.echo_cancel", echoCancel);
+    return echoCancel;
+}
+
+void VoiceFilters::sendEchoStat(quint32 delay, bool delayEstimated, qint32 erle)
+{
+    if (toxConfig().isActive())
+    {
+        data::AudioEchoStat audioEchoStat;
+        audioEchoStat.delay = delay;
+        audioEchoStat.delayEstimated = delayEstimated;
+        audioEchoStat.erle = erle;
+
+        Message::Ptr m = createMessage(audioEchoStat);
+        toxConfig().send(m);
+    }
+}
+
+void VoiceFilters::command_VoiceFilterChain(const Message::Ptr& message)
+{
+    data::VoiceFilterChain voiceFilterChain;
+    readFromMessage(message, voiceFilterChain);
+
+    QString value;
+    for (const QString& stage : voiceFilterChain.stages)
+    {
+        if (!value.isEmpty())
+            value += ",";
+        value += stage.trimmed();
+    }
+    config::state().setValue("audio.streams.filter_chain", value.toStdString());
+    config::state().saveFile();
+
+    _filterChanged = true;
+    wake();
+}
+
+QVector<QString> VoiceFilters::rereadFilterChain()
+{
+    // Состав цепочки, заданный конфигуратором (state), имеет приоритет
+    // перед значением из основного конфигурационного файла
+    string value = "echo,noise";
+    config::base().getValue("audio.filter_chain", value);
+    config::state().getValue("audio.streams.filter_chain", value, false);
+
+    QVector<QString> stages;
+    for (const QString& stage : QString::fromStdString(value).split(',', QString::SkipEmptyParts))
+        stages.append(stage.trimmed());
+
+    return stages;
+}
+
+void VoiceFilters::sendFilterStat(const QVector<VoiceFilterChain::Stat>& stat)
+{
+    if (toxConfig().isActive())
+    {
+        data::VoiceFilterStat voiceFilterStat;
+        for (const VoiceFilterChain::Stat& s : stat)
+        {
+            data::VoiceFilterStat::Stage stage;
+            stage.name = s.name;
+            stage.frames = s.frames;
+            stage.min = s.min;
+            stage.avg = s.avg;
+            stage.max = s.max;
+            voiceFilterStat.stages.append(stage);
+        }
+
+        Message::Ptr m = createMessage(voiceFilterStat);
+        toxConfig().send(m);
+    }
+}
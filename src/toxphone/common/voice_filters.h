@@ -10,6 +10,8 @@
 #include "commands/commands.h"
 #include "commands/error.h"
 
+#include "voice_filter_chain.h"
+
 #include <QtCore>
 #include <atomic>
 
@@ -23,6 +25,19 @@ public:
     void wake();
     void sendRecordLevet(quint32 maxLevel, quint32 time);
 
+    // Передача опорного (воспроизводимого) сигнала для эхоподавления.
+    // Вызывается только из потока воспроизведения голоса (PulseAudio или
+    // бэкенда ALSA), latency - задержка потока воспроизведения
+    // (в микросекундах)
+    void farEnd(const int16_t* pcm, quint32 sampleCount, quint8 channels,
+                quint32 samplingRate, quint32 latency);
+
+    // Задержка потока записи (в микросекундах)
+    void setRecordLatency(quint32 latency) {_recordLatency = latency;}
+
+    // Признак использования эхоподавления
+    bool echoCancel() const {return _echoCancel;}
+
 public slots:
     void message(const pproto::Message::Ptr&);
 
@@ -34,8 +49,19 @@ private:
 
     void command_IncomingConfigConnection(const Message::Ptr&);
     void command_AudioNoise(const Message::Ptr&);
+    void command_AudioEchoCancel(const Message::Ptr&);
+    void command_VoiceFilterChain(const Message::Ptr&);
 
     data::AudioNoise::FilterType rereadFilterType();
+    bool rereadEchoCancel();
+    QVector<QString> rereadFilterChain();
+
+    // Перестраивает цепочку фильтров в соответствии с текущими настройками,
+    // вызывается только из потока фильтров
+    void rebuildFilterChain(VoiceFilterChain&, const QVector<VoiceFilterStage*>& validStages);
+
+    void sendEchoStat(quint32 delay, bool delayEstimated, qint32 erle);
+    void sendFilterStat(const QVector<VoiceFilterChain::Stat>&);
 
 private:
     // Параметр используется для подготовки данных об индикации уровня сигнала
@@ -47,6 +73,12 @@ private:
     QWaitCondition _threadCond;
 
     volatile bool _filterChanged;
+
+    std::atomic_bool _echoCancel = {false};
+    std::atomic<quint32> _farEndRate = {0};
+    std::atomic<quint32> _playbackLatency = {0};
+    std::atomic<quint32> _recordLatency = {0};
+
     FunctionInvoker _funcInvoker;
 
     template<typename T, int> friend T& safe::singleton();
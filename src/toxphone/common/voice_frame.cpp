@@ -2,7 +2,7 @@
 
 #include "shared/safe_singleton.h"
 #include "shared/spin_locker.h"
-#include <atomic>
+#include <chrono>
 
 VoiceFrameInfo::VoiceFrameInfo(quint32 latency,
                                quint8  channels,
@@ -32,16 +32,6 @@ VoiceFrameInfo::Ptr getRecordFrameInfo(const VoiceFrameInfo* vfi, bool reset)
     return voiceFrameInfo;
 }
 
-RingBuffer& recordRBuff_1()
-{
-    return safe::singleton<RingBuffer, 0>();
-}
-
-RingBuffer& recordRBuff_2()
-{
-    return safe::singleton<RingBuffer, 1>();
-}
-
 VoiceFrameInfo::Ptr getVoiceFrameInfo(const VoiceFrameInfo* vfi, bool reset)
 {
     static VoiceFrameInfo::Ptr voiceFrameInfo;
@@ -56,7 +46,162 @@ VoiceFrameInfo::Ptr getVoiceFrameInfo(const VoiceFrameInfo* vfi, bool reset)
     return voiceFrameInfo;
 }
 
-RingBuffer& voiceRBuff()
+VoiceFrameInfo::Ptr defaultVoiceFrameInfo()
+{
+    VoiceFrameInfo voiceFrameInfo {20000, 1, sizeof(int16_t),
+                                   960, 48000, 960 * sizeof(int16_t)};
+    return VoiceFrameInfo::Ptr::create(voiceFrameInfo);
+}
+
+qint64 voiceTimestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+//----------------------------- VoiceFrameQueue ------------------------------
+
+bool VoiceFrameQueue::init(quint32 capacity)
+{
+    quint32 cap = 1;
+    while (cap < capacity)
+        cap <<= 1;
+
+    if (cap > VOICE_QUEUE_MAX_CAPACITY)
+        return false;
+
+    _capacity = cap;
+    _mask = cap - 1;
+    _head.store(0, std::memory_order_relaxed);
+    _tail.store(0, std::memory_order_release);
+    return true;
+}
+
+bool VoiceFrameQueue::push(VoiceFrame* frame)
+{
+    const quint32 tail = _tail.load(std::memory_order_relaxed);
+    const quint32 head = _head.load(std::memory_order_acquire);
+    if ((tail - head) >= _capacity)
+        return false;
+
+    _ring[tail & _mask] = frame;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+VoiceFrame* VoiceFrameQueue::front() const
+{
+    const quint32 head = _head.load(std::memory_order_relaxed);
+    const quint32 tail = _tail.load(std::memory_order_acquire);
+    if (head == tail)
+        return nullptr;
+
+    return _ring[head & _mask];
+}
+
+VoiceFrame* VoiceFrameQueue::pop()
+{
+    const quint32 head = _head.load(std::memory_order_relaxed);
+    const quint32 tail = _tail.load(std::memory_order_acquire);
+    if (head == tail)
+        return nullptr;
+
+    VoiceFrame* frame = _ring[head & _mask];
+    _head.store(head + 1, std::memory_order_release);
+    return frame;
+}
+
+quint32 VoiceFrameQueue::count() const
+{
+    return _tail.load(std::memory_order_acquire)
+           - _head.load(std::memory_order_acquire);
+}
+
+//----------------------------- VoiceFramePool -------------------------------
+
+VoiceFramePool::~VoiceFramePool()
+{
+    delete [] _frames;
+}
+
+bool VoiceFramePool::init(quint32 count)
+{
+    if (!_free.init(count))
+        return false;
+
+    if (_count != count)
+    {
+        delete [] _frames;
+        _frames = new VoiceFrame[count];
+        _count = count;
+    }
+    for (quint32 i = 0; i < _count; ++i)
+    {
+        _frames[i].dataSize = 0;
+        _frames[i].timestamp = 0;
+        _free.push(&_frames[i]);
+    }
+    return true;
+}
+
+VoiceFrame* VoiceFramePool::acquire()
+{
+    VoiceFrame* frame = _free.pop();
+    if (frame)
+    {
+        frame->dataSize = 0;
+        frame->timestamp = 0;
+        frame->filterIn = 0;
+        frame->filterOut = 0;
+        frame->speech = true;
+    }
+    return frame;
+}
+
+void VoiceFramePool::release(VoiceFrame* frame)
+{
+    if (frame)
+        _free.push(frame);
+}
+
+//------------------------------- Singletons ---------------------------------
+
+VoiceFramePool& recordFramePool()
+{
+    return safe::singleton<VoiceFramePool, 0>();
+}
+
+VoiceFrameQueue& recordQueue_1()
+{
+    return safe::singleton<VoiceFrameQueue, 0>();
+}
+
+VoiceFrameQueue& recordQueue_2()
+{
+    return safe::singleton<VoiceFrameQueue, 1>();
+}
+
+VoiceFrameQueue& sendQueue()
+{
+    return safe::singleton<VoiceFrameQueue, 5>();
+}
+
+VoiceFramePool& voiceFramePool()
+{
+    return safe::singleton<VoiceFramePool, 1>();
+}
+
+VoiceFrameQueue& voiceQueue()
+{
+    return safe::singleton<VoiceFrameQueue, 3>();
+}
+
+VoiceFramePool& echoFramePool()
+{
+    return safe::singleton<VoiceFramePool, 2>();
+}
+
+VoiceFrameQueue& echoQueue()
 {
-    return safe::singleton<RingBuffer, 3>();
+    return safe::singleton<VoiceFrameQueue, 4>();
 }
@@ -1,12 +1,13 @@
 #pragma once
 
 #include "shared/list.h"
+#include "shared/defmac.h"
 #include "shared/clife_alloc.h"
 #include "shared/clife_base.h"
 #include "shared/clife_ptr.h"
 #include "shared/container_ptr.h"
-#include "shared/ring_buffer.h"
 #include <QtCore>
+#include <atomic>
 
 /**
   Содержит базовые параметры воспроизведения/записи
@@ -34,10 +35,119 @@ struct VoiceFrameInfo
 };
 
 VoiceFrameInfo::Ptr getRecordFrameInfo(const VoiceFrameInfo* = 0, bool reset = false);
-RingBuffer& recordRBuff_1();
-RingBuffer& recordRBuff_2();
-
 VoiceFrameInfo::Ptr getVoiceFrameInfo(const VoiceFrameInfo* = 0, bool reset = false);
-RingBuffer& voiceRBuff();
 
+// Предполагаемые параметры входящего голосового потока, используются
+// до получения первых фреймов: 48 кГц, один канал, фрейм 20 мс
+VoiceFrameInfo::Ptr defaultVoiceFrameInfo();
+
+// Максимальный размер аудио-данных в одном фрейме: 60 мс, 48 кГц, 2 канала
+#define VOICE_FRAME_MAX_SIZE (60 * 48 * 2 * sizeof(int16_t))
+
+// Максимальная емкость очереди фреймов (не менее 120 мс при фрейме 2.5 мс)
+#define VOICE_QUEUE_MAX_CAPACITY 64
+
+/**
+  Слот для одного аудио-фрейма. Слоты выделяются заранее (см. VoiceFramePool)
+  и передаются между потоками по указателю, без копирования аудио-данных.
+  Выравнивание по кэш-линии исключает ложное разделение данных между потоками
+  записи и чтения.
+*/
+struct alignas(64) VoiceFrame
+{
+    quint32 dataSize  = {0}; // Размер аудио-данных в буфере (в байтах)
+    qint64  timestamp = {0}; // Время захвата (получения) фрейма, см. voiceTimestamp()
+    qint64  filterIn  = {0}; // Время начала/окончания обработки фрейма цепочкой
+    qint64  filterOut = {0}; // фильтров (см. VoiceLatency)
+    bool    speech = {true}; // Признак наличия речи, выставляется ступенью VAD
+    char    data[VOICE_FRAME_MAX_SIZE];
+};
+
+// Монотонное время в микросекундах, используется для отметок времени фреймов
+qint64 voiceTimestamp();
+
+/**
+  Lock-free очередь указателей на аудио-фреймы для схемы один писатель/один
+  читатель (SPSC). Функция push() вызывается только из потока-писателя,
+  функции front()/pop() - только из потока-читателя.
+*/
+class VoiceFrameQueue
+{
+public:
+    VoiceFrameQueue() = default;
+
+    // Емкость округляется вверх до степени двойки и не может превышать
+    // VOICE_QUEUE_MAX_CAPACITY. Вызывать только когда очередь не используется.
+    bool init(quint32 capacity);
+
+    bool push(VoiceFrame*);
+    VoiceFrame* front() const;
+    VoiceFrame* pop();
+
+    quint32 count() const;
+    quint32 capacity() const {return _capacity;}
+    bool empty() const {return (count() == 0);}
+
+private:
+    DISABLE_DEFAULT_COPY(VoiceFrameQueue)
+
+    alignas(64) std::atomic<quint32> _head = {0}; // Позиция читателя
+    alignas(64) std::atomic<quint32> _tail = {0}; // Позиция писателя
+
+    alignas(64) quint32 _capacity = {0};
+    quint32 _mask = {0};
+    VoiceFrame* _ring[VOICE_QUEUE_MAX_CAPACITY] = {0};
+};
+
+/**
+  Пул заранее выделенных аудио-фреймов. Свободные фреймы хранятся в SPSC
+  очереди: acquire() вызывается только потоком-производителем аудио-данных,
+  release() - только потоком-потребителем, который последним владеет фреймом.
+*/
+class VoiceFramePool
+{
+public:
+    VoiceFramePool() = default;
+    ~VoiceFramePool();
 
+    // Выделяет count фреймов. Вызывать только когда пул не используется.
+    bool init(quint32 count);
+
+    VoiceFrame* acquire();
+    void release(VoiceFrame*);
+
+    quint32 count() const {return _count;}
+    quint32 available() const {return _free.count();}
+
+private:
+    DISABLE_DEFAULT_COPY(VoiceFramePool)
+
+    VoiceFrame* _frames = {nullptr};
+    quint32 _count = {0};
+    VoiceFrameQueue _free;
+};
+
+/**
+  Тракт записи: AudioDev (PulseAudio) -> recordQueue_1 -> VoiceFilters ->
+  recordQueue_2 -> VoiceSender -> sendQueue -> ToxNet. Фреймы берутся из
+  recordFramePool() и возвращаются в него потоком ToxNet после вызова
+  toxav_audio_send_frame(). Емкость очередей не меньше размера пула.
+*/
+VoiceFramePool&  recordFramePool();
+VoiceFrameQueue& recordQueue_1();
+VoiceFrameQueue& recordQueue_2();
+VoiceFrameQueue& sendQueue();
+
+/**
+  Тракт воспроизведения: ToxCall -> voiceQueue -> AudioDev (PulseAudio).
+  Фреймы берутся из voiceFramePool() и возвращаются в него после проигрывания.
+*/
+VoiceFramePool&  voiceFramePool();
+VoiceFrameQueue& voiceQueue();
+
+/**
+  Опорный сигнал для эхоподавления: AudioDev (воспроизведение голоса) ->
+  echoQueue -> VoiceFilters. Данные во фреймах приведены к одному каналу.
+*/
+VoiceFramePool&  echoFramePool();
+VoiceFrameQueue& echoQueue();
@@ -0,0 +1,110 @@
+#include "voice_latency.h"
+
+#include "shared/safe_singleton.h"
+
+static const quint32 latencyBounds[VOICE_LATENCY_BUCKETS] =
+{
+    500, 1000, 2000, 5000, 10000, 20000, 30000, 40000,
+    60000, 80000, 100000, 150000, 200000, 300000, 500000, quint32(-1)
+};
+
+static const char* segmentNames[VoiceLatency::SegmentCount] =
+{
+    "capture_to_filter", "filter", "filter_to_send",
+    "capture_to_send", "receive_to_playback"
+};
+
+VoiceLatency& voiceLatency()
+{
+    return safe::singleton<VoiceLatency, 0>();
+}
+
+VoiceLatency::Histogram::Histogram()
+{
+    for (int i = 0; i < VOICE_LATENCY_BUCKETS; ++i)
+        buckets[i] = 0;
+}
+
+const quint32* VoiceLatency::bucketBounds()
+{
+    return latencyBounds;
+}
+
+const char* VoiceLatency::segmentName(Segment segment)
+{
+    return segmentNames[segment];
+}
+
+void VoiceLatency::add(Segment segment, qint64 latency)
+{
+    quint32 value = quint32(qBound(qint64(0), latency, qint64(quint32(-1) - 1)));
+
+    int bucket = 0;
+    while (value > latencyBounds[bucket])
+        ++bucket;
+
+    Histogram& h = _histograms[segment];
+    h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    h.sum.fetch_add(value, std::memory_order_relaxed);
+
+    // Участок заполняется одним потоком, поэтому CAS-цикл не требуется
+    if (value > h.max.load(std::memory_order_relaxed))
+        h.max.store(value, std::memory_order_relaxed);
+}
+
+QVector<VoiceLatency::Stat> VoiceLatency::stat(bool reset)
+{
+    QVector<Stat> result;
+    result.reserve(SegmentCount);
+
+    for (int i = 0; i < SegmentCount; ++i)
+    {
+        Histogram& h = _histograms[i];
+
+        Stat stat;
+        stat.name = segmentNames[i];
+
+        // При сбросе значения забираются атомарно, чтобы не потерять данные,
+        // добавленные во время получения снимка
+        quint32 count = 0;
+        for (int j = 0; j < VOICE_LATENCY_BUCKETS; ++j)
+        {
+            stat.histogram[j] = (reset)
+                ? h.buckets[j].exchange(0, std::memory_order_relaxed)
+                : h.buckets[j].load(std::memory_order_relaxed);
+            count += stat.histogram[j];
+        }
+        quint64 sum = (reset) ? h.sum.exchange(0, std::memory_order_relaxed)
+                              : h.sum.load(std::memory_order_relaxed);
+        stat.max = (reset) ? h.max.exchange(0, std::memory_order_relaxed)
+                           : h.max.load(std::memory_order_relaxed);
+
+        stat.count = count;
+        if (count)
+        {
+            stat.avg = quint32(sum / count);
+
+            quint32* percentiles[] = {&stat.p50, &stat.p95, &stat.p99};
+            const quint32 levels[] = {50, 95, 99};
+            for (int k = 0; k < 3; ++k)
+            {
+                quint64 threshold = (quint64(count) * levels[k] + 99) / 100;
+                quint64 accum = 0;
+                for (int j = 0; j < VOICE_LATENCY_BUCKETS; ++j)
+                {
+                    accum += stat.histogram[j];
+                    if (accum >= threshold)
+                    {
+                        // Для последнего (неограниченного) интервала
+                        // используется максимальное значение
+                        *percentiles[k] = (j == VOICE_LATENCY_BUCKETS - 1)
+                                          ? stat.max : latencyBounds[j];
+                        break;
+                    }
+                }
+            }
+        }
+        result.append(stat);
+    }
+    return result;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "shared/defmac.h"
+
+#include <QtCore>
+#include <atomic>
+
+// Количество интервалов гистограммы задержек
+#define VOICE_LATENCY_BUCKETS 16
+
+/**
+  Гистограммы задержек голосовых фреймов на участках аудио-тракта.
+
+  Тракт записи (отметки времени хранятся во фрейме, см. VoiceFrame):
+    Capture - чтение данных из потока PulseAudio (record_stream_read);
+    FilterIn/FilterOut - вход/выход цепочки фильтров (VoiceFilters);
+    Send - возврат из toxav_audio_send_frame() (очередь sendQueue, ToxNet).
+  Тракт воспроизведения:
+    Receive - получение фрейма в toxav_audio_receive_frame();
+    Playback - начало записи фрейма в поток PulseAudio (voice_stream_write).
+
+  Каждый участок заполняется только одним потоком, добавление значения
+  выполняется без блокировок (атомарные счетчики), поэтому снимок
+  гистограмм может быть получен из любого потока.
+*/
+class VoiceLatency
+{
+public:
+    enum Segment
+    {
+        CaptureToFilter   = 0, // Ожидание в очереди recordQueue_1
+        Filter            = 1, // Обработка цепочкой фильтров
+        FilterToSend      = 2, // Ожидание в очередях recordQueue_2/sendQueue и отправка
+        CaptureToSend     = 3, // Тракт записи в целом
+        ReceiveToPlayback = 4, // Ожидание в джиттер-буфере
+        SegmentCount
+    };
+
+    struct Stat
+    {
+        const char* name = {nullptr};
+        quint32 count = {0}; // Количество фреймов
+        quint32 avg = {0};   // Задержка (в микросекундах)
+        quint32 max = {0};
+        quint32 p50 = {0};   // Процентили (верхняя граница интервала
+        quint32 p95 = {0};   // гистограммы, в микросекундах)
+        quint32 p99 = {0};
+        quint32 histogram[VOICE_LATENCY_BUCKETS] = {0};
+    };
+
+    VoiceLatency() = default;
+
+    // Верхние границы интервалов гистограммы (в микросекундах), последний
+    // интервал не ограничен
+    static const quint32* bucketBounds();
+    static const char* segmentName(Segment);
+
+    void add(Segment, qint64 latency);
+
+    // Снимок гистограмм. Если reset равен TRUE, то гистограммы сбрасываются
+    QVector<Stat> stat(bool reset);
+
+private:
+    DISABLE_DEFAULT_COPY(VoiceLatency)
+
+    struct Histogram
+    {
+        std::atomic<quint64> sum = {0};
+        std::atomic<quint32> max = {0};
+        std::atomic<quint32> buckets[VOICE_LATENCY_BUCKETS];
+
+        Histogram();
+    };
+
+    Histogram _histograms[SegmentCount];
+};
+
+VoiceLatency& voiceLatency();
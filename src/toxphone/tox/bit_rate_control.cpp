@@ -0,0 +1,205 @@
+#include "bit_rate_control.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/config/appl_conf.h"
+#include "shared/qt/logger_operators.h"
+
+#include <chrono>
+
+#define log_error_m   alog::logger().error  (alog_line_location, "BitRateCtl")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "BitRateCtl")
+#define log_info_m    alog::logger().info   (alog_line_location, "BitRateCtl")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "BitRateCtl")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "BitRateCtl")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "BitRateCtl")
+
+using namespace std;
+
+// Ряд допустимых значений битрейта голосового потока (в Кбит/с)
+static const quint32 bitRateLevels[] = {64, 48, 32, 24, 16, 12, 8, 6};
+
+static const char* reasonName(BitRateControl::Reason reason)
+{
+    switch (reason)
+    {
+        case BitRateControl::Reason::Initial:           return "initial";
+        case BitRateControl::Reason::NetworkSuggestion: return "network suggestion";
+        case BitRateControl::Reason::TcpRelay:          return "tcp relay";
+        case BitRateControl::Reason::PacketLoss:        return "packet loss";
+        case BitRateControl::Reason::Jitter:            return "jitter";
+        case BitRateControl::Reason::Recovery:          return "recovery";
+        default:                                        return "undefined";
+    }
+}
+
+void BitRateControl::init()
+{
+    int maxBitRate = 64;
+    config::base().getValue("audio.bit_rate.max", maxBitRate);
+
+    int minBitRate = 8;
+    config::base().getValue("audio.bit_rate.min", minBitRate);
+
+    int tcpMax = 24;
+    config::base().getValue("audio.bit_rate.tcp_max", tcpMax);
+    _tcpMax = quint32(qMax(tcpMax, 1));
+
+    int lossHigh = 5;
+    config::base().getValue("audio.bit_rate.loss_high", lossHigh);
+    _lossHigh = quint32(qBound(1, lossHigh, 100));
+
+    int lossLow = 1;
+    config::base().getValue("audio.bit_rate.loss_low", lossLow);
+    _lossLow = qMin(quint32(qMax(lossLow, 0)), _lossHigh);
+
+    int jitterHigh = 60;
+    config::base().getValue("audio.bit_rate.jitter_high", jitterHigh);
+    _jitterHigh = quint32(qMax(jitterHigh, 1)) * 1000;
+
+    int jitterLow = 30;
+    config::base().getValue("audio.bit_rate.jitter_low", jitterLow);
+    _jitterLow = qMin(quint32(qMax(jitterLow, 0)) * 1000, _jitterHigh);
+
+    int stepDownDelay = 2;
+    config::base().getValue("audio.bit_rate.step_down_delay", stepDownDelay);
+    _stepDownDelay = quint32(qMax(stepDownDelay, 1));
+
+    int stepUpDelay = 10;
+    config::base().getValue("audio.bit_rate.step_up_delay", stepUpDelay);
+    _stepUpDelay = quint32(qMax(stepUpDelay, 1));
+
+    int localDownDelay = 10;
+    config::base().getValue("audio.bit_rate.local_down_delay", localDownDelay);
+    _localDownDelay = quint32(qMax(localDownDelay, 1));
+
+    _levels.clear();
+    for (quint32 level : bitRateLevels)
+        if (int(level) <= maxBitRate && int(level) >= minBitRate)
+            _levels.append(level);
+
+    if (_levels.isEmpty())
+    {
+        log_error_m << "Invalid bit rate range: " << minBitRate << " - " << maxBitRate
+                    << " Kb/sec. Bit rate will be fixed to "
+                    << bitRateLevels[0] << " Kb/sec";
+        _levels.append(bitRateLevels[0]);
+    }
+
+    log_verbose_m << "Audio bit rate: " << _levels.first() << " - " << _levels.last()
+                  << " Kb/sec; tcp relay max: " << _tcpMax << " Kb/sec";
+}
+
+quint32 BitRateControl::start()
+{
+    _active = true;
+    _changed = false;
+    _ceiling = 0;
+    _level = 0;
+    _bitRate = _levels[0];
+    _reason = Reason::Initial;
+
+    _stepDownTimer.reset();
+    _goodTimer.reset();
+    _badTimer.reset();
+    return _bitRate;
+}
+
+void BitRateControl::stop()
+{
+    _active = false;
+    _changed = false;
+    _bitRate = 0;
+    _reason = Reason::Undefined;
+}
+
+int BitRateControl::levelFor(quint32 bitRate) const
+{
+    for (int i = 0; i < _levels.count(); ++i)
+        if (_levels[i] <= bitRate)
+            return i;
+
+    return _levels.count() - 1;
+}
+
+void BitRateControl::setLevel(int level, Reason reason)
+{
+    if (level == _level)
+        return;
+
+    log_verbose_m << "Audio bit rate: " << _levels[_level]
+                  << " -> " << _levels[level] << " Kb/sec"
+                  << "; reason: " << reasonName(reason);
+
+    _level = level;
+    _bitRate = _levels[level];
+    _reason = reason;
+    _changed = true;
+}
+
+void BitRateControl::suggest(quint32 bitRate)
+{
+    if (!_active)
+        return;
+
+    int level = levelFor(bitRate);
+    if (level > _level)
+    {
+        setLevel(level, Reason::NetworkSuggestion);
+        _stepDownTimer.reset();
+        _goodTimer.reset();
+        _badTimer.reset();
+    }
+}
+
+void BitRateControl::update(const Network& network)
+{
+    if (!_active)
+        return;
+
+    _ceiling = network.tcpRelay ? levelFor(_tcpMax) : 0;
+    if (_level < _ceiling)
+    {
+        setLevel(_ceiling, Reason::TcpRelay);
+        _stepDownTimer.reset();
+        _goodTimer.reset();
+        return;
+    }
+
+    // Без входящих фреймов состояние канала не оценивается и повышению
+    // битрейта не препятствует
+    if (network.voice && (network.loss > _lossHigh || network.jitter > _jitterHigh))
+    {
+        _goodTimer.reset();
+        if (_level < _levels.count() - 1
+            && _badTimer.elapsed<chrono::seconds>() >= _localDownDelay
+            && _stepDownTimer.elapsed<chrono::seconds>() >= _stepDownDelay)
+        {
+            setLevel(_level + 1, (network.loss > _lossHigh) ? Reason::PacketLoss
+                                                            : Reason::Jitter);
+            _stepDownTimer.reset();
+            _badTimer.reset();
+        }
+        return;
+    }
+    _badTimer.reset();
+
+    if (network.voice && (network.loss > _lossLow || network.jitter > _jitterLow))
+    {
+        _goodTimer.reset();
+        return;
+    }
+
+    if (_level > _ceiling && _goodTimer.elapsed<chrono::seconds>() >= _stepUpDelay)
+    {
+        setLevel(_level - 1, Reason::Recovery);
+        _goodTimer.reset();
+    }
+}
+
+bool BitRateControl::changed()
+{
+    bool changed = _changed;
+    _changed = false;
+    return changed;
+}
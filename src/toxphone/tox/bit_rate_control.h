@@ -0,0 +1,100 @@
+#pragma once
+
+#include "commands/commands.h"
+#include "shared/defmac.h"
+#include "shared/steady_timer.h"
+
+#include <QtCore>
+
+/**
+  Выбор битрейта исходящего голосового потока во время звонка.
+
+  Битрейт выбирается из ряда фиксированных значений (ограниченного
+  параметрами audio.bit_rate.min и audio.bit_rate.max) с учетом следующих
+  факторов:
+    - рекомендации ToxAV (bit rate callback): битрейт сразу снижается
+      до рекомендованного значения. Рекомендация формируется ToxAV по
+      потерям исходящего потока, о которых сообщает сторона друга, поэтому
+      она является основным источником снижения битрейта;
+    - типа соединения с другом: при соединении через TCP-релей битрейт
+      ограничивается значением audio.bit_rate.tcp_max;
+    - потерь и джиттера входящего голосового потока. Входящий поток
+      характеризует обратное направление канала, поэтому плохие условия
+      в нем сдерживают повышение битрейта, а снижение выполняется, только
+      если они сохраняются не менее local_down_delay секунд. Интервалы без
+      входящих фреймов (паузы в речи) не оцениваются.
+
+  Снижение битрейта выполняется не чаще, чем раз в step_down_delay секунд,
+  повышение - на одну ступень после step_up_delay секунд хороших условий
+  сети.
+
+  Все функции вызываются из потока ToxCall.
+*/
+class BitRateControl
+{
+public:
+    typedef data::ToxCallState::BitRateReason Reason;
+
+    // Состояние сети за последний интервал измерения
+    struct Network
+    {
+        bool    tcpRelay = {false}; // Соединение с другом через TCP-релей
+        bool    voice    = {false}; // За интервал поступали входящие фреймы
+        quint32 loss     = {0};     // Потери входящих фреймов (в процентах)
+        quint32 jitter   = {0};     // Джиттер входящего потока (в микросекундах)
+    };
+
+    BitRateControl() = default;
+
+    // Читает параметры из конфигурации
+    void init();
+
+    // Начало звонка, возвращает начальный битрейт (в Кбит/с)
+    quint32 start();
+    void stop();
+
+    // Рекомендация битрейта от ToxAV (в Кбит/с)
+    void suggest(quint32 bitRate);
+
+    // Периодическая оценка состояния сети, вызывается раз в секунду
+    void update(const Network&);
+
+    // Возвращает TRUE, если битрейт изменился с момента предыдущего вызова
+    // функции. Функция сбрасывает признак изменения
+    bool changed();
+
+    bool active() const {return _active;}
+    quint32 bitRate() const {return _bitRate;}
+    Reason reason() const {return _reason;}
+
+private:
+    DISABLE_DEFAULT_COPY(BitRateControl)
+
+    // Максимальная ступень, битрейт которой не превышает bitRate
+    int levelFor(quint32 bitRate) const;
+    void setLevel(int level, Reason);
+
+private:
+    bool _active = {false};
+    bool _changed = {false};
+
+    QVector<quint32> _levels; // Допустимые значения битрейта по убыванию
+    int _level = {0};         // Текущая ступень (индекс в _levels)
+    int _ceiling = {0};       // Ступень, выше которой подниматься нельзя
+
+    quint32 _bitRate = {0};
+    Reason _reason = {Reason::Undefined};
+
+    quint32 _tcpMax = {24};
+    quint32 _lossHigh = {5};
+    quint32 _lossLow = {1};
+    quint32 _jitterHigh = {60000}; // В микросекундах
+    quint32 _jitterLow = {30000};  // В микросекундах
+    quint32 _stepDownDelay = {2};  // В секундах
+    quint32 _stepUpDelay = {10};   // В секундах
+    quint32 _localDownDelay = {10}; // В секундах
+
+    steady_timer _stepDownTimer;
+    steady_timer _goodTimer;
+    steady_timer _badTimer;
+};
@@ -1,6 +1,8 @@
 #include "tox_call.h"
 #include "tox_net.h"
 #include "tox_func.h"
+#include "tox_lock_stat.h"
+#include "voice_sender.h"
 
 #include "toxfunc/tox_func.h"
 #include "toxfunc/tox_logger.h"
@@ -8,6 +10,8 @@
 
 #include "common/defines.h"
 #include "common/functions.h"
+#include "common/realtime.h"
+#include "audio/audio_dev.h"
 #include "common/voice_filters.h"
 #include "diverter/phone_diverter.h"
 
@@ -81,22 +85,34 @@ bool ToxCall::init(Tox* tox)
     toxav_callback_audio_receive_frame(_toxav, toxav_audio_receive_frame, this);
     toxav_callback_video_receive_frame(_toxav, toxav_video_receive_frame, this);
 
+    voiceSender().init(_toxav);
+    _bitRateControl.init();
+
+    _dtmfDetect = true;
+    config::base().getValue("audio.dtmf_detector", _dtmfDetect);
     return true;
 }
 
 void ToxCall::run()
 {
     log_info_m << "Started";
+    realtimeSetupThread("tox_call");
 
     Message::List messages;
     steady_timer iterationTimer;
     int iterationSleepTime;
 
+    bool reactor = true;
+    config::base().getValue("tox_core.reactor", reactor);
+    if (reactor)
+        _reactor.init();
+
     while (true)
     {
         CHECK_THREAD_STOP
 
         toxav_iterate(_toxav);
+        _callActive = (_callState.direction != data::ToxCallState::Direction::Undefined);
 
         // Параметр iterationSleepTime вычисляется с учетом времени потраченного
         // на выполнение toxav_iterate()
@@ -123,8 +139,6 @@ void ToxCall::run()
             //log_debug2_m << "iterationSleepTime: " << iterationSleepTime;
         }
 
-        iterateVoiceFrame();
-
         { //Block for QMutexLocker
             QMutexLocker locker(&_threadLock); (void) locker;
             if (!_messages.empty())
@@ -150,16 +164,38 @@ void ToxCall::run()
             sendCallState();
         }
 
+        if (_bitRateControl.active() && (_bitRateTimer.elapsed() >= 1000))
+            updateBitRate();
+
+        // Битрейт может измениться как по результатам оценки состояния сети,
+        // так и по рекомендации ToxAV (из toxav_iterate())
+        if (_bitRateControl.changed())
+            applyBitRate();
+
         iterationSleepTime -= iterationTimer.elapsed();
         if (iterationSleepTime > 0)
         {
-            QMutexLocker locker(&_threadLock); (void) locker;
-            if (!_messages.empty())
-                continue;
-            _threadCond.wait(&_threadLock, iterationSleepTime);
+            if (_reactor.active())
+            {
+                { //Block for QMutexLocker
+                    QMutexLocker locker(&_threadLock); (void) locker;
+                    if (!_messages.empty())
+                        continue;
+                }
+                _reactor.wait(iterationSleepTime);
+            }
+            else
+            {
+                QMutexLocker locker(&_threadLock); (void) locker;
+                if (!_messages.empty())
+                    continue;
+                _threadCond.wait(&_threadLock, iterationSleepTime);
+            }
         }
     } // while (true)
 
+    _reactor.deinit();
+
     if (_toxav)
         toxav_kill(_toxav);
 
@@ -180,9 +216,16 @@ void ToxCall::message(const pproto::Message::Ptr& message)
         QMutexLocker locker(&_threadLock); (void) locker;
         _messages.add(message.get());
         _threadCond.wakeAll();
+        _reactor.wake();
     }
 }
 
+void ToxCall::wakeOnPacket()
+{
+    if (_callActive)
+        _reactor.wake();
+}
+
 void ToxCall::command_IncomingConfigConnection(const Message::Ptr& /*message*/)
 {
     //sendCallState();
@@ -202,7 +245,7 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
         log_verbose_m << "Begin outgoing call (state: WaitingAnswer). "
                       << ToxFriendLog(toxav_get_tox(_toxav), toxCallAction.friendNumber);
 
-        ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+        ToxTimedLock toxGlobalLock {ToxLockStat::CallControl}; (void) toxGlobalLock;
 
         if (_callState.direction != data::ToxCallState::Direction::Undefined)
         {
@@ -210,7 +253,7 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
                         << ". Command is interrupted";
             return;
         }
-        _sendVoiceFriendNumber = quint32(-1);
+        voiceSender().stopSending();
         _callState.direction = data::ToxCallState::Direction::Outgoing;
         _callState.callState = data::ToxCallState::CallState::WaitingAnswer;
         _callState.callEnd = data::ToxCallState::CallEnd::Undefined;
@@ -221,7 +264,9 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
         TOXAV_ERR_CALL err;
         data::MessageError msgerr;
 
-        toxav_call(_toxav, toxCallAction.friendNumber, 64 /*Kb/sec*/, 0, &err);
+        startBitRate();
+        toxav_call(_toxav, toxCallAction.friendNumber,
+                   _callState.audioBitRate /*Kb/sec*/, 0, &err);
 
         if (toxError(err, msgerr))
         {
@@ -235,6 +280,7 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
             }
             toxav_call_control(_toxav, toxCallAction.friendNumber, TOXAV_CALL_CONTROL_CANCEL, 0);
 
+            stopBitRate();
             _callState.direction = data::ToxCallState::Direction::Undefined;
             _callState.callState = data::ToxCallState::CallState::IsComplete;
             _callState.friendNumber = quint32(-1);
@@ -257,7 +303,7 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
         log_verbose_m << "Accept incoming call (state: InProgress). "
                       << ToxFriendLog(toxav_get_tox(_toxav), toxCallAction.friendNumber);
 
-        ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+        ToxTimedLock toxGlobalLock {ToxLockStat::CallControl}; (void) toxGlobalLock;
 
         if (!(_callState.direction == data::ToxCallState::Direction::Incoming
               && _callState.callState == data::ToxCallState::CallState::WaitingAnswer))
@@ -266,7 +312,7 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
                         << ". Command is interrupted";
             return;
         }
-        _skipFirstFrames = 0;
+        prepareVoice();
         _callState.direction = data::ToxCallState::Direction::Incoming;
         _callState.callState = data::ToxCallState::CallState::InProgress;
         _callState.callEnd = data::ToxCallState::CallEnd::Undefined;
@@ -277,12 +323,13 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
         TOXAV_ERR_ANSWER err;
         data::MessageError msgerr;
 
-        toxav_answer(_toxav, toxCallAction.friendNumber, 64 /*Kb/sec*/, 0, &err);
+        startBitRate();
+        toxav_answer(_toxav, toxCallAction.friendNumber,
+                     _callState.audioBitRate /*Kb/sec*/, 0, &err);
 
         if (!toxError(err, msgerr))
         {
-            _recordBytes = 0;
-            _sendVoiceFriendNumber = toxCallAction.friendNumber;
+            voiceSender().startSending(toxCallAction.friendNumber);
         }
         else
         {
@@ -296,6 +343,7 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
             }
             toxav_call_control(_toxav, toxCallAction.friendNumber, TOXAV_CALL_CONTROL_CANCEL, 0);
 
+            stopBitRate();
             _callState.direction = data::ToxCallState::Direction::Undefined;
             _callState.callState = data::ToxCallState::CallState::IsComplete;
             _callState.friendNumber = quint32(-1);
@@ -343,7 +391,7 @@ void ToxCall::command_ToxCallAction(const Message::Ptr& message)
             logLine << ToxFriendLog(toxav_get_tox(_toxav), toxCallAction.friendNumber);
         }
 
-        ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+        ToxTimedLock toxGlobalLock {ToxLockStat::CallControl}; (void) toxGlobalLock;
 
         if (_callState.direction == data::ToxCallState::Direction::Undefined)
         {
@@ -460,76 +508,259 @@ void ToxCall::command_DiverterHandset(const Message::Ptr& message)
     }
 }
 
-void ToxCall::iterateVoiceFrame()
+void ToxCall::endCalling()
+{
+    voiceSender().stopSending();
+    stopBitRate();
+
+    _voiceReady = false;
+    _warmupCount = 0;
+
+    log_debug_m << "Voice bytes (processed): " << _voiceBytes;
+    _voiceBytes = 0;
+}
+
+void ToxCall::prepareVoice()
+{
+    _voiceReady = false;
+    _warmupCount = 0;
+    _voiceBytes = 0;
+
+    if (_voiceFrameInfo.empty())
+        _voiceFrameInfo = defaultVoiceFrameInfo();
+
+    log_debug_m << "Prepare voice stream"
+                << "; channels: "  << int(_voiceFrameInfo->channels)
+                << "; sample count: "  << _voiceFrameInfo->sampleCount
+                << "; sampling rate: " << _voiceFrameInfo->samplingRate;
+
+    emit startVoice(_voiceFrameInfo);
+}
+
+void ToxCall::receiveVoice(const int16_t* pcm, quint32 sampleCount,
+                           quint8 channels, quint32 samplingRate)
 {
-    if (_sendVoiceFriendNumber == quint32(-1))
+    static quint32 sampleSize {sizeof(int16_t)};
+    quint32 bufferSize = sampleCount * sampleSize * channels;
+
+    if (_callState.callState != data::ToxCallState::CallState::InProgress
+        || samplingRate == 0)
+    {
         return;
+    }
 
-    VoiceFrameInfo::Ptr voiceFrameInfo = getRecordFrameInfo();
-    if (voiceFrameInfo.empty())
+    if (bufferSize > VOICE_FRAME_MAX_SIZE)
+    {
+        log_error_m << "Voice frame too large"
+                    << "; buffer size: " << bufferSize;
         return;
+    }
 
-    //quint32 audioLength = 5; // ms
-    //quint32 dataSize = (voiceFrameInfo->samplingRate / 1000) * audioLength
-    //                   * voiceFrameInfo->sampleSize * voiceFrameInfo->channels;
-    char data[4000];
-    quint32 dataSize = voiceFrameInfo->bufferSize;
+    auto sameFormat = [&](const VoiceFrameInfo& info)
+    {
+        return info.sampleCount == sampleCount
+               && info.channels == channels
+               && info.samplingRate == samplingRate;
+    };
 
-    if (recordRBuff_2().read(data, dataSize))
+    if (_voiceReady && sameFormat(*_voiceFrameInfo))
     {
-        _recordBytes += dataSize;
+        pushVoice((const char*)pcm, bufferSize, voiceTimestamp());
+        return;
+    }
 
-        int retries = 0;
-        TOXAV_ERR_SEND_FRAME err;
-        data::MessageError msgerr;
+    // Перестройка opus-декодера: параметры фреймов меняются, пока декодер
+    // не настроится на входящий поток. Фреймы накапливаются до тех пор, пока
+    // VOICE_WARMUP_FRAMES фреймов подряд не будут получены с одинаковыми
+    // параметрами. Фреймы с отличающимися параметрами не могут быть
+    // воспроизведены одним потоком, поэтому при смене параметров накопленные
+    // фреймы отбрасываются.
+    if (_warmupCount && (_warmupFrames[0].dataSize != bufferSize
+                         || _warmupChannels != channels
+                         || _warmupSamplingRate != samplingRate))
+    {
+        log_debug2_m << "Voice format is changed, warm-up frames dropped: "
+                     << _warmupCount;
+        _warmupCount = 0;
+    }
 
-        while (retries++ < 5)
-        {
-            ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
-            toxav_audio_send_frame(_toxav, _sendVoiceFriendNumber,
-                                   (int16_t*)data,
-                                   voiceFrameInfo->sampleCount,
-                                   voiceFrameInfo->channels,
-                                   voiceFrameInfo->samplingRate,
-                                   &err);
-            if (err == TOXAV_ERR_SEND_FRAME_SYNC)
-            {
-                QThread::usleep(500);
-                continue;
-            }
-            break;
-        }
-        if (toxError(err, msgerr))
-        {
-            size_t sampleCount =
-                dataSize / voiceFrameInfo->sampleSize / voiceFrameInfo->channels;
-            log_error_m << "Failed toxav_audio_send_frame: " << msgerr.description
-                        << "; sample count: " << sampleCount
-                        << "; data size: " << dataSize;
-        }
+    log_debug2_m << "Warm-up frame: " << _warmupCount
+                 << "; channels: "  << int(channels)
+                 << "; sample count: "  << sampleCount
+                 << "; sampling rate: " << samplingRate;
+
+    VoiceFrame& frame = _warmupFrames[_warmupCount++];
+    memcpy(frame.data, pcm, bufferSize);
+    frame.dataSize = bufferSize;
+    frame.timestamp = voiceTimestamp();
+    _warmupChannels = channels;
+    _warmupSamplingRate = samplingRate;
+
+    if (_warmupCount < VOICE_WARMUP_FRAMES)
+        return;
+
+    if (!sameFormat(*_voiceFrameInfo))
+    {
+        quint32 latency = quint32(quint64(sampleCount) * 1000000 / samplingRate);
+        VoiceFrameInfo voiceFrameInfo {latency, channels, sampleSize,
+                                       sampleCount, samplingRate, bufferSize};
+        _voiceFrameInfo = VoiceFrameInfo::Ptr::create(voiceFrameInfo);
+
+        log_verbose_m << "Voice stream will be recreated"
+                      << "; channels: "  << int(channels)
+                      << "; sample count: "  << sampleCount
+                      << "; sampling rate: " << samplingRate;
+
+        emit startVoice(_voiceFrameInfo);
     }
+    _dtmfDetector.reset(*_voiceFrameInfo);
+
+    for (int i = 0; i < _warmupCount; ++i)
+        pushVoice(_warmupFrames[i].data, _warmupFrames[i].dataSize,
+                  _warmupFrames[i].timestamp);
+
+    _warmupCount = 0;
+    _voiceReady = true;
 }
 
-void ToxCall::endCalling()
+void ToxCall::pushVoice(const char* data, quint32 dataSize, qint64 timestamp)
 {
-    _sendVoiceFriendNumber = quint32(-1);
+    // Если пул пуст, то поток воспроизведения не успевает забирать данные,
+    // фрейм отбрасывается
+    VoiceFrame* frame = voiceFramePool().acquire();
+    if (frame == nullptr)
+        return;
 
-    log_debug_m << "Record bytes (processed): " << _recordBytes;
-    log_debug_m << "Voice bytes (processed): " << _voiceBytes;
+    memcpy(frame->data, data, dataSize);
+    frame->dataSize = dataSize;
+    frame->timestamp = timestamp;
 
-    _recordBytes = 0;
-    _voiceBytes = 0;
+    if (voiceQueue().push(frame))
+        _voiceBytes += dataSize;
+
+    if (_dtmfDetect)
+        detectDtmf(data, dataSize);
+}
+
+void ToxCall::detectDtmf(const char* pcm, quint32 dataSize)
+{
+    quint32 count = dataSize / (_voiceFrameInfo->sampleSize * _voiceFrameInfo->channels);
+    QString digits = _dtmfDetector.process((const int16_t*)pcm, count);
+
+    for (QChar digit : digits)
+    {
+        log_verbose_m << "DTMF digit received: " << QString(digit)
+                      << "; friend number: " << _callState.friendNumber;
+
+        data::DtmfDigit dtmfDigit;
+        dtmfDigit.friendNumber = _callState.friendNumber;
+        dtmfDigit.digit = QString(digit);
+
+        Message::Ptr m = createMessage(dtmfDigit);
+        emit internalMessage(m);
+        toxConfig().send(m);
+    }
 }
 
-void ToxCall::sendCallState()
+void ToxCall::sendCallState(bool internal)
 {
     //log_debug_m << "Call sendCallState()";
 
     Message::Ptr m = createMessage(_callState);
-    emit internalMessage(m);
+    if (internal)
+        emit internalMessage(m);
     toxConfig().send(m);
 }
 
+void ToxCall::startBitRate()
+{
+    _callState.audioBitRate = _bitRateControl.start();
+    _callState.bitRateReason = _bitRateControl.reason();
+
+    _voiceStat = JitterBuffer::Stat();
+    _bitRateTimer.reset();
+}
+
+void ToxCall::stopBitRate()
+{
+    _bitRateControl.stop();
+    _callState.audioBitRate = 0;
+    _callState.bitRateReason = data::ToxCallState::BitRateReason::Undefined;
+}
+
+void ToxCall::updateBitRate()
+{
+    _bitRateTimer.reset();
+
+    BitRateControl::Network network;
+    { //Block for ToxGlobalLock
+        ToxTimedLock toxGlobalLock {ToxLockStat::CallControl}; (void) toxGlobalLock;
+        TOX_CONNECTION connection = tox_friend_get_connection_status(
+                                        toxav_get_tox(_toxav), _callState.friendNumber, 0);
+        network.tcpRelay = (connection == TOX_CONNECTION_TCP);
+    }
+
+    // Потери оцениваются по доле потерянных и опоздавших фреймов входящего
+    // потока. Паузы в потоке джиттер-буфер потерями не считает, интервалы
+    // без входящих фреймов не оцениваются
+    if (audioDev().voiceActive() && getVoiceFrameInfo())
+    {
+        JitterBuffer::Stat stat = audioDev().voiceStat();
+        quint32 missing = stat.lost + stat.late;
+        quint32 missingPrev = _voiceStat.lost + _voiceStat.late;
+
+        // При перезапуске воспроизведения статистика джиттер-буфера
+        // сбрасывается
+        if (missing >= missingPrev && stat.received >= _voiceStat.received)
+        {
+            quint32 lost = missing - missingPrev;
+            quint32 total = (stat.received - _voiceStat.received) + lost;
+            if (total)
+            {
+                network.voice = true;
+                network.loss = lost * 100 / total;
+                network.jitter = stat.jitter;
+            }
+        }
+        _voiceStat = stat;
+    }
+    else
+        _voiceStat = JitterBuffer::Stat();
+
+    _bitRateControl.update(network);
+}
+
+void ToxCall::applyBitRate()
+{
+    if (_callState.friendNumber == quint32(-1))
+        return;
+
+    quint32 bitRate = _bitRateControl.bitRate();
+    TOXAV_ERR_BIT_RATE_SET err;
+
+    { //Block for ToxGlobalLock
+        ToxTimedLock toxGlobalLock {ToxLockStat::CallControl}; (void) toxGlobalLock;
+#if TOX_VERSION_IS_API_COMPATIBLE(0, 2, 0)
+        toxav_audio_set_bit_rate(_toxav, _callState.friendNumber, bitRate, &err);
+#else
+        toxav_bit_rate_set(_toxav, _callState.friendNumber, int32_t(bitRate), -1, &err);
+#endif
+    }
+    if (err != TOXAV_ERR_BIT_RATE_SET_OK)
+    {
+        log_error_m << "Failed set audio bit rate " << bitRate << " Kb/sec"
+                    << "; error code: " << int(err);
+        return;
+    }
+
+    _callState.audioBitRate = bitRate;
+    _callState.bitRateReason = _bitRateControl.reason();
+
+    // Изменение битрейта не меняет состояния звонка, поэтому внутренним
+    // модулям программы сообщение не отправляется
+    sendCallState(false);
+}
+
 //----------------------------- Tox callback ---------------------------------
 
 void ToxCall::toxav_call_cb(ToxAV* av, uint32_t friend_number,
@@ -551,7 +782,7 @@ void ToxCall::toxav_call_cb(ToxAV* av, uint32_t friend_number,
         data::MessageError msgerr;
 
         { //Block for ToxGlobalLock
-            ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+            ToxTimedLock toxGlobalLock {ToxLockStat::CallControl}; (void) toxGlobalLock;
             toxav_call_control(av, friend_number, TOXAV_CALL_CONTROL_CANCEL, &err);
         }
         if (toxError(err, msgerr))
@@ -672,7 +903,7 @@ void ToxCall::toxav_call_state(ToxAV* av, uint32_t friend_number, uint32_t state
         if (tc->_callState.direction == data::ToxCallState::Direction::Outgoing
             && tc->_callState.callState == data::ToxCallState::CallState::WaitingAnswer)
         {
-            tc->_skipFirstFrames = 0;
+            tc->prepareVoice();
             tc->_callState.callState = data::ToxCallState::CallState::InProgress;
             tc->_callState.callEnd = data::ToxCallState::CallEnd::Undefined;
 
@@ -689,7 +920,7 @@ void ToxCall::toxav_call_state(ToxAV* av, uint32_t friend_number, uint32_t state
                 data::MessageError msgerr;
 
                 { //Block for ToxGlobalLock
-                    ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+                    ToxTimedLock toxGlobalLock {ToxLockStat::CallControl}; (void) toxGlobalLock;
                     toxav_call_control(av, friend_number, TOXAV_CALL_CONTROL_CANCEL, &err);
                 }
                 if (toxError(err, msgerr))
@@ -711,8 +942,7 @@ void ToxCall::toxav_call_state(ToxAV* av, uint32_t friend_number, uint32_t state
     {
         log_debug2_m << "ToxAV event: TOXAV_FRIEND_CALL_STATE_ACCEPTING_A";
 
-        tc->_recordBytes = 0;
-        tc->_sendVoiceFriendNumber = friend_number;
+        voiceSender().startSending(friend_number);
 
         //emit tc->startRecordVoice();
     }
@@ -729,6 +959,10 @@ void ToxCall::toxav_audio_bit_rate(ToxAV* av, uint32_t friend_number,
     log_debug2_m << "toxav_audio_bit_rate()"
                  << "; friend_number: " << friend_number
                  << "; audio_bit_rate: " << audio_bit_rate;
+
+    ToxCall* tc = static_cast<ToxCall*>(user_data);
+    if (tc->_callState.friendNumber == friend_number)
+        tc->_bitRateControl.suggest(audio_bit_rate);
 }
 
 void ToxCall::toxav_video_bit_rate(ToxAV* av, uint32_t friend_number,
@@ -747,6 +981,10 @@ void ToxCall::toxav_bit_rate_status(ToxAV* av, uint32_t friend_number,
                  << "; friend_number: " << friend_number
                  << "; audio_bit_rate: " << audio_bit_rate
                  << "; video_bit_rate: " << video_bit_rate;
+
+    ToxCall* tc = static_cast<ToxCall*>(user_data);
+    if (tc->_callState.friendNumber == friend_number)
+        tc->_bitRateControl.suggest(audio_bit_rate);
 }
 #endif
 
@@ -756,44 +994,7 @@ void ToxCall::toxav_audio_receive_frame(ToxAV* av, uint32_t friend_number,
                                         void* user_data)
 {
     ToxCall* tc = static_cast<ToxCall*>(user_data);
-
-    static quint32 sampleSize {sizeof(int16_t)};
-    quint32 bufferSize = sample_count * sampleSize * channels;
-                         //((latency * sampling_rate) / 1000000) * sampleSize * channels;
-
-    // Пропускаем первые 10 фреймов. Таким образом даем opus-декодеру
-    // возможность перестроиться в правильный режим приема данных.
-    // На 11-м фрейме инициализируем аудио-систему.
-    if (tc->_skipFirstFrames < 10)
-    {
-        log_debug2_m << "Skip frame: " << tc->_skipFirstFrames
-                     << "; friend number: " << friend_number
-                     << "; channels: "  << int(channels)
-                     << "; sample size: "   << sampleSize
-                     << "; sample count: "  << sample_count
-                     << "; sampling rate: " << sampling_rate
-                     << "; buffer size: "   << bufferSize;
-
-        ++tc->_skipFirstFrames;
-        return;
-    }
-
-    if (tc->_skipFirstFrames == 10)
-    {
-        ++tc->_skipFirstFrames;
-        tc->_voiceBytes = 0;
-
-        //quint32 latency = 20000;
-        quint32 latency = (bufferSize * 1000000) / sampling_rate / sampleSize / channels;
-        VoiceFrameInfo voiceFrameInfo {latency, channels, sampleSize,
-                                       quint32(sample_count), sampling_rate, bufferSize};
-
-        emit tc->startVoice(VoiceFrameInfo::Ptr::create(voiceFrameInfo));
-        return;
-    }
-
-    if (voiceRBuff().write((char*)pcm, bufferSize))
-        tc->_voiceBytes += bufferSize;
+    tc->receiveVoice(pcm, quint32(sample_count), channels, sampling_rate);
 }
 
 void ToxCall::toxav_video_receive_frame(ToxAV* av, uint32_t friend_number,
@@ -1,9 +1,13 @@
 #pragma once
 
+#include "bit_rate_control.h"
+#include "tox_reactor.h"
 #include "commands/commands.h"
 #include "commands/error.h"
 
 #include "common/voice_frame.h"
+#include "common/jitter_buffer.h"
+#include "common/dtmf_detector.h"
 #include "toxcore/tox.h"
 #include "toxav/toxav.h"
 
@@ -22,11 +26,20 @@ using namespace std;
 using namespace pproto;
 using namespace pproto::transport;
 
+// Количество подряд полученных фреймов с неизменными параметрами (количество
+// сэмплов, частота дискретизации, количество каналов), после которого
+// opus-декодер считается перестроившимся на входящий поток
+#define VOICE_WARMUP_FRAMES 3
+
 class ToxCall : public QThreadEx
 {
 public:
     bool init(Tox* tox);
 
+    // Пробуждает поток при поступлении пакетов на сокет tox-ядра, если
+    // идет звонок (см. ToxReactor)
+    void wakeOnPacket();
+
 signals:
     // Используется для отправки сообщения в пределах программы
     void internalMessage(const pproto::Message::Ptr&);
@@ -49,9 +62,31 @@ private:
     void command_PlaybackFinish(const Message::Ptr&);
     void command_DiverterHandset(const Message::Ptr&);
 
-    void iterateVoiceFrame();
     void endCalling();
-    void sendCallState();
+
+    // Подготовка потока воспроизведения к приему голоса. Поток создается
+    // с параметрами предыдущего звонка (или параметрами по умолчанию) еще
+    // до получения первого фрейма
+    void prepareVoice();
+
+    // Обработка фрейма, полученного от ToxAV
+    void receiveVoice(const int16_t* pcm, quint32 sampleCount,
+                      quint8 channels, quint32 samplingRate);
+    void pushVoice(const char* data, quint32 dataSize, qint64 timestamp);
+
+    // Поиск DTMF-сигналов во входящем голосовом фрейме, для каждой
+    // обнаруженной цифры отправляется сообщение DtmfDigit
+    void detectDtmf(const char* pcm, quint32 dataSize);
+
+    // Если internal равен FALSE, то состояние звонка отправляется только
+    // в конфигуратор
+    void sendCallState(bool internal = true);
+
+    // Управление битрейтом исходящего голосового потока
+    void startBitRate();
+    void stopBitRate();
+    void updateBitRate();
+    void applyBitRate();
 
 private:
     // Tox callback
@@ -82,21 +117,45 @@ private:
 private:
     ToxAV* _toxav;
     data::ToxCallState _callState;
-    int _skipFirstFrames = {0};
-    atomic<quint32> _sendVoiceFriendNumber = {quint32(-1)};
 
-    size_t _recordBytes = {0};
+    // Параметры фреймов, для которых создан поток воспроизведения
+    VoiceFrameInfo::Ptr _voiceFrameInfo;
+
+    // Признак того, что параметры входящих фреймов совпадают с параметрами
+    // потока воспроизведения и фреймы передаются в voiceQueue() напрямую
+    bool _voiceReady = {false};
+
+    // Фреймы, полученные в период перестройки декодера. Эти фреймы
+    // не отбрасываются, а передаются на воспроизведение после того как
+    // параметры входящего потока стабилизируются
+    VoiceFrame _warmupFrames[VOICE_WARMUP_FRAMES];
+    int     _warmupCount = {0};
+    quint8  _warmupChannels = {0};
+    quint32 _warmupSamplingRate = {0};
+
     size_t _voiceBytes = {0};
 
+    // Детектор DTMF-сигналов входящего голосового потока (параметр
+    // audio.dtmf_detector)
+    bool _dtmfDetect = {true};
+    DtmfDetector _dtmfDetector;
+
     FunctionInvoker _funcInvoker;
 
     Message::List _messages;
     QMutex _threadLock;
     QWaitCondition _threadCond;
 
+    ToxReactor _reactor;
+    std::atomic_bool _callActive = {false};
+
     steady_timer _sendCallStateTimer;
     bool _sendCallStateByTimer = {false};
 
+    BitRateControl _bitRateControl;
+    steady_timer _bitRateTimer;
+    JitterBuffer::Stat _voiceStat;
+
     template<typename T, int> friend T& safe::singleton();
 };
 
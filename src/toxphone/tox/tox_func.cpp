@@ -1,4 +1,5 @@
 #include "tox_func.h"
+#include "tox_lock_stat.h"
 
 #include "toxfunc/tox_func.h"
 #include "toxfunc/tox_logger.h"
@@ -46,7 +47,7 @@ bool sendToxLosslessMessage(Tox* tox, uint32_t friendNumber,
         message->toDataStream(stream);
     }
 
-    ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+    ToxTimedLock toxGlobalLock {ToxLockStat::Message}; (void) toxGlobalLock;
 
     TOX_ERR_FRIEND_CUSTOM_PACKET err;
     pproto::data::MessageError msgerr;
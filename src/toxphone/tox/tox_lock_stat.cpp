@@ -0,0 +1,130 @@
+#include "tox_lock_stat.h"
+#include "common/voice_frame.h"
+
+#include "shared/safe_singleton.h"
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/qt/logger_operators.h"
+
+#define log_error_m   alog::logger().error  (alog_line_location, "ToxLockStat")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "ToxLockStat")
+#define log_info_m    alog::logger().info   (alog_line_location, "ToxLockStat")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "ToxLockStat")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "ToxLockStat")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "ToxLockStat")
+
+static const char* siteNames[ToxLockStat::SiteCount] =
+{
+    "net_iterate", "net_command", "voice_send", "call_control", "message"
+};
+
+// Порог медленного ожидания захвата блокировки (в микросекундах)
+static const quint32 slowWaitThreshold = 1000;
+
+static void updateMax(std::atomic<quint32>& max, quint32 value)
+{
+    // Место захвата может использоваться несколькими потоками
+    quint32 current = max.load(std::memory_order_relaxed);
+    while (value > current
+           && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {}
+}
+
+static quint32 toValue(qint64 time)
+{
+    return quint32(qBound(qint64(0), time, qint64(quint32(-1))));
+}
+
+ToxLockStat& toxLockStat()
+{
+    return safe::singleton<ToxLockStat, 0>();
+}
+
+const char* ToxLockStat::siteName(Site site)
+{
+    return siteNames[site];
+}
+
+void ToxLockStat::add(Site site, qint64 wait, qint64 hold)
+{
+    quint32 waitValue = toValue(wait);
+    quint32 holdValue = toValue(hold);
+
+    Counters& c = _counters[site];
+    c.count.fetch_add(1, std::memory_order_relaxed);
+    c.waitSum.fetch_add(waitValue, std::memory_order_relaxed);
+    c.holdSum.fetch_add(holdValue, std::memory_order_relaxed);
+    if (waitValue > slowWaitThreshold)
+        c.slowWaits.fetch_add(1, std::memory_order_relaxed);
+
+    updateMax(c.waitMax, waitValue);
+    updateMax(c.holdMax, holdValue);
+}
+
+QVector<ToxLockStat::Stat> ToxLockStat::stat(bool reset)
+{
+    auto take = [reset](auto& counter)
+    {
+        return (reset) ? counter.exchange(0, std::memory_order_relaxed)
+                       : counter.load(std::memory_order_relaxed);
+    };
+
+    QVector<Stat> result;
+    result.reserve(SiteCount);
+
+    for (int i = 0; i < SiteCount; ++i)
+    {
+        Counters& c = _counters[i];
+
+        Stat stat;
+        stat.name = siteNames[i];
+        stat.count = take(c.count);
+        stat.slowWaits = take(c.slowWaits);
+        stat.waitMax = take(c.waitMax);
+        stat.holdMax = take(c.holdMax);
+
+        quint64 waitSum = take(c.waitSum);
+        quint64 holdSum = take(c.holdSum);
+        if (stat.count)
+        {
+            stat.waitAvg = quint32(waitSum / stat.count);
+            stat.holdAvg = quint32(holdSum / stat.count);
+        }
+        result.append(stat);
+    }
+    return result;
+}
+
+void ToxLockStat::log()
+{
+    QVector<Stat> stats = stat(true);
+
+    log_debug_m << "ToxGlobalLock summary (us)";
+    for (const Stat& st : stats)
+    {
+        if (st.count == 0)
+            continue;
+
+        log_debug_m << "  " << st.name
+                    << ": locks " << st.count
+                    << "; wait avg " << st.waitAvg
+                    << "; wait max " << st.waitMax
+                    << "; slow waits " << st.slowWaits
+                    << "; hold avg " << st.holdAvg
+                    << "; hold max " << st.holdMax;
+    }
+}
+
+ToxTimedLock::ToxTimedLock(ToxLockStat::Site site)
+    : _site(site),
+      _begin(voiceTimestamp()),
+      _lock(),
+      _acquired(voiceTimestamp())
+{}
+
+ToxTimedLock::~ToxTimedLock()
+{
+    // Блокировка освобождается после выхода из деструктора (при разрушении
+    // поля _lock), время освобождения в удержание не входит
+    toxLockStat().add(_site, _acquired - _begin, voiceTimestamp() - _acquired);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "toxfunc/tox_func.h"
+#include "shared/defmac.h"
+
+#include <QtCore>
+#include <atomic>
+
+/**
+  Статистика захвата глобальной блокировки tox-ядра (ToxGlobalLock).
+  Для каждого места захвата накапливаются время ожидания захвата и время
+  удержания блокировки (в микросекундах). Значения добавляются из разных
+  потоков без блокировок (атомарные счетчики).
+*/
+class ToxLockStat
+{
+public:
+    enum Site
+    {
+        NetIterate  = 0, // tox_iterate() в потоке ToxNet
+        NetCommand  = 1, // Прочие вызовы tox-функций в потоке ToxNet
+        VoiceSend   = 2, // Отправка голосовых фреймов (toxav_audio_send_frame)
+        CallControl = 3, // Управление звонком в потоке ToxCall
+        Message     = 4, // Отправка пользовательских tox-сообщений
+        SiteCount
+    };
+
+    struct Stat
+    {
+        const char* name = {nullptr};
+        quint32 count   = {0}; // Количество захватов
+        quint32 waitAvg = {0}; // Время ожидания захвата
+        quint32 waitMax = {0};
+        quint32 holdAvg = {0}; // Время удержания блокировки
+        quint32 holdMax = {0};
+        quint32 slowWaits = {0}; // Количество ожиданий дольше 1 мс
+    };
+
+    ToxLockStat() = default;
+
+    static const char* siteName(Site);
+
+    void add(Site, qint64 wait, qint64 hold);
+
+    // Снимок статистики. Если reset равен TRUE, то статистика сбрасывается
+    QVector<Stat> stat(bool reset);
+
+    // Выводит статистику в лог (уровень debug) и сбрасывает ее
+    void log();
+
+private:
+    DISABLE_DEFAULT_COPY(ToxLockStat)
+
+    struct Counters
+    {
+        std::atomic<quint32> count = {0};
+        std::atomic<quint32> slowWaits = {0};
+        std::atomic<quint64> waitSum = {0};
+        std::atomic<quint64> holdSum = {0};
+        std::atomic<quint32> waitMax = {0};
+        std::atomic<quint32> holdMax = {0};
+    };
+
+    Counters _counters[SiteCount];
+};
+
+ToxLockStat& toxLockStat();
+
+/**
+  Захват ToxGlobalLock с измерением времени ожидания и удержания блокировки.
+  Используется вместо ToxGlobalLock в местах, перечисленных в ToxLockStat::Site.
+*/
+class ToxTimedLock
+{
+public:
+    explicit ToxTimedLock(ToxLockStat::Site);
+    ~ToxTimedLock();
+
+private:
+    DISABLE_DEFAULT_COPY(ToxTimedLock)
+
+    // Порядок полей важен: время захвата измеряется до и после
+    // инициализации _lock
+    const ToxLockStat::Site _site;
+    const qint64 _begin;
+    ToxGlobalLock _lock;
+    const qint64 _acquired;
+};
@@ -1,5 +1,8 @@
 #include "tox/tox_net.h"
+#include "tox/tox_call.h"
 #include "tox/tox_func.h"
+#include "tox/tox_lock_stat.h"
+#include "tox/voice_sender.h"
 
 #include "toxfunc/tox_func.h"
 #include "toxfunc/tox_logger.h"
@@ -7,7 +10,9 @@
 #include "toxfunc/pproto_error.h"
 
 #include "common/defines.h"
+#include "common/voice_frame.h"
 #include "common/functions.h"
+#include "common/realtime.h"
 
 #include "shared/break_point.h"
 #include "shared/logger/logger.h"
@@ -309,7 +314,7 @@ bool ToxNet::saveState()
 {
     QByteArray data;
     { //Block for ToxGlobalLock
-        ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+        ToxTimedLock toxGlobalLock {ToxLockStat::NetCommand}; (void) toxGlobalLock;
         size_t size = tox_get_savedata_size(_tox);
         data.resize(size);
         tox_get_savedata(_tox, (uint8_t*)data.constData());
@@ -481,7 +486,7 @@ bool ToxNet::setUserProfile(const QString& name, const QString& status)
     QByteArray userName = name.toUtf8();
     QByteArray userStatus = status.toUtf8();
 
-    ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+    ToxTimedLock toxGlobalLock {ToxLockStat::NetCommand}; (void) toxGlobalLock;
 
     if (!tox_self_set_name(_tox, (const uint8_t*)userName.constData(), userName.length(), 0))
     {
@@ -499,11 +504,15 @@ bool ToxNet::setUserProfile(const QString& name, const QString& status)
 void ToxNet::run()
 {
     log_info_m << "Started";
+    realtimeSetupThread("tox_net");
 
     Message::List messages;
     steady_timer iterationTimer;
     int iterationSleepTime;
     int updateBootstrapAttempt = 0;
+    bool packetReceived = false;
+
+    initReactor();
 
     while (true)
     {
@@ -526,10 +535,21 @@ void ToxNet::run()
         }
 
         { //Block for ToxGlobalLock
-            ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+            ToxTimedLock toxGlobalLock {ToxLockStat::NetIterate}; (void) toxGlobalLock;
             tox_iterate(_tox, this);
         }
 
+        // Голосовые фреймы, поступившие во время выполнения tox_iterate()
+        sendVoice();
+
+        // Голосовые пакеты, принятые в tox_iterate(), декодируются в потоке
+        // ToxCall, поэтому во время звонка он пробуждается сразу
+        if (packetReceived)
+        {
+            packetReceived = false;
+            toxCall().wakeOnPacket();
+        }
+
         if (tox_self_get_connection_status(_tox) != TOX_CONNECTION_NONE)
         {
             _updateBootstrapCounter = 0;
@@ -572,16 +592,48 @@ void ToxNet::run()
         if (!messages.empty())
             continue;
 
-        iterationSleepTime -= iterationTimer.elapsed();
-        if (iterationSleepTime > 0)
+        // Ожидание следующей итерации. Голосовые фреймы (см. wakeVoice())
+        // отправляются сразу после поступления, без вызова tox_iterate()
+        while (true)
         {
-            QMutexLocker locker(&_threadLock); (void) locker;
-            if (!_messages.empty())
-                continue;
-            _threadCond.wait(&_threadLock, iterationSleepTime);
+            // Если ToxAV был занят в потоке ToxCall (TOXAV_ERR_SEND_FRAME_SYNC),
+            // отправка фрейма повторяется при следующем пробуждении потока:
+            // по поступлению нового фрейма, сообщения или пакета
+            int sleepTime = iterationSleepTime - int(iterationTimer.elapsed());
+            if (sleepTime <= 0)
+                break;
+
+            if (_reactor.active())
+            {
+                { //Block for QMutexLocker
+                    QMutexLocker locker(&_threadLock); (void) locker;
+                    if (!_messages.empty())
+                        break;
+                }
+                if (_reactor.wait(sleepTime) & ToxReactor::Socket)
+                {
+                    packetReceived = true;
+                    break;
+                }
+            }
+            else
+            {
+                QMutexLocker locker(&_threadLock); (void) locker;
+                if (!_messages.empty())
+                    break;
+
+                // Фрейм мог поступить после вызова sendVoice(), но до захвата
+                // _threadLock: сигнал wakeVoice() в этом случае уже отправлен,
+                // поэтому ожидание не выполняется
+                if (!_voiceWake)
+                    _threadCond.wait(&_threadLock, sleepTime);
+                _voiceWake = false;
+            }
+            sendVoice();
         }
     } // while (true)
 
+    _reactor.deinit();
     saveState();
     if (_tox)
         tox_kill(_tox);
@@ -603,7 +655,75 @@ void ToxNet::message(const pproto::Message::Ptr& message)
         QMutexLocker locker(&_threadLock); (void) locker;
         _messages.add(message.get());
         _threadCond.wakeAll();
+        _reactor.wake();
+    }
+}
+
+void ToxNet::wakeVoice()
+{
+    QMutexLocker locker(&_threadLock); (void) locker;
+    _voiceWake = true;
+    _threadCond.wakeAll();
+    _reactor.wake();
+}
+
+void ToxNet::sendVoice()
+{
+    // Кодирование голоса (toxav_audio_send_frame) выполняется в этом потоке,
+    // поэтому его загрузка учитывается при подстройке частоты процессора
+    if (_encodeLoadTimer.elapsed() > 1000)
+    {
+        powerPolicy().setAudioLoad(PowerPolicy::EncoderThread, _encodeLoad.measure());
+        _encodeLoadTimer.reset();
+    }
+
+    if (sendQueue().empty())
+        return;
+
+    ToxTimedLock toxGlobalLock {ToxLockStat::VoiceSend}; (void) toxGlobalLock;
+    _encodeLoad.begin();
+    voiceSender().sendQueued();
+    _encodeLoad.end();
+}
+
+void ToxNet::initReactor()
+{
+    bool reactor = true;
+    config::base().getValue("tox_core.reactor", reactor);
+    if (!reactor)
+    {
+        log_info_m << "Timed iteration loop is used (reactor is disabled)";
+        return;
+    }
+
+    // Реактор используется только если UDP-сокет tox-ядра определен
+    // однозначно. В остальных случаях поток ожидает следующей итерации
+    // на _threadCond, как при отключенном реакторе
+    TOX_ERR_GET_PORT err;
+    quint16 port = tox_self_get_udp_port(_tox, &err);
+    if (err != TOX_ERR_GET_PORT_OK)
+    {
+        // Например, если UDP отключен (tox_core.options.udp_enabled)
+        log_info_m << "Timed iteration loop is used (UDP of tox core is disabled)";
+        return;
+    }
+
+    int fd = ToxReactor::findUdpSocket(port);
+    if (fd < 0)
+    {
+        log_info_m << "Timed iteration loop is used"
+                   << " (UDP socket of tox core is not found; udp port: " << port << ")";
+        return;
+    }
+
+    if (!_reactor.init() || !_reactor.addSocket(fd))
+    {
+        _reactor.deinit();
+        log_info_m << "Timed iteration loop is used (failed init reactor)";
+        return;
     }
+    log_info_m << "Reactor mode is used"
+               << "; udp port: " << port << "; socket: " << fd;
 }
 
 void ToxNet::command_IncomingConfigConnection(const Message::Ptr& message)
@@ -762,7 +882,7 @@ void ToxNet::command_RequestFriendship(const Message::Ptr& message)
 
     QByteArray msg = friendMessage.toUtf8();
     { //Block for ToxGlobalLock
-        ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+        ToxTimedLock toxGlobalLock {ToxLockStat::NetCommand}; (void) toxGlobalLock;
         friendNum = tox_friend_add(_tox, (uint8_t*)friendIdBin.constData(),
                                    (uint8_t*)msg.constData(), msg.length(), 0);
     }
@@ -804,7 +924,7 @@ void ToxNet::command_FriendRequest(const Message::Ptr& message)
         QByteArray pubKey = QByteArray::fromHex(publicKey);
         uint32_t friendNum;
         { //Block for ToxGlobalLock
-            ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+            ToxTimedLock toxGlobalLock {ToxLockStat::NetCommand}; (void) toxGlobalLock;
             friendNum = tox_friend_add_norequest(_tox, (uint8_t*)pubKey.constData(), 0);
         }
         if (friendNum != UINT32_MAX)
@@ -855,7 +975,7 @@ void ToxNet::command_RemoveFriend(const Message::Ptr& message)
         QString friendName = getToxFriendName(_tox, friendNum);
         bool result;
         { //Block for ToxGlobalLock
-            ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+            ToxTimedLock toxGlobalLock {ToxLockStat::NetCommand}; (void) toxGlobalLock;
             result = tox_friend_delete(_tox, friendNum, 0);
         }
         if (result)
@@ -1130,7 +1250,7 @@ bool ToxNet::fillFriendItem(data::FriendItem& item, uint32_t friendNumber)
     item.statusMessage = getToxFriendStatusMsg(_tox, friendNumber);
 
     { //Block for ToxGlobalLock
-        ToxGlobalLock toxGlobalLock; (void) toxGlobalLock;
+        ToxTimedLock toxGlobalLock {ToxLockStat::NetCommand}; (void) toxGlobalLock;
         TOX_CONNECTION connection_status =
             tox_friend_get_connection_status(_tox, friendNumber, 0);
         item.isConnecnted = (connection_status != TOX_CONNECTION_NONE);
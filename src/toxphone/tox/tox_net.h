@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include "tox_reactor.h"
+#include "common/power_policy.h"
 #include "commands/commands.h"
 #include "commands/error.h"
 
@@ -31,6 +33,10 @@ public:
 
     Tox* tox() const {return _tox;}
 
+    // Пробуждает поток для отправки голосовых фреймов из очереди sendQueue().
+    // Вызывается потоком VoiceSender
+    void wakeVoice();
+
 signals:
     // Используется для отправки сообщения в пределах программы
     void internalMessage(const pproto::Message::Ptr&);
@@ -44,6 +50,12 @@ private:
     ToxNet();
 
     void run() override;
+
+    // Регистрирует UDP-сокет tox-ядра в реакторе
+    void initReactor();
+
+    // Отправляет голосовые фреймы из очереди sendQueue()
+    void sendVoice();
     void updateBootstrap();
     bool saveState();
     bool saveAvatar(const QByteArray& avatar, const QString& avatarFile);
@@ -166,6 +178,19 @@ private:
     QMutex _threadLock;
     QWaitCondition _threadCond;
 
+    // Признак поступления голосовых фреймов (см. wakeVoice()), защищен
+    // _threadLock. Используется, когда реактор не активен
+    bool _voiceWake = {false};
+
+    // Ожидание входящих пакетов на UDP-сокете tox-ядра (параметр
+    // tox_core.reactor)
+    ToxReactor _reactor;
+
+    // Загрузка потока кодированием голоса (см. sendVoice()), передается
+    // в PowerPolicy раз в секунду
+    SectionLoad _encodeLoad;
+    steady_timer _encodeLoadTimer;
+
     template<typename T, int> friend T& safe::singleton();
 };
 
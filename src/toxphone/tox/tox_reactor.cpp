@@ -0,0 +1,209 @@
+#include "tox_reactor.h"
+
+#include "shared/spin_locker.h"
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/qt/logger_operators.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define log_error_m   alog::logger().error  (alog_line_location, "ToxReactor")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "ToxReactor")
+#define log_info_m    alog::logger().info   (alog_line_location, "ToxReactor")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "ToxReactor")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "ToxReactor")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "ToxReactor")
+
+ToxReactor::~ToxReactor()
+{
+    deinit();
+}
+
+bool ToxReactor::init()
+{
+    deinit();
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+    {
+        log_error_m << "Failed call epoll_create1(): " << strerror(errno);
+        return false;
+    }
+
+    _timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    { //Block for SpinLocker
+        SpinLocker locker(_eventLock); (void) locker;
+        _eventFd = eventFd;
+    }
+    if (_timerFd < 0 || eventFd < 0)
+    {
+        log_error_m << "Failed create timerfd/eventfd: " << strerror(errno);
+        deinit();
+        return false;
+    }
+
+    if (!addSocket(_timerFd) || !addSocket(eventFd))
+    {
+        deinit();
+        return false;
+    }
+    return true;
+}
+
+void ToxReactor::deinit()
+{
+    if (_epollFd >= 0)
+        close(_epollFd);
+    if (_timerFd >= 0)
+        close(_timerFd);
+
+    _epollFd = -1;
+    _timerFd = -1;
+
+    // Дескриптор закрывается под блокировкой: wake() из другого потока
+    // не должен писать в закрытый или повторно выделенный дескриптор
+    SpinLocker locker(_eventLock); (void) locker;
+    if (_eventFd >= 0)
+        close(_eventFd);
+    _eventFd = -1;
+}
+
+bool ToxReactor::addSocket(int fd)
+{
+    // Edge-triggered режим: сокеты вычитываются tox-ядром, поток должен
+    // просыпаться только при поступлении новых данных
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = fd;
+
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        log_error_m << "Failed call epoll_ctl() for descriptor " << fd
+                    << ": " << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+int ToxReactor::wait(int timeout)
+{
+    if (timeout <= 0)
+        return Timeout;
+
+    itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = timeout / 1000;
+    spec.it_value.tv_nsec = (timeout % 1000) * 1000000;
+    timerfd_settime(_timerFd, 0, &spec, nullptr);
+
+    int result = Timeout;
+    epoll_event events[8];
+    int count = epoll_wait(_epollFd, events, 8, -1);
+    for (int i = 0; i < count; ++i)
+    {
+        uint64_t value;
+        if (events[i].data.fd == _timerFd)
+        {
+            // EAGAIN: таймер был сброшен до чтения (см. конец функции)
+            if (read(_timerFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                log_error_m << "Failed read timerfd: " << strerror(errno);
+        }
+        else if (events[i].data.fd == _eventFd)
+        {
+            if (read(_eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                log_error_m << "Failed read eventfd: " << strerror(errno);
+            result |= Wake;
+        }
+        else
+            result |= Socket;
+    }
+
+    // Сбрасываем таймер, если пробуждение произошло раньше срока
+    memset(&spec, 0, sizeof(spec));
+    timerfd_settime(_timerFd, 0, &spec, nullptr);
+    return result;
+}
+
+void ToxReactor::wake()
+{
+    SpinLocker locker(_eventLock); (void) locker;
+    if (_eventFd < 0)
+        return;
+
+    // EAGAIN означает переполнение счетчика eventfd: поток уже разбужен
+    uint64_t value = 1;
+    if (write(_eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        log_error_m << "Failed write eventfd: " << strerror(errno);
+}
+
+int ToxReactor::findUdpSocket(quint16 port)
+{
+#ifdef __linux__
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir == nullptr)
+        return -1;
+
+    int result = -1;
+    while (dirent* entry = readdir(dir))
+    {
+        char* end;
+        long fd = strtol(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != '\0')
+            continue;
+
+        struct stat st;
+        if (fstat(int(fd), &st) < 0 || !S_ISSOCK(st.st_mode))
+            continue;
+
+        int type = 0;
+        socklen_t typeLen = sizeof(type);
+        if (getsockopt(int(fd), SOL_SOCKET, SO_TYPE, &type, &typeLen) < 0
+            || type != SOCK_DGRAM)
+        {
+            continue;
+        }
+
+        sockaddr_storage addr;
+        socklen_t addrLen = sizeof(addr);
+        if (getsockname(int(fd), (sockaddr*)&addr, &addrLen) < 0)
+            continue;
+
+        quint16 sockPort = 0;
+        if (addr.ss_family == AF_INET)
+            sockPort = ntohs(((sockaddr_in*)&addr)->sin_port);
+        else if (addr.ss_family == AF_INET6)
+            sockPort = ntohs(((sockaddr_in6*)&addr)->sin6_port);
+
+        if (sockPort != port)
+            continue;
+
+        // Несколько сокетов на одном порту (например, SO_REUSEPORT):
+        // сокет tox-ядра однозначно не определен
+        if (result >= 0)
+        {
+            log_warn_m << "Several UDP sockets are bound to port " << port
+                       << " (descriptors " << result << ", " << int(fd) << ")";
+            result = -1;
+            break;
+        }
+        result = int(fd);
+    }
+    closedir(dir);
+    return result;
+#else
+    (void) port;
+    return -1;
+#endif
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "shared/defmac.h"
+#include <QtCore>
+#include <atomic>
+
+/**
+  Ожидание событий для циклов tox_iterate()/toxav_iterate() на основе epoll.
+  Поток просыпается в одном из случаев:
+    - на зарегистрированный сокет поступили данные (addSocket());
+    - вызвана функция wake() (например, поступило сообщение для потока);
+    - истек интервал итерации, заданный в wait() (timerfd).
+
+  Таким образом входящие пакеты обрабатываются сразу после поступления,
+  а не по истечении интервала итерации.
+
+  Функции init(), deinit(), addSocket() и wait() вызываются из потока,
+  владеющего реактором, wake() - из любого потока. Запись в eventfd
+  и закрытие дескриптора выполняются под блокировкой, поэтому wake() может
+  вызываться и во время/после deinit().
+*/
+class ToxReactor
+{
+public:
+    ToxReactor() = default;
+    ~ToxReactor();
+
+    bool init();
+    void deinit();
+
+    bool active() const {return (_epollFd >= 0);}
+
+    // Регистрирует сокет для ожидания входящих данных
+    bool addSocket(int fd);
+
+    // Причины пробуждения потока (битовые флаги)
+    enum Event
+    {
+        Timeout = 0x00, // Истек интервал ожидания
+        Socket  = 0x01, // На сокет поступили данные
+        Wake    = 0x02  // Вызвана функция wake()
+    };
+
+    // Ожидает события не дольше timeout (в миллисекундах). Возвращает
+    // комбинацию флагов Event
+    int wait(int timeout);
+
+    void wake();
+
+    // Поиск UDP-сокета tox-ядра по номеру порта (tox_self_get_udp_port()).
+    // Публичное API toxcore не предоставляет дескрипторы сокетов, поэтому
+    // сокет ищется среди открытых дескрипторов процесса (/proc/self/fd,
+    // только Linux). Возвращает -1, если сокет не найден или найдено
+    // несколько сокетов на этом порту
+    static int findUdpSocket(quint16 port);
+
+private:
+    DISABLE_DEFAULT_COPY(ToxReactor)
+
+    int _epollFd = {-1};
+    int _timerFd = {-1};
+    int _eventFd = {-1};
+    std::atomic_flag _eventLock = ATOMIC_FLAG_INIT;
+};
@@ -0,0 +1,320 @@
+#include "voice_sender.h"
+
+#include "toxphone_appl.h"
+#include "tox_net.h"
+#include "tox_lock_stat.h"
+#include "common/defines.h"
+#include "common/voice_latency.h"
+#include "common/functions.h"
+#include "common/realtime.h"
+#include "toxfunc/tox_func.h"
+#include "toxfunc/tox_error.h"
+
+#include "commands/error.h"
+
+#include "shared/logger/logger.h"
+#include "shared/logger/format.h"
+#include "shared/config/appl_conf.h"
+#include "shared/qt/logger_operators.h"
+
+#include "pproto/commands/pool.h"
+
+#include <string>
+
+using namespace std;
+using namespace pproto;
+
+#define log_error_m   alog::logger().error  (alog_line_location, "VoiceSender")
+#define log_warn_m    alog::logger().warn   (alog_line_location, "VoiceSender")
+#define log_info_m    alog::logger().info   (alog_line_location, "VoiceSender")
+#define log_verbose_m alog::logger().verbose(alog_line_location, "VoiceSender")
+#define log_debug_m   alog::logger().debug  (alog_line_location, "VoiceSender")
+#define log_debug2_m  alog::logger().debug2 (alog_line_location, "VoiceSender")
+
+VoiceSender& voiceSender()
+{
+    return safe::singleton<VoiceSender, 0>();
+}
+
+void VoiceSender::wake()
+{
+    QMutexLocker locker(&_threadLock); (void) locker;
+    _threadCond.wakeAll();
+}
+
+void VoiceSender::startSending(quint32 friendNumber)
+{
+    _friendNumber = friendNumber;
+    wake();
+}
+
+void VoiceSender::stopSending()
+{
+    _friendNumber = quint32(-1);
+    wake();
+}
+
+void VoiceSender::run()
+{
+    log_info_m << "Started";
+    realtimeSetupThread("voice_sender");
+
+    int vadKeepalive = 400;
+    config::base().getValue("audio.vad.keepalive", vadKeepalive);
+    _vadKeepalive = quint32(qMax(vadKeepalive, 0));
+
+    string backlogPolicy = "drop_oldest";
+    config::base().getValue("audio.voice_sender.backlog_policy", backlogPolicy);
+    if (backlogPolicy != "drop_oldest" && backlogPolicy != "send_all")
+    {
+        log_error_m << "Unknown backlog policy: " << backlogPolicy
+                    << ". Will be used policy: drop_oldest";
+        backlogPolicy = "drop_oldest";
+    }
+    _dropOldest = (backlogPolicy == "drop_oldest");
+
+    int maxLatency = 100;
+    config::base().getValue("audio.voice_sender.max_latency", maxLatency);
+    _maxLatency = quint32(qMax(maxLatency, 0)) * 1000;
+
+    log_verbose_m << "Backlog policy: " << backlogPolicy
+                  << "; max latency: " << maxLatency << " ms";
+
+    quint32 prevFriendNumber = quint32(-1);
+
+    while (true)
+    {
+        CHECK_THREAD_STOP
+
+        const quint32 friendNumber = _friendNumber;
+        if (friendNumber != prevFriendNumber)
+        {
+            if (prevFriendNumber != quint32(-1))
+            {
+                sendStat();
+                sendLatency(true);
+            }
+            else
+            {
+                // Задержки накапливаются с начала звонка
+                voiceLatency().stat(true);
+                _latencyTimer.reset();
+            }
+            prevFriendNumber = friendNumber;
+        }
+
+        // За одно пробуждение обрабатывается вся накопленная очередь
+        quint32 backlog = recordQueue_2().count();
+        if (friendNumber != quint32(-1) && backlog > _sendStat.maxBacklog)
+            _sendStat.maxBacklog = backlog;
+
+        bool framesQueued = false;
+        while (VoiceFrame* frame = recordQueue_2().pop())
+        {
+            if (friendNumber == quint32(-1))
+            {
+                frame->dataSize = 0;
+            }
+            // Устаревшие фреймы отбрасываются, чтобы однократная задержка
+            // отправки не увеличивала задержку до конца звонка. Последний
+            // фрейм очереди отправляется всегда
+            else if (_dropOldest && frame->dataSize != 0 && !recordQueue_2().empty()
+                     && voiceTimestamp() - frame->timestamp > qint64(_maxLatency))
+            {
+                ++_sendStat.dropped;
+                frame->dataSize = 0;
+            }
+            else if (frame->dataSize != 0 && silenceFrame(frame))
+            {
+                ++_sendStat.suppressed;
+                frame->dataSize = 0;
+            }
+            _recordBytes += frame->dataSize;
+
+            // Фрейм передается в очередь без копирования, даже если он не
+            // будет отправлен (dataSize == 0): фреймы записи возвращаются
+            // в recordFramePool() только потоком ToxNet. Емкость sendQueue
+            // не меньше размера пула, поэтому очередь не переполняется
+            sendQueue().push(frame);
+            framesQueued = true;
+        }
+        if (framesQueued)
+            toxNet().wakeVoice();
+
+        if (friendNumber != quint32(-1) && _latencyTimer.elapsed() > 1000)
+        {
+            sendLatency(false);
+            _latencyTimer.reset();
+        }
+
+        // Ожидание ограничено по времени только для проверки признака
+        // остановки потока, фреймы поступают через wake()
+        QMutexLocker locker(&_threadLock); (void) locker;
+        if (recordQueue_2().empty() && _friendNumber == friendNumber && !threadStop())
+            _threadCond.wait(&_threadLock, 100);
+    }
+
+    while (VoiceFrame* frame = recordQueue_2().pop())
+    {
+        frame->dataSize = 0;
+        sendQueue().push(frame);
+    }
+    toxNet().wakeVoice();
+
+    if (prevFriendNumber != quint32(-1))
+    {
+        sendStat();
+        sendLatency(true);
+    }
+
+    log_info_m << "Stopped";
+}
+
+bool VoiceSender::silenceFrame(const VoiceFrame* frame)
+{
+    VoiceFrameInfo::Ptr voiceFrameInfo = getRecordFrameInfo();
+    if (voiceFrameInfo.empty())
+        return false;
+
+    // Во время пауз в речи (см. ступень vad цепочки фильтров) фреймы не
+    // передаются, за исключением одного фрейма в интервале keepalive.
+    // Это снижает нагрузку на кодек и объем исходящего трафика, а на
+    // принимающей стороне паузы заполняются комфортным шумом
+    if (frame->speech)
+    {
+        _silenceDuration = 0;
+        return false;
+    }
+    if (_silenceDuration < _vadKeepalive)
+    {
+        size_t sampleCount =
+            frame->dataSize / voiceFrameInfo->sampleSize / voiceFrameInfo->channels;
+        _silenceDuration += quint32(sampleCount * 1000 / voiceFrameInfo->samplingRate);
+        return true;
+    }
+    _silenceDuration = 0;
+    return false;
+}
+
+void VoiceSender::sendQueued()
+{
+    while (VoiceFrame* frame = sendQueue().front())
+    {
+        const quint32 friendNumber = _friendNumber;
+        VoiceFrameInfo::Ptr voiceFrameInfo = getRecordFrameInfo();
+
+        // Если звонок завершен, фреймы из очереди отбрасываются. Пустые
+        // фреймы (см. run()) только возвращаются в пул
+        if (friendNumber != quint32(-1) && frame->dataSize != 0
+            && !voiceFrameInfo.empty())
+        {
+            size_t sampleCount =
+                frame->dataSize / voiceFrameInfo->sampleSize / voiceFrameInfo->channels;
+
+            TOXAV_ERR_SEND_FRAME err;
+            toxav_audio_send_frame(_toxav, friendNumber,
+                                   (int16_t*)frame->data,
+                                   sampleCount,
+                                   voiceFrameInfo->channels,
+                                   voiceFrameInfo->samplingRate,
+                                   &err);
+
+            // Мьютекс ToxAV захвачен в toxav_iterate(), фрейм остается
+            // в очереди до следующего пробуждения потока ToxNet
+            if (err == TOXAV_ERR_SEND_FRAME_SYNC)
+            {
+                ++_sendBusy;
+                return;
+            }
+
+            data::MessageError msgerr;
+            if (toxError(err, msgerr))
+            {
+                log_error_m << "Failed toxav_audio_send_frame: " << msgerr.description
+                            << "; sample count: " << sampleCount
+                            << "; data size: " << frame->dataSize;
+            }
+            else
+            {
+                ++_sentFrames;
+                qint64 timestamp = voiceTimestamp();
+                qint64 latency = timestamp - frame->timestamp;
+                if (latency > qint64(_sentMaxLatency))
+                    _sentMaxLatency = quint32(latency);
+
+                voiceLatency().add(VoiceLatency::FilterToSend, timestamp - frame->filterOut);
+                voiceLatency().add(VoiceLatency::CaptureToSend, latency);
+            }
+        }
+        recordFramePool().release(sendQueue().pop());
+    }
+}
+
+void VoiceSender::sendStat()
+{
+    _sendStat.sent = _sentFrames.exchange(0);
+    _sendStat.maxLatency = _sentMaxLatency.exchange(0);
+
+    log_debug_m << "Record bytes (processed): " << _recordBytes;
+    log_debug_m << "Record frames sent: "      << _sendStat.sent
+                << "; suppressed (VAD): "      << _sendStat.suppressed
+                << "; dropped (backlog): "     << _sendStat.dropped
+                << "; max backlog: "           << _sendStat.maxBacklog
+                << "; max latency (us): "      << _sendStat.maxLatency
+                << "; toxav busy retries: "    << _sendBusy.exchange(0);
+
+    // Время ожидания и удержания ToxGlobalLock за время звонка
+    toxLockStat().log();
+
+    if (toxConfig().isActive())
+    {
+        Message::Ptr m = createMessage(_sendStat);
+        toxConfig().send(m);
+    }
+
+    _recordBytes = 0;
+    _silenceDuration = 0;
+    _sendStat = data::VoiceSendStat();
+}
+
+void VoiceSender::sendLatency(bool summary)
+{
+    QVector<VoiceLatency::Stat> stat = voiceLatency().stat(summary);
+
+    if (summary)
+    {
+        log_debug_m << "Voice latency summary (us)";
+        for (const VoiceLatency::Stat& st : stat)
+            log_debug_m << "  " << st.name
+                        << ": frames " << st.count
+                        << "; avg " << st.avg
+                        << "; p50 " << st.p50
+                        << "; p95 " << st.p95
+                        << "; p99 " << st.p99
+                        << "; max " << st.max;
+    }
+
+    if (toxConfig().isActive())
+    {
+        data::VoiceLatency latency;
+        for (int i = 0; i < VOICE_LATENCY_BUCKETS; ++i)
+            latency.bounds.append(VoiceLatency::bucketBounds()[i]);
+
+        for (const VoiceLatency::Stat& st : stat)
+        {
+            data::VoiceLatency::Segment segment;
+            segment.name  = st.name;
+            segment.count = st.count;
+            segment.avg   = st.avg;
+            segment.max   = st.max;
+            segment.p50   = st.p50;
+            segment.p95   = st.p95;
+            segment.p99   = st.p99;
+            for (int i = 0; i < VOICE_LATENCY_BUCKETS; ++i)
+                segment.histogram.append(st.histogram[i]);
+            latency.segments.append(segment);
+        }
+        Message::Ptr m = createMessage(latency);
+        toxConfig().send(m);
+    }
+}
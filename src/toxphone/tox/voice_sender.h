@@ -0,0 +1,85 @@
+#pragma once
+
+#include "common/voice_frame.h"
+#include "commands/commands.h"
+#include "toxav/toxav.h"
+
+#include "shared/defmac.h"
+#include "shared/steady_timer.h"
+#include "shared/safe_singleton.h"
+#include "shared/qt/qthreadex.h"
+
+#include <QtCore>
+#include <atomic>
+
+/**
+  Поток передачи записанных голосовых фреймов абоненту. Поток пробуждается
+  модулем VoiceFilters сразу после обработки фрейма, применяет политику
+  очереди и подавление пауз (VAD) и передает фрейм в очередь sendQueue()
+  без копирования аудио-данных. В очередь передаются все фреймы записи,
+  в том числе когда звонка нет: фреймы, которые не должны быть отправлены,
+  передаются пустыми. Последним владельцем фреймов является поток ToxNet,
+  он возвращает их в recordFramePool().
+
+  Функция toxav_audio_send_frame() вызывается потоком ToxNet (см. sendQueued()),
+  который владеет tox-ядром: отправка фрейма не ожидает освобождения
+  ToxGlobalLock на время tox_iterate(), а поток VoiceSender не блокируется.
+*/
+class VoiceSender : public QThreadEx
+{
+public:
+    ~VoiceSender() = default;
+
+    void init(ToxAV* toxav) {_toxav = toxav;}
+    void wake();
+
+    // Начало/окончание передачи голосовых фреймов абоненту
+    void startSending(quint32 friendNumber);
+    void stopSending();
+
+    // Отправляет фреймы из очереди sendQueue() и возвращает их в пул.
+    // Вызывается только из потока ToxNet под ToxGlobalLock. Если ToxAV занят
+    // в потоке ToxCall (TOXAV_ERR_SEND_FRAME_SYNC), неотправленные фреймы
+    // остаются в очереди до следующего вызова
+    void sendQueued();
+
+private:
+    DISABLE_DEFAULT_COPY(VoiceSender)
+    VoiceSender() = default;
+    void run() override;
+
+    // Возвращает TRUE, если фрейм не передается из-за паузы в речи
+    bool silenceFrame(const VoiceFrame*);
+    void sendStat();
+    void sendLatency(bool summary);
+
+private:
+    ToxAV* _toxav = {nullptr};
+    std::atomic<quint32> _friendNumber = {quint32(-1)};
+
+    QMutex _threadLock;
+    QWaitCondition _threadCond;
+
+    size_t _recordBytes = {0};
+
+    // Подавление передачи фреймов во время пауз в речи (в миллисекундах)
+    quint32 _vadKeepalive = {400};
+    quint32 _silenceDuration = {0};
+
+    // Политика обработки очереди фреймов: если TRUE, то фреймы с задержкой
+    // больше _maxLatency (в микросекундах) отбрасываются
+    bool    _dropOldest = {true};
+    quint32 _maxLatency = {100000};
+
+    // Статистика передачи в течение звонка
+    data::VoiceSendStat _sendStat;
+
+    // Статистика отправки, заполняется потоком ToxNet (см. sendQueued())
+    std::atomic<quint32> _sentFrames = {0};
+    std::atomic<quint32> _sentMaxLatency = {0};
+    std::atomic<quint32> _sendBusy = {0};
+    steady_timer _latencyTimer;
+
+    template<typename T, int> friend T& safe::singleton();
+};
+VoiceSender& voiceSender();
@@ -1,7 +1,11 @@
 #include "toxphone_appl.h"
 #include "tox/tox_net.h"
 #include "tox/tox_call.h"
+#include "tox/voice_sender.h"
 #include "audio/audio_dev.h"
+#include "common/audio_kernels.h"
+#include "common/power_policy.h"
+#include "common/realtime.h"
 #include "common/voice_frame.h"
 #include "common/voice_filters.h"
 #include "diverter/phone_diverter.h"
@@ -33,11 +37,6 @@
 #include <signal.h>
 #endif
 
-#if defined(__SSE__) && defined(USE_SIMD)
-//#include <immintrin.h>
-#include <xmmintrin.h>
-#endif
-
 #include <sodium.h>
 #include <unistd.h>
 
@@ -89,11 +88,14 @@ void stopProgram()
     STOP_THREAD(udp::socket(),   "TransportUDP",  15)
     STOP_THREAD(phoneDiverter(), "PhoneDiverter", 15)
     STOP_THREAD(audioDev(),      "AudioDev",      15)
+    STOP_THREAD(voiceSender(),   "VoiceSender",   15)
     STOP_THREAD(toxCall(),       "ToxCall",       15)
     STOP_THREAD(toxNet(),        "ToxNet",        15)
 
     #undef STOP_THREAD
 
+    powerPolicy().deinit();
+
     log_info << "ToxPhone is stopped";
     alog::stop();
 
@@ -291,6 +293,14 @@ int main(int argc, char *argv[])
             return 1;
         }
 
+        // Выбор реализации векторизованных функций обработки звука
+        initAudioKernels();
+
+        // Блокировка памяти и параметры планирования главного потока.
+        // Привязка к процессорам наследуется потоками, создаваемыми далее
+        realtimeLockMemory();
+        realtimeSetupThread("main");
+
         // Пул потоков нужно активировать после кода демонизации
         trd::threadPool().start();
 
@@ -391,6 +401,7 @@ int main(int argc, char *argv[])
             return 1;
         }
         toxCall().start();
+        voiceSender().start();
 
         if (!audioDev().init()
             || !audioDev().start())
@@ -418,6 +429,8 @@ int main(int argc, char *argv[])
         usleep(200*1000);
         appl.initPhoneDiverter();
 
+        powerPolicy().init();
+
         QMetaObject::invokeMethod(&appl, "sendToxPhoneInfo", Qt::QueuedConnection);
 
         ret = appl.exec();
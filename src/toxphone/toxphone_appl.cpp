@@ -5,6 +5,7 @@
 #include "tox/tox_net.h"
 
 #include "common/functions.h"
+#include "common/power_policy.h"
 #include "audio/audio_dev.h"
 
 #include "shared/logger/logger.h"
@@ -34,6 +35,7 @@ Application::Application(int &argc, char **argv)
     : QCoreApplication(argc, argv)
 {
     _stopTimerId = startTimer(1000);
+    _powerPolicyTimerId = startTimer(1000);
 
     chk_connect_q(&tcp::listener(), &tcp::Listener::message,
                   this, &Application::message)
@@ -79,6 +81,10 @@ void Application::timerEvent(QTimerEvent* event)
             return;
         }
     }
+    else if (event->timerId() == _powerPolicyTimerId)
+    {
+        powerPolicy().update();
+    }
 }
 
 void Application::stop(int exitCode)
@@ -228,26 +234,20 @@ void Application::command_ToxCallState(const Message::Ptr& message)
 {
     readFromMessage(message, _callState);
 
-    QFile pipe {"/tmp/toxphone/cpufreq"};
-    if (pipe.exists())
+    // Частота процессора поднимается с началом установки соединения,
+    // а не после ответа абонента
+    if (_callState.callState == data::ToxCallState::CallState::WaitingAnswer)
+        powerPolicy().callSetup();
+    else if (_callState.callState == data::ToxCallState::CallState::InProgress)
+        powerPolicy().callStarted();
+    else if (_callState.direction == data::ToxCallState::Direction::Undefined
+             && _callState.callState == data::ToxCallState::CallState::Undefined
+             && !(diverterIsActive()
+                  && phoneDiverter().handset() == PhoneDiverter::Handset::On))
     {
-        // Изменяем частоту работы процессора
-        if (pipe.open(QIODevice::WriteOnly))
-        {
-            const char* command = "cpufreq-max\n";
-            if (_callState.direction == data::ToxCallState::Direction::Undefined
-                && _callState.callState == data::ToxCallState::CallState::Undefined)
-            {
-                command = "cpufreq-default\n";
-            }
-            if (pipe.write(command) == -1)
-                log_error_m << "Failed write command " << command
-                            << " to pipe /tmp/toxphone/cpufreq";
-            pipe.flush();
-            pipe.close();
-        }
-        else
-            log_error_m << "Failed open pipe /tmp/toxphone/cpufreq at write-mode";
+        // При снятой трубке ожидается набор номера, частота остается
+        // поднятой (см. phoneDiverterHandset())
+        powerPolicy().callFinished();
     }
 
     if (!diverterIsActive())
@@ -920,12 +920,16 @@ void Application::phoneDiverterHandset(PhoneDiverter::Handset handset)
                  && _callState.callState == data::ToxCallState::CallState::Undefined)
         {
             setDiverterToDefaultState();
+            powerPolicy().callFinished();
         }
     }
     else // PhoneDiverter::Handset::On
     {
         _diverterHandsetTimer.restart();
 
+        // Трубка снята: ожидается набор номера или ответ на вызов
+        powerPolicy().callSetup();
+
         // Принять входящий вызов
         if (_callState.direction == data::ToxCallState::Direction::Incoming
             && _callState.callState == data::ToxCallState::CallState::WaitingAnswer)
@@ -79,6 +79,7 @@ private:
 
 private:
     int _stopTimerId = {-1};
+    int _powerPolicyTimerId = {-1};
     static volatile bool _stop;
     static std::atomic_int _exitCode;
 